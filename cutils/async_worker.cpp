@@ -4,8 +4,11 @@
 #include <poll.h>
 #include <sys/prctl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <chrono>
 
 #include "cutils.h"
+#include "trace.h"
 
 namespace cutils {
 
@@ -30,8 +33,11 @@ std::string AsyncSeqTaskProfiler::Format() {
     for (int i = 0; i < n; ++i) {
         ss << " worker_" << i << "_beg " << worker_beg_ts[i]
            << " worker_" << i << "_end " << worker_end_ts[i]
-           << " worker_" << i << "_queue " << worker_beg_ts[i] - beg_ts
-           << " worker_" << i << "_handle " << worker_handle[i];
+           << " worker_" << i << "_queue " << worker_beg_ts[i] - beg_ts;
+        // filled by RunSeqTaskAndWait, may be missing from a hand made one
+        if (i < (int)worker_handle.size()) {
+            ss << " worker_" << i << "_handle " << worker_handle[i];
+        }
     }
     ss << " task_runtime";
     for (size_t i = 0; i < task_runtime.size(); ++i) {
@@ -44,12 +50,15 @@ void AsyncWorkerPool::WorkerRun(WorkerInititalizer initializer, bool& stop) {
     if (initializer) initializer();
 
     AsyncTask task;
-    while (!stop) {
+    while (!IsStopped(stop)) {
         bool got = queue_.TryPop(&task, 1000);
-        if (stop) break;
+        if (IsStopped(stop)) break;
         if (got) {
             active_worker_++;
-            task();
+            {
+                CUTILS_TRACE_SPAN("AsyncWorkerPool::task");
+                task();
+            }
             active_worker_--;
         }
     }
@@ -65,6 +74,13 @@ AsyncWorkerPool::AsyncWorkerPool(
 }
 
 AsyncWorkerPool::~AsyncWorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(timer_mutex_);
+        timer_stop_ = true;
+    }
+    timer_cv_.notify_all();
+    timer_ = nullptr;
+
     for (auto& worker : workers_) {
         worker->Stop();
     }
@@ -72,9 +88,66 @@ AsyncWorkerPool::~AsyncWorkerPool() {
 }
 
 void AsyncWorkerPool::AddTask(AsyncTask task) {
+    if (trace::Enabled()) {
+        // time spent queued shows up on the worker that runs the task
+        static const uint16_t wait_id =
+            trace::RegisterName("AsyncWorkerPool::queue_wait");
+        uint64_t enqueued = trace::Now();
+        AsyncTask inner = std::move(task);
+        task = [inner, enqueued] {
+            trace::Record(wait_id, enqueued, trace::Now());
+            inner();
+        };
+    }
+    CUTILS_TRACE_SPAN("AsyncWorkerPool::push");
     queue_.Push(std::move(task));
 }
 
+bool AsyncWorkerPool::LaterDeadline(const TimedTask& a, const TimedTask& b) {
+    return a.deadline != b.deadline ? a.deadline > b.deadline : a.seq > b.seq;
+}
+
+void AsyncWorkerPool::AddTaskAt(uint64_t deadline_ns, AsyncTask task) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> guard(timer_mutex_);
+        if (timer_ == nullptr) {
+            timer_ = AsyncWorker::Make(&AsyncWorkerPool::TimerRun, this);
+        }
+        TimedTask timed = {deadline_ns, timer_seq_++, std::move(task)};
+        timers_.push_back(std::move(timed));
+        std::push_heap(timers_.begin(), timers_.end(), LaterDeadline);
+        // only a new earliest deadline changes the timer's wait
+        wake = timers_.front().seq == timer_seq_ - 1;
+    }
+    if (wake) timer_cv_.notify_one();
+}
+
+void AsyncWorkerPool::TimerRun(bool& /*stop*/) {
+    SetThreadTitle("pool_timer");
+    // stopped through timer_stop_, which also wakes the wait
+    std::unique_lock<std::mutex> lock(timer_mutex_);
+    while (!timer_stop_) {
+        if (timers_.empty()) {
+            timer_cv_.wait(lock);
+            continue;
+        }
+        uint64_t now = MonotonicNanos();
+        if (timers_.front().deadline > now) {
+            timer_cv_.wait_for(lock, std::chrono::nanoseconds(
+                        timers_.front().deadline - now));
+            continue;
+        }
+        std::pop_heap(timers_.begin(), timers_.end(), LaterDeadline);
+        AsyncTask task = std::move(timers_.back().task);
+        timers_.pop_back();
+        // AddTask may block on a full queue
+        lock.unlock();
+        AddTask(std::move(task));
+        lock.lock();
+    }
+}
+
 int AsyncWorkerPool::RunSeqTaskAndWait(
         int concur, int max_seq, AsyncSeqTask seq_task,
         AsyncSeqTaskProfiler* profiler) {
@@ -85,7 +158,7 @@ int AsyncWorkerPool::RunSeqTaskAndWait(
     if (profiler) {
         profiler->concur = concur;
         profiler->max_seq = max_seq;
-        profiler->beg_ts = time(0);
+        profiler->beg_ts = MonotonicMillis();
         profiler->worker_beg_ts.resize(concur);
         profiler->worker_end_ts.resize(concur);
         profiler->worker_handle.resize(concur);
@@ -97,7 +170,7 @@ int AsyncWorkerPool::RunSeqTaskAndWait(
                       profiler, concur, max_seq, seq_task, fds]{
         int worker_id = (wid++);
         if (profiler) {
-            profiler->worker_beg_ts[worker_id] = time(0);
+            profiler->worker_beg_ts[worker_id] = MonotonicMillis();
         }
         while (seq_alloc < max_seq) {
             int seq = (seq_alloc++);
@@ -107,7 +180,7 @@ int AsyncWorkerPool::RunSeqTaskAndWait(
                     TimeDiff td;
                     seq_task(seq, errcode);
                     td.Stop();
-                    profiler->task_runtime[seq] = td.ElapsedInSecond();
+                    profiler->task_runtime[seq] = td.ElapsedInMillisecond();
                     profiler->worker_handle[worker_id]++;
                 } else {
                     seq_task(seq, errcode);
@@ -117,7 +190,7 @@ int AsyncWorkerPool::RunSeqTaskAndWait(
             }
         }
         if (profiler) {
-            profiler->worker_end_ts[worker_id] = time(0);
+            profiler->worker_end_ts[worker_id] = MonotonicMillis();
         }
         if ((++exited) == concur) {
             char c = 'o';
@@ -127,10 +200,11 @@ int AsyncWorkerPool::RunSeqTaskAndWait(
     };
 
     for (int i = 0; i < concur; ++i) {
-        queue_.Push(task);
+        AddTask(task);
     }
 
     {
+        CUTILS_TRACE_SPAN("AsyncWorkerPool::wait");
         char c;
         int ret = read(fds[0], &c, sizeof(c));
         hassert(ret == sizeof(c), "%d %d", ret, errno);
@@ -139,27 +213,27 @@ int AsyncWorkerPool::RunSeqTaskAndWait(
     close(fds[1]);
 
     if (profiler) {
-        profiler->end_ts = time(0);
+        profiler->end_ts = MonotonicMillis();
     }
     return errcode;
 }
 
 void CEventTick::BGWorker(bool& stop) {
     SetThreadTitle("cevent_bg");
-    uint64_t last_10_ = GetTimeStampInMS();
-    uint64_t last_60_ = GetTimeStampInMS();
-    while (!stop) {
-        uint64_t bt = GetTimeStampInMS();
+    uint64_t last_10_ = MonotonicMillis();
+    uint64_t last_60_ = MonotonicMillis();
+    while (!IsStopped(stop)) {
+        uint64_t bt = MonotonicMillis();
         for (auto e : events_1s_) e();
         if (bt - last_10_ >= 10000) {
             for (auto e : events_10s_) e();
-            last_10_ = GetTimeStampInMS();
+            last_10_ = MonotonicMillis();
         }
         if (bt - last_60_ >= 60000) {
             for (auto e : events_60s_) e();
-            last_60_ = GetTimeStampInMS();
+            last_60_ = MonotonicMillis();
         }
-        uint64_t rt = GetTimeStampInMS() - bt;
+        uint64_t rt = MonotonicMillis() - bt;
         if (rt < 1000) {
             poll(nullptr, 0, 1000 - rt);
         }
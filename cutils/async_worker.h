@@ -2,7 +2,9 @@
 
 #include <future>
 #include <cassert>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 
 #include "cqueue.h"
 #include "singleton.h"
@@ -10,6 +12,12 @@
 
 namespace cutils {
 
+// The "stop" flag an AsyncWorker passes to its function is set by Stop()
+// from another thread, so the function polls it through IsStopped().
+inline bool IsStopped(const bool& stop) {
+    return __atomic_load_n(&stop, __ATOMIC_ACQUIRE);
+}
+
 class AsyncWorker {
 public:
     template <typename WorkerType, typename ...Args>
@@ -33,11 +41,11 @@ public:
     }
 
     void Stop() {
-        stop_ = true;
+        __atomic_store_n(&stop_, true, __ATOMIC_RELEASE);
     }
 
     ~AsyncWorker() {
-        stop_ = true;
+        Stop();
         if (worker_.valid()) {
             worker_.get();
         }
@@ -63,6 +71,8 @@ using AsyncTask = std::function<void()>;
 using WorkerInititalizer = std::function<void()>;
 using AsyncSeqTask = std::function<void(int, std::atomic<int>&)>;
 
+// Timestamps are MonotonicMillis() truncated to 32 bits, so only their
+// differences mean something; task_runtime is in milliseconds.
 struct AsyncSeqTaskProfiler {
     int      concur;
     int      max_seq;
@@ -78,13 +88,29 @@ struct AsyncSeqTaskProfiler {
 
 class AsyncWorkerPool {
 private:
+    struct TimedTask {
+        uint64_t deadline;
+        uint64_t seq;
+        AsyncTask task;
+    };
+
     int tot_worker_ = 0;
     BlockingCQueue<AsyncTask> queue_;
     std::atomic<int> active_worker_;
     std::vector<AsyncWorkerPtr> workers_;
 
+    // min heap of tasks waiting for their deadline, run by timer_
+    std::mutex timer_mutex_;
+    std::condition_variable timer_cv_;
+    std::vector<TimedTask> timers_;
+    uint64_t timer_seq_ = 0;
+    bool timer_stop_ = false;
+    AsyncWorkerPtr timer_ = nullptr;
+
 private:
     void WorkerRun(WorkerInititalizer initializer, bool& stop);
+    void TimerRun(bool& stop);
+    static bool LaterDeadline(const TimedTask& a, const TimedTask& b);
 
 public:
     AsyncWorkerPool(int tot_worker, int queue_size = 1, 
@@ -96,6 +122,16 @@ public:
     size_t QueuingTaskCount() { return queue_.Size(); }
 
     void AddTask(AsyncTask task);
+
+    // Queue the task once MonotonicNanos() reaches deadline_ns, without
+    // holding a worker while waiting.  Tasks with the same deadline run
+    // in the order they were added.  A timer thread starts on first use;
+    // tasks still waiting when the pool is destroyed are dropped.
+    void AddTaskAt(uint64_t deadline_ns, AsyncTask task);
+    void AddTaskAfter(uint64_t delay_ns, AsyncTask task) {
+        AddTaskAt(MonotonicNanos() + delay_ns, std::move(task));
+    }
+
     int RunSeqTaskAndWait(int concur, int max_seq, AsyncSeqTask seq_task, 
                           AsyncSeqTaskProfiler* profiler = nullptr);
 };
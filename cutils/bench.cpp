@@ -0,0 +1,1140 @@
+#include "async_worker.h"
+#include "buffer.h"
+#include "cached_clock.h"
+#include "circle_queue.h"
+#include "clock.h"
+#include "concurrency_limiter.h"
+#include "crc32c.h"
+#include "distribution.h"
+#include "cutils.h"
+#include "dir_scan.h"
+#include "file.h"
+#include "keyed_limiter.h"
+#include "log_reader.h"
+#include "log_writer.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "stream_vbyte.h"
+#include "trace.h"
+#include "workload.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <regex>
+#include <thread>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace cutils;
+
+namespace {
+
+uint64_t NowNs() { return MonotonicNanos(); }
+
+// Command line, see Usage()
+struct BenchOptions {
+    std::string filter;
+    std::string format = "text";
+    int rounds = 0;
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t warmup_ns = 20000000;
+} g_options;
+
+std::regex g_filter;
+int g_reported = 0;
+
+void Usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [--filter=REGEX] [--format=text|csv|json]\n"
+            "       [--rounds=N] [--threads=N] [--warmup_ms=N]\n"
+            "\n"
+            "  --filter     run only the benchmarks whose name matches\n"
+            "  --format     csv and json print one record per benchmark,\n"
+            "               notes go to stderr\n"
+            "  --rounds     timed rounds per benchmark instead of its own\n"
+            "  --threads    multi-threaded benchmarks run at 1, 2, 4, ...\n"
+            "               up to N threads, default one per CPU\n"
+            "  --warmup_ms  untimed rounds run for at least this long\n",
+            prog);
+}
+
+bool ParseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* eq = strchr(arg, '=');
+        std::string key(arg, eq ? eq - arg : strlen(arg));
+        const char* val = eq ? eq + 1 : "";
+        if (key == "--filter") {
+            g_options.filter = val;
+        } else if (key == "--format") {
+            g_options.format = val;
+            if (g_options.format != "text" && g_options.format != "csv" &&
+                g_options.format != "json") {
+                return false;
+            }
+        } else if (key == "--rounds") {
+            g_options.rounds = atoi(val);
+        } else if (key == "--threads") {
+            g_options.max_threads = std::max(1, atoi(val));
+        } else if (key == "--warmup_ms") {
+            g_options.warmup_ns = strtoull(val, nullptr, 10) * 1000000;
+        } else {
+            return false;
+        }
+    }
+    g_filter = std::regex(g_options.filter);
+    return true;
+}
+
+bool Wanted(const std::string& name) {
+    return g_options.filter.empty() || std::regex_search(name, g_filter);
+}
+
+// Informational lines, kept out of the csv / json records
+void Note(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void Note(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(g_options.format == "text" ? stdout : stderr, fmt, ap);
+    va_end(ap);
+}
+
+// 1, 2, 4, ... up to --threads, which is always included
+std::vector<int> ThreadCounts() {
+    std::vector<int> res;
+    for (int t = 1; t < g_options.max_threads; t *= 2) res.push_back(t);
+    res.push_back(g_options.max_threads);
+    return res;
+}
+
+struct Timing {
+    uint64_t ns;
+    uint64_t cycles;
+};
+
+std::string JsonEscape(const std::string& s) {
+    std::string res;
+    for (char c : s) {
+        if (c == '"' || c == '\\') res.push_back('\\');
+        res.push_back(c);
+    }
+    return res;
+}
+
+void PrintHeader() {
+    if (g_options.format == "csv") {
+        printf("name,threads,items,rounds,ns_per_op,ns_per_op_median,"
+               "ns_per_op_max,ops_per_sec,cycles_per_op\n");
+    } else if (g_options.format == "json") {
+        time_t now = time(nullptr);
+        char date[64];
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+        printf("{\n  \"context\": {\"date\": \"%s\", \"num_cpus\": %u, "
+               "\"tsc_invariant\": %s, \"tsc_ghz\": %.3f, "
+               "\"crc32c_kernel\": \"%s\"},\n  \"benchmarks\": [",
+               date, std::thread::hardware_concurrency(),
+               TscIsInvariant() ? "true" : "false", TscTicksPerNano(),
+               crc32c::KernelName(crc32c::CurrentKernel()));
+    } else {
+        printf("%-40s %3s %10s %10s %10s %10s %10s\n", "name", "thr",
+               "M/s", "ns/op", "median", "max", "cycles/op");
+    }
+}
+
+void PrintFooter() {
+    if (g_options.format == "json") printf("\n  ]\n}\n");
+}
+
+// Report the rounds of a benchmark that did "items" operations per round:
+// throughput and cycles of the best round, and the median and worst
+// per-round cost (a handful of rounds is too few for tail percentiles).
+// Cycles are TSC ticks, which run at the nominal frequency whatever the
+// actual clock of the core.
+void Report(const std::string& name, int threads, size_t items,
+            const std::vector<Timing>& rounds) {
+    std::vector<uint64_t> ns;
+    for (auto& r : rounds) ns.push_back(r.ns);
+    std::sort(ns.begin(), ns.end());
+    double median = (double)ns[(ns.size() - 1) / 2] / items;
+    double worst = (double)ns.back() / items;
+    const Timing* best = &rounds[0];
+    for (auto& r : rounds) {
+        if (r.ns < best->ns) best = &r;
+    }
+    double ns_per_op = (double)best->ns / items;
+    double ops = items * 1e9 / std::max<uint64_t>(best->ns, 1);
+    double cycles = (double)best->cycles / items;
+    if (g_options.format == "csv") {
+        printf("%s,%d,%zu,%zu,%.3f,%.3f,%.3f,%.0f,%.2f\n", name.c_str(),
+               threads, items, rounds.size(), ns_per_op, median, worst, ops,
+               cycles);
+    } else if (g_options.format == "json") {
+        printf("%s\n    {\"name\": \"%s\", \"threads\": %d, \"items\": %zu, "
+               "\"rounds\": %zu, \"ns_per_op\": %.3f, "
+               "\"ns_per_op_median\": %.3f, \"ns_per_op_max\": %.3f, "
+               "\"ops_per_sec\": %.0f, \"cycles_per_op\": %.2f}",
+               g_reported > 0 ? "," : "", JsonEscape(name).c_str(), threads,
+               items, rounds.size(), ns_per_op, median, worst, ops, cycles);
+    } else {
+        printf("%-40s %3d %10.2f %10.3f %10.3f %10.3f %10.2f\n",
+               name.c_str(), threads, ops / 1e6, ns_per_op, median, worst,
+               cycles);
+    }
+    fflush(stdout);
+    ++g_reported;
+}
+
+// Run "round" untimed for --warmup_ms (at least once), then "rounds"
+// times, or --rounds if given.  "round" returns its own timing.
+template <typename Round>
+void Measure(const std::string& name, int threads, size_t items, int rounds,
+             Round round) {
+    if (!Wanted(name)) return;
+    uint64_t warmup_end = NowNs() + g_options.warmup_ns;
+    do {
+        round();
+    } while (NowNs() < warmup_end);
+    if (g_options.rounds > 0) rounds = g_options.rounds;
+    std::vector<Timing> timings;
+    for (int i = 0; i < rounds; ++i) timings.push_back(round());
+    Report(name, threads, items, timings);
+}
+
+// Single threaded: "func" does "items" operations per call
+template <typename Func>
+void RunBench(const std::string& name, size_t items, int rounds, Func func) {
+    Measure(name, 1, items, rounds, [&]() {
+        Timing t;
+        uint64_t beg = NowNs();
+        uint64_t beg_cycles = ReadTsc();
+        func();
+        t.cycles = ReadTsc() - beg_cycles;
+        t.ns = NowNs() - beg;
+        return t;
+    });
+}
+
+// "threads" threads run func(tid) at once, doing "items" operations in
+// total per round.  A round is timed from the moment all of them are
+// released until the last one is done, so thread creation is not counted.
+template <typename Func>
+void RunBenchThreads(const std::string& name, int threads, size_t items,
+                     int rounds, Func func) {
+    Measure(name, threads, items, rounds, [&]() {
+        std::atomic<int> ready(0);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back([&, i]() {
+                ready.fetch_add(1);
+                while (!go.load(std::memory_order_acquire)) sched_yield();
+                func(i);
+            });
+        }
+        while (ready.load() < threads) sched_yield();
+        Timing t;
+        uint64_t beg = NowNs();
+        uint64_t beg_cycles = ReadTsc();
+        go.store(true, std::memory_order_release);
+        for (auto& w : workers) w.join();
+        t.cycles = ReadTsc() - beg_cycles;
+        t.ns = NowNs() - beg;
+        return t;
+    });
+}
+
+volatile uint64_t g_sink = 0;
+
+template <typename T>
+std::vector<T> MakeInts(size_t n, int max_bits, bool sorted) {
+    std::vector<T> v(n);
+    int seed = 20180917;
+    uint64_t acc = 0;
+    for (size_t i = 0; i < n; ++i) {
+        seed = FastRand(seed);
+        int bits = seed % (max_bits + 1);
+        seed = FastRand(seed);
+        uint64_t x = (((uint64_t)seed << 31) | FastRand(seed));
+        x = bits == 0 ? 0 : (x & (~0ULL >> (64 - bits)));
+        if (sorted) {
+            acc += x;
+            x = acc;
+        }
+        v[i] = (T)x;
+    }
+    return v;
+}
+
+void PutVarintT(std::string* dst, uint32_t v) { PutVarint32(dst, v); }
+void PutVarintT(std::string* dst, uint64_t v) { PutVarint64(dst, v); }
+bool GetVarintT(Slice* in, uint32_t* v) { return GetVarint32(in, v); }
+bool GetVarintT(Slice* in, uint64_t* v) { return GetVarint64(in, v); }
+
+void PutVarintBatchT(std::string* dst, const std::vector<uint32_t>& in) {
+    PutVarint32Batch(dst, in.data(), in.size());
+}
+void PutVarintBatchT(std::string* dst, const std::vector<uint64_t>& in) {
+    PutVarint64Batch(dst, in.data(), in.size());
+}
+bool GetVarintBatchT(Slice* in, std::vector<uint32_t>* out) {
+    return GetVarint32Batch(in, out->data(), out->size());
+}
+bool GetVarintBatchT(Slice* in, std::vector<uint64_t>* out) {
+    return GetVarint64Batch(in, out->data(), out->size());
+}
+
+void PutStreamVByteT(std::string* dst, const std::vector<uint32_t>& in,
+                     bool delta) {
+    PutStreamVByte32(dst, in.data(), in.size(), delta);
+}
+void PutStreamVByteT(std::string* dst, const std::vector<uint64_t>& in,
+                     bool delta) {
+    PutStreamVByte64(dst, in.data(), in.size(), delta);
+}
+bool GetStreamVByteT(Slice* in, std::vector<uint32_t>* out, bool delta) {
+    return GetStreamVByte32(in, out, delta);
+}
+bool GetStreamVByteT(Slice* in, std::vector<uint64_t>* out, bool delta) {
+    return GetStreamVByte64(in, out, delta);
+}
+
+// LevelDB varint one by one, in batch, and Stream VByte side by side
+template <typename T>
+void BenchVarintCodec(const char* tag, int max_bits, bool sorted) {
+    const size_t n = 1 << 20;
+    const int rounds = 10;
+    const int bits = sizeof(T) * 8;
+    std::vector<T> in = MakeInts<T>(n, max_bits, sorted);
+    std::vector<T> out(n);
+    char name[64];
+
+    std::string varint;
+    for (auto v : in) PutVarintT(&varint, v);
+    std::string svb;
+    PutStreamVByteT(&svb, in, sorted);
+
+    snprintf(name, sizeof(name), "varint%d/%s/encode", bits, tag);
+    RunBench(name, n, rounds, [&]() {
+        std::string buf;
+        for (auto v : in) PutVarintT(&buf, v);
+        g_sink += buf.size();
+    });
+    snprintf(name, sizeof(name), "varint%d/%s/encode_batch", bits, tag);
+    RunBench(name, n, rounds, [&]() {
+        std::string buf;
+        PutVarintBatchT(&buf, in);
+        g_sink += buf.size();
+    });
+    snprintf(name, sizeof(name), "varint%d/%s/decode", bits, tag);
+    RunBench(name, n, rounds, [&]() {
+        Slice s(varint);
+        for (size_t i = 0; i < n; ++i) GetVarintT(&s, &out[i]);
+        g_sink += out[n - 1];
+    });
+    snprintf(name, sizeof(name), "varint%d/%s/decode_batch", bits, tag);
+    RunBench(name, n, rounds, [&]() {
+        Slice s(varint);
+        GetVarintBatchT(&s, &out);
+        g_sink += out[n - 1];
+    });
+    snprintf(name, sizeof(name), "streamvbyte%d/%s/encode", bits, tag);
+    RunBench(name, n, rounds, [&]() {
+        std::string buf;
+        PutStreamVByteT(&buf, in, sorted);
+        g_sink += buf.size();
+    });
+    snprintf(name, sizeof(name), "streamvbyte%d/%s/decode", bits, tag);
+    RunBench(name, n, rounds, [&]() {
+        Slice s(svb);
+        GetStreamVByteT(&s, &out, sorted);
+        g_sink += out[n - 1];
+    });
+    if (!Wanted(name)) return;
+    if (out != in) {
+        Note("%s: streamvbyte mismatch\n", tag);
+    }
+    Note("%-40s varint %zu bytes streamvbyte %zu bytes\n", tag,
+         varint.size(), svb.size());
+}
+
+void BenchCoding() {
+    BenchVarintCodec<uint32_t>("small", 7, false);
+    BenchVarintCodec<uint32_t>("random", 32, false);
+    BenchVarintCodec<uint32_t>("sorted", 8, true);
+    BenchVarintCodec<uint64_t>("random", 64, false);
+    BenchVarintCodec<uint64_t>("sorted", 12, true);
+}
+
+// Every supported kernel over a range of buffer sizes, in MB/s
+void BenchCrc32c() {
+    const size_t sizes[] = {64, 256, 4096, 65536, 1 << 20};
+    const crc32c::Kernel kernels[] = {crc32c::kTable, crc32c::kSSE42,
+                                      crc32c::kSSE42Pclmul, crc32c::kPower8};
+    std::string buf(1 << 20, 0);
+    int seed = 20180917;
+    for (auto& c : buf) {
+        seed = FastRand(seed);
+        c = (char)seed;
+    }
+    char name[64];
+    for (auto kernel : kernels) {
+        if (!crc32c::IsKernelSupported(kernel)) continue;
+        for (size_t size : sizes) {
+            // about 16MB per round whatever the buffer size
+            size_t loops = (16 << 20) / size;
+            snprintf(name, sizeof(name), "crc32c/%s/%zu",
+                     crc32c::KernelName(kernel), size);
+            RunBench(name, loops * size, 5, [&]() {
+                uint32_t crc = 0;
+                for (size_t i = 0; i < loops; ++i) {
+                    crc = crc32c::ExtendWith(kernel, crc, buf.data(), size);
+                }
+                g_sink += crc;
+            });
+        }
+    }
+
+    std::string big(64 << 20, 0);
+    for (size_t i = 0; i < big.size(); i += 4096) big[i] = (char)i;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    AsyncWorkerPool pool(threads, threads);
+    RunBench("crc32c/extend/64M", big.size(), 5, [&]() {
+        g_sink += crc32c::Value(big.data(), big.size());
+    });
+    snprintf(name, sizeof(name), "crc32c/parallel_x%d/64M", threads);
+    RunBench(name, big.size(), 5, [&]() {
+        g_sink += ParallelCrc32c(big.data(), big.size(), &pool);
+    });
+    // copy-then-checksum against the fused kernel
+    std::string dst(big.size(), 0);
+    const size_t copy_sizes[] = {256, 4096, 65536, 1 << 20, 32 << 20};
+    for (size_t size : copy_sizes) {
+        size_t loops = (64 << 20) / size;
+        snprintf(name, sizeof(name), "crc32c/memcpy+extend/%zu", size);
+        RunBench(name, loops * size, 5, [&]() {
+            uint32_t crc = 0;
+            for (size_t i = 0; i < loops; ++i) {
+                size_t off = (i * size) % big.size();
+                memcpy(&dst[off], &big[off], size);
+                crc = crc32c::Extend(crc, &dst[off], size);
+            }
+            g_sink += crc;
+        });
+        snprintf(name, sizeof(name), "crc32c/copy_and_crc/%zu", size);
+        RunBench(name, loops * size, 5, [&]() {
+            uint32_t crc = 0;
+            for (size_t i = 0; i < loops; ++i) {
+                size_t off = (i * size) % big.size();
+                crc = CopyAndCrc32c(&dst[off], &big[off], size, crc);
+            }
+            g_sink += crc;
+        });
+    }
+    // many small records, one by one and batched with the mask applied
+    const size_t rec_sizes[] = {64, 256, 1024};
+    for (size_t size : rec_sizes) {
+        const size_t n = 4096;
+        std::vector<const char*> ptrs(n);
+        std::vector<size_t> lens(n, size);
+        std::vector<uint32_t> crcs(n);
+        for (size_t i = 0; i < n; ++i) ptrs[i] = &big[i * size];
+        snprintf(name, sizeof(name), "crc32c/records_loop/%zu", size);
+        RunBench(name, n, 10, [&]() {
+            for (size_t i = 0; i < n; ++i) {
+                crcs[i] = crc32c::Mask(crc32c::Value(ptrs[i], lens[i]));
+            }
+            g_sink += crcs[n - 1];
+        });
+        snprintf(name, sizeof(name), "crc32c/records_batch/%zu", size);
+        RunBench(name, n, 10, [&]() {
+            Crc32cBatch(ptrs.data(), lens.data(), n, crcs.data(), true);
+            g_sink += crcs[n - 1];
+        });
+    }
+    RunBench("crc32c/combine", 1 << 16, 5, [&]() {
+        uint32_t crc = 0;
+        for (uint32_t i = 0; i < (1 << 16); ++i) {
+            crc = Crc32cCombine(crc, i, (size_t)i * 7919);
+        }
+        g_sink += crc;
+    });
+}
+
+// Framing cost of log::Writer (to /dev/null) and log::Reader from memory
+void BenchLog() {
+    const size_t record_sizes[] = {100, 1000, 100000};
+    for (size_t size : record_sizes) {
+        const size_t n = (64 << 20) / size;
+        std::string record(size, 'x');
+        char name[64];
+
+        int fd = open("/dev/null", O_WRONLY);
+        snprintf(name, sizeof(name), "log/write/%zu", size);
+        RunBench(name, n, 5, [&]() {
+            log::Writer writer(fd);
+            for (size_t i = 0; i < n; ++i) writer.AddRecord(record);
+        });
+        close(fd);
+
+        char path[] = "/tmp/cutils_bench_log.XXXXXX";
+        fd = mkstemp(path);
+        unlink(path);
+        {
+            log::Writer writer(fd);
+            for (size_t i = 0; i < n; ++i) writer.AddRecord(record);
+        }
+        std::string data(lseek(fd, 0, SEEK_END), 0);
+        pread(fd, &data[0], data.size(), 0);
+        close(fd);
+        snprintf(name, sizeof(name), "log/read/%zu", size);
+        RunBench(name, n, 5, [&]() {
+            log::Reader reader(data);
+            Slice rec;
+            while (reader.ReadRecord(&rec)) g_sink += rec.size();
+        });
+    }
+}
+
+// Recursive listing of a tree of 64 x 256 empty files: opendir / readdir
+// with a stat per entry as ScanFiles callers used to, against ScanDir
+// on one thread and on a pool
+size_t ReaddirTree(const std::string& dir) {
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr) return 0;
+    size_t n = 0;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        std::string path = dir + "/" + ent->d_name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) continue;
+        ++n;
+        if (S_ISDIR(st.st_mode)) n += ReaddirTree(path);
+    }
+    closedir(d);
+    return n;
+}
+
+void BenchDirScan() {
+    std::vector<int> thread_counts = ThreadCounts();
+    std::vector<std::string> pool_names;
+    bool wanted = Wanted("dir/readdir+stat") || Wanted("dir/ScanDir");
+    for (int threads : thread_counts) {
+        pool_names.push_back("dir/ScanDir(pool" + std::to_string(threads) +
+                             ")");
+        wanted = wanted || Wanted(pool_names.back());
+    }
+    if (!wanted) return;
+
+    const int dirs = 64, files = 256;
+    const size_t n = dirs * (files + 1);
+    char root[] = "/tmp/cutils_bench_scan.XXXXXX";
+    if (mkdtemp(root) == nullptr) return;
+    for (int i = 0; i < dirs; ++i) {
+        std::string dir = std::string(root) + "/d" + std::to_string(i);
+        mkdir(dir.c_str(), 0755);
+        for (int j = 0; j < files; ++j) {
+            Touch(dir + "/f" + std::to_string(j));
+        }
+    }
+
+    RunBench("dir/readdir+stat", n, 5, [&]() { g_sink += ReaddirTree(root); });
+    ScanOptions options;
+    options.recursive = true;
+    options.include_dirs = true;
+    std::atomic<uint64_t> types(0);
+    auto callback = [&](const DirEntry& entry) {
+        types.fetch_add(entry.type, std::memory_order_relaxed);
+        return true;
+    };
+    RunBench("dir/ScanDir", n, 5, [&]() { ScanDir(root, options, callback); });
+    for (size_t i = 0; i < thread_counts.size(); ++i) {
+        AsyncWorkerPool pool(thread_counts[i], 1024);
+        options.pool = &pool;
+        RunBench(pool_names[i], n, 5,
+                 [&]() { ScanDir(root, options, callback); });
+    }
+    g_sink += types.load();
+    DeleteFileOrDir(root, 1);
+}
+
+// Reading a 64MB file (from the page cache) to crc32c it: open + pread
+// into a std::string as our readers do, against MappedFile
+void BenchMappedFile() {
+    if (!Wanted("file/pread") && !Wanted("file/MappedFile") &&
+        !Wanted("file/MappedFile(populate)")) {
+        return;
+    }
+    const size_t size = 64 << 20;
+    char path[] = "/tmp/cutils_bench_map.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    std::string data(size, 'x');
+    for (size_t i = 0; i < size; i += 4096) data[i] = (char)i;
+    pwrite(fd, data.data(), data.size(), 0);
+    close(fd);
+
+    RunBench("file/pread", size, 5, [&]() {
+        int fd = open(path, O_RDONLY);
+        std::string buf(lseek(fd, 0, SEEK_END), 0);
+        pread(fd, &buf[0], buf.size(), 0);
+        close(fd);
+        g_sink += crc32c::Value(buf.data(), buf.size());
+    });
+    RunBench("file/MappedFile", size, 5, [&]() {
+        MappedFile file;
+        file.Open(path);
+        g_sink += crc32c::Value(file.data().data(), file.size());
+    });
+    MappedFile::Options options;
+    options.populate = true;
+    options.advice = MappedFile::kSequential;
+    RunBench("file/MappedFile(populate)", size, 5, [&]() {
+        MappedFile file;
+        file.Open(path, options);
+        g_sink += crc32c::Value(file.data().data(), file.size());
+    });
+    unlink(path);
+}
+
+// Cost of one read of each time source
+void BenchClock() {
+    const size_t n = 1 << 22;
+    RunBench("clock/gettimeofday", n, 5, [&]() {
+        struct timeval tv;
+        for (size_t i = 0; i < n; ++i) {
+            gettimeofday(&tv, nullptr);
+            g_sink += tv.tv_usec;
+        }
+    });
+    RunBench("clock/GetTimeStampInMS", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += GetTimeStampInMS();
+    });
+    RunBench("clock/MonotonicNanos", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += MonotonicNanos();
+    });
+    RunBench("clock/CoarseMonotonicNanos", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += CoarseMonotonicNanos();
+    });
+    RunBench("clock/ReadTsc", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += ReadTsc();
+    });
+    RunBench("clock/TimeDiff", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            TimeDiff td;
+            td.Stop();
+            g_sink += td.ElapsedInMicrosecond();
+        }
+    });
+    RunBench("clock/CycleTimer", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            CycleTimer ct;
+            g_sink += ct.ElapsedNanos();
+        }
+    });
+
+    CachedClock::GetInstance()->Start();
+    RunBench("clock/CachedTimeStampInMS", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += CachedTimeStampInMS();
+    });
+    RunBench("clock/CachedMonotonicMillis", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += CachedMonotonicMillis();
+    });
+    // how far behind the cache runs
+    if (Wanted("clock/cached_lag")) {
+        uint64_t max_lag = 0, sum_lag = 0;
+        const int samples = 2000;
+        for (int i = 0; i < samples; ++i) {
+            uint64_t lag = MonotonicMillis() - CachedMonotonicMillis();
+            max_lag = std::max(max_lag, lag);
+            sum_lag += lag;
+            usleep(97);
+        }
+        Note("%-40s avg %.2f ms max %lu ms\n", "clock/cached_lag",
+             (double)sum_lag / samples, (unsigned long)max_lag);
+    }
+    CachedClock::GetInstance()->Stop();
+
+    RunBench("timer/StopWatch::Stop", n, 5, [&]() {
+        StopWatch sw(64);
+        for (size_t i = 0; i < n; ++i) {
+            if ((i & 63) == 0) sw.Clear();
+            sw.Stop();
+        }
+        g_sink += sw.Cost();
+    });
+    RunBench("timer/TimeDiff::StopAndWait(0)", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            TimeDiff td;
+            td.StopAndWait(0);
+            g_sink += td.ElapsedInNanosecond();
+        }
+    });
+}
+
+// Cost of a CUTILS_TRACE_SPAN with tracing off and on.  With tracing on
+// each round fits in the ring and the flusher drains it between rounds, so
+// no span takes the drop path.
+void BenchTrace() {
+    const size_t n = 4096;
+    RunBench("trace/span_off", n, 50, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            CUTILS_TRACE_SPAN("bench");
+            g_sink += i;
+        }
+    });
+
+    if (!Wanted("trace/span_on")) return;
+    if (trace::StartTracing("/dev/null", 1) != 0) return;
+    Measure("trace/span_on", 1, n, 50, [&]() {
+        usleep(3000);
+        Timing t;
+        uint64_t beg = NowNs();
+        uint64_t beg_cycles = ReadTsc();
+        for (size_t i = 0; i < n; ++i) {
+            CUTILS_TRACE_SPAN("bench");
+            g_sink += i;
+        }
+        t.cycles = ReadTsc() - beg_cycles;
+        t.ns = NowNs() - beg;
+        return t;
+    });
+    trace::StopTracing();
+}
+
+// Recording cost of the metrics types, and of reading a histogram
+void BenchMetrics() {
+    const size_t n = 1 << 22;
+    Histogram hist;
+    RunBench("metrics/Histogram::Record", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) hist.Record(i & 0xfffff);
+    });
+    RunBench("metrics/ScopedLatency", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) ScopedLatency sl(&hist);
+    });
+    Counter counter;
+    RunBench("metrics/Counter::Add", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) counter.Add();
+    });
+    HistogramSnapshot snap;
+    RunBench("metrics/Histogram::Snapshot", 1, 5, [&]() {
+        hist.Snapshot(&snap);
+        g_sink += snap.Percentile(99.9);
+    });
+}
+
+// Admission cost of the rate limiters, with a rate high enough that
+// every call is admitted
+void BenchRateLimit() {
+    const size_t n = 1 << 22;
+    TokenBucket bucket(1e12, 1e6);
+    RunBench("ratelimit/TokenBucket::TryAcquire", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += bucket.TryAcquire();
+    });
+    FreqCtrl::GetInstance()->Init("bench", 1UL << 40);
+    RunBench("ratelimit/FreqCtrl::ShouldGo", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            g_sink += FreqCtrl::GetInstance()->ShouldGo();
+        }
+    });
+    KeyedLimiter keys(1 << 20, 1e12, 1e6);
+    RunBench("ratelimit/KeyedLimiter::TryAcquire", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            g_sink += keys.TryAcquire(UinHash(i) & 0xfffff);
+        }
+    });
+    ConcurrencyLimiter limiter;
+    RunBench("ratelimit/ConcurrencyLimiter", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            if (limiter.TryAcquire()) limiter.Release(1000 + (i & 1023));
+        }
+    });
+}
+
+// Generators of random.h, one 64-bit value (or 8 bytes) per op
+void BenchRandom() {
+    const size_t n = 1 << 22;
+    RunBench("random/FastRand", n, 5, [&]() {
+        int seed = 20180917;
+        for (size_t i = 0; i < n; ++i) seed = FastRand(seed);
+        g_sink += seed;
+    });
+    RunBench("random/DeviceRand", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += DeviceRand();
+    });
+    Xoshiro256pp xoshiro(1);
+    RunBench("random/Xoshiro256pp", n, 5, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += xoshiro.Next();
+        g_sink += sum;
+    });
+    WyRand wyrand(1);
+    RunBench("random/WyRand", n, 5, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += wyrand.Next();
+        g_sink += sum;
+    });
+    Pcg64 pcg(1);
+    RunBench("random/Pcg64", n, 5, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += pcg.Next();
+        g_sink += sum;
+    });
+    RunBench("random/ThreadRand", n, 5, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += ThreadRand().Next();
+        g_sink += sum;
+    });
+    RunBench("random/Xoshiro256pp::Uniform(1000)", n, 5, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += xoshiro.Uniform(1000);
+        g_sink += sum;
+    });
+    std::vector<char> buf(n * 8);
+    RunBench("random/Xoshiro256pp::Fill", n, 5, [&]() {
+        xoshiro.Fill(buf.data(), buf.size());
+        g_sink += buf[n];
+    });
+    Xoshiro256ppX4 x4(1);
+    RunBench(IsRandomSimdSupported() ? "random/Xoshiro256ppX4::Fill(avx2)"
+                                     : "random/Xoshiro256ppX4::Fill",
+             n, 5, [&]() {
+        x4.Fill(buf.data(), buf.size());
+        g_sink += buf[n];
+    });
+    std::vector<double> doubles(n);
+    RunBench("random/Xoshiro256ppX4::FillDouble", n, 5, [&]() {
+        x4.FillDouble(doubles.data(), n);
+        g_sink += doubles[n / 2];
+    });
+
+    const size_t m = 1 << 20;
+    ZipfianDistribution zipf(1000000);
+    RunBench("distribution/zipfian", m, 5, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < m; ++i) sum += zipf.Next(xoshiro);
+        g_sink += sum;
+    });
+    ScrambledZipfianDistribution scrambled(1000000, 0.99, zipf.zeta());
+    RunBench("distribution/scrambled_zipfian", m, 5, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < m; ++i) sum += scrambled.Next(xoshiro);
+        g_sink += sum;
+    });
+    ExponentialDistribution exponential(1.0);
+    RunBench("distribution/exponential", m, 5, [&]() {
+        exponential.Fill(xoshiro, doubles.data(), m);
+        g_sink += doubles[m / 2];
+    });
+    RunBench("distribution/exponential_x4", m, 5, [&]() {
+        exponential.Fill(x4, doubles.data(), m);
+        g_sink += doubles[m / 2];
+    });
+    NormalDistribution normal(0, 1);
+    RunBench("distribution/normal", m, 5, [&]() {
+        normal.Fill(xoshiro, doubles.data(), m);
+        g_sink += doubles[m / 2];
+    });
+    RunBench("distribution/reservoir(100)", m, 5, [&]() {
+        ReservoirSampler<uint64_t> sampler(100, 1);
+        for (size_t i = 0; i < m; ++i) sampler.Add(i);
+        g_sink += sampler.samples()[0];
+    });
+}
+
+// Drive a hash map, the codecs and a queue with YCSB style workloads
+void BenchWorkload() {
+    const size_t n = 1 << 20;
+    const char* names[] = {"sequential", "uniform", "zipfian",
+                           "scrambled_zipfian", "latest"};
+    for (int d = WorkloadOptions::kSequential; d <= WorkloadOptions::kLatest;
+         ++d) {
+        WorkloadOptions options;
+        options.seed = 1;
+        options.key_distribution = (WorkloadOptions::KeyDistribution)d;
+        WorkloadGenerator gen(options);
+        std::string name = std::string("workload/NextKey(") + names[d] + ")";
+        RunBench(name.c_str(), n, 5, [&]() {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < n; ++i) sum += gen.NextKey().size();
+            g_sink += sum;
+        });
+    }
+
+    // YCSB workload A on a map keyed by CHash2 of the key
+    WorkloadOptions options;
+    options.seed = 1;
+    options.num_keys = 100000;
+    options.key_distribution = WorkloadOptions::kScrambledZipfian;
+    options.read_proportion = 0.5;
+    options.update_proportion = 0.5;
+    options.min_value_size = 16;
+    options.max_value_size = 256;
+    WorkloadGenerator gen(options);
+    std::unordered_map<uint64_t, Slice> map;
+    for (uint64_t id = 0; id < options.num_keys; ++id) {
+        Slice key = gen.Key(id);
+        map[CHash2<uint64_t>(key.data(), key.size())] = gen.NextValue();
+    }
+    RunBench("workload/ycsb_a(unordered_map)", n, 5, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            WorkloadGenerator::Op op = gen.NextOp();
+            Slice key = gen.NextKey();
+            uint64_t h = CHash2<uint64_t>(key.data(), key.size());
+            if (op == WorkloadGenerator::kRead) {
+                sum += map[h].size();
+            } else {
+                map[h] = gen.NextValue();
+            }
+        }
+        g_sink += sum;
+    });
+
+    // key/value records through BufferWriter and crc32c
+    const size_t m = 1 << 16;
+    BufferWriter writer(1 << 20);
+    RunBench("workload/encode_kv(buffer+crc32c)", m, 5, [&]() {
+        writer.Clear();
+        for (size_t i = 0; i < m; ++i) {
+            writer.PutLengthPrefixedSlice(gen.NextKey());
+            Slice value = gen.NextValue();
+            writer.PutFixed32(crc32c::Value(value.data(), value.size()));
+            writer.PutLengthPrefixedSlice(value);
+        }
+        g_sink += writer.size();
+    });
+
+    CQueue<std::string> queue;
+    RunBench("workload/cqueue_push_pop(key)", m, 5, [&]() {
+        for (size_t i = 0; i < m; ++i) {
+            queue.Push(std::unique_ptr<std::string>(
+                    new std::string(gen.NextKey().ToString())));
+        }
+        uint64_t sum = 0;
+        for (size_t i = 0; i < m; ++i) sum += queue.Pop()->size();
+        g_sink += sum;
+    });
+}
+
+// Every thread pushes one item then pops one, so a pop never finds the
+// queue empty and no thread blocks
+void BenchQueue() {
+    const size_t n = 1 << 20;
+    for (int threads : ThreadCounts()) {
+        BlockingCQueue<uint64_t> blocking(1024);
+        RunBenchThreads("queue/BlockingCQueue", threads, n, 5, [&](int) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < n / threads; ++i) {
+                blocking.Push(i);
+                sum += blocking.Pop();
+            }
+            g_sink += sum;
+        });
+        CQueue<uint64_t> cqueue;
+        RunBenchThreads("queue/CQueue", threads, n, 5, [&](int) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < n / threads; ++i) {
+                cqueue.Push(std::unique_ptr<uint64_t>(new uint64_t(i)));
+                sum += *cqueue.Pop();
+            }
+            g_sink += sum;
+        });
+    }
+
+    // single threaded ring, and "threads" producers against the one
+    // consumer it allows
+    clsCircleQueue<uintptr_t> ring(1024);
+    RunBench("queue/clsCircleQueue", n, 5, [&]() {
+        uintptr_t sum = 0, v = 0;
+        for (size_t i = 0; i < n; ++i) {
+            ring.Push(i + 1);
+            ring.Take(&v);
+            sum += v;
+        }
+        g_sink += sum;
+    });
+    for (int threads : ThreadCounts()) {
+        clsCircleQueue<uintptr_t> mpsc(1024);
+        RunBenchThreads("queue/clsCircleQueue::PushByMultiThread",
+                        threads + 1, n, 5, [&](int tid) {
+            size_t per_thread = n / threads;
+            if (tid == threads) {
+                uintptr_t sum = 0, v = 0;
+                for (size_t got = 0; got < per_thread * threads;) {
+                    if (mpsc.TakeByOneThread(&v) == 0) {
+                        sum += v;
+                        ++got;
+                    } else {
+                        sched_yield();
+                    }
+                }
+                g_sink += sum;
+                return;
+            }
+            for (size_t i = 0; i < per_thread; ++i) {
+                while (mpsc.PushByMultiThread(i + 1) != 0) sched_yield();
+            }
+        });
+    }
+}
+
+// Round trip of trivial tasks through AsyncWorkerPool, submitted by as
+// many threads as there are workers
+void BenchAsyncWorkerPool() {
+    const size_t n = 1 << 18;
+    for (int threads : ThreadCounts()) {
+        AsyncWorkerPool pool(threads, 1024);
+        std::atomic<size_t> done(0);
+        RunBenchThreads("pool/AddTask", threads, n, 5, [&](int tid) {
+            size_t per_thread = n / threads;
+            for (size_t i = 0; i < per_thread; ++i) {
+                pool.AddTask([&]() { done.fetch_add(1); });
+            }
+            // thread 0 also waits for all tasks of the round
+            if (tid == 0) {
+                while (done.load() < per_thread * threads) sched_yield();
+                done.store(0);
+            }
+        });
+        const size_t timers = 1 << 14;
+        RunBenchThreads("pool/AddTaskAfter", threads, timers, 5, [&](int tid) {
+            size_t per_thread = timers / threads;
+            for (size_t i = 0; i < per_thread; ++i) {
+                pool.AddTaskAfter(i & 1023, [&]() { done.fetch_add(1); });
+            }
+            if (tid == 0) {
+                while (done.load() < per_thread * threads) sched_yield();
+                done.store(0);
+            }
+        });
+        const int seqs = 1 << 14;
+        RunBench("pool/RunSeqTaskAndWait", seqs, 5, [&]() {
+            pool.RunSeqTaskAndWait(threads, seqs,
+                                   [](int, std::atomic<int>&) {});
+        });
+    }
+}
+
+// Hashes of chash.h over keys of a few sizes
+void BenchHash() {
+    const size_t n = 1 << 20;
+    const size_t sizes[] = {8, 16, 64, 256};
+    std::string buf(n + 256, 0);
+    int seed = 20180917;
+    for (auto& c : buf) {
+        seed = FastRand(seed);
+        c = (char)seed;
+    }
+    char name[64];
+    for (size_t size : sizes) {
+        snprintf(name, sizeof(name), "hash/CHash/%zu", size);
+        RunBench(name, n, 5, [&]() {
+            uint32_t sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                sum += CHash<uint32_t>(&buf[i & 0xffff], size);
+            }
+            g_sink += sum;
+        });
+        snprintf(name, sizeof(name), "hash/CHash2/%zu", size);
+        RunBench(name, n, 5, [&]() {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                sum += CHash2<uint64_t>(&buf[i & 0xffff], size);
+            }
+            g_sink += sum;
+        });
+    }
+    RunBench("hash/UinHash", n, 5, [&]() {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += UinHash(i);
+        g_sink += sum;
+    });
+}
+
+// Split and the hex conversions of slice.h
+void BenchString() {
+    const size_t n = 1 << 16;
+    std::string line;
+    for (int i = 0; i < 16; ++i) {
+        if (i > 0) line.push_back(',');
+        line.append("field").append(std::to_string(i * 7919));
+    }
+    std::vector<Slice> fields;
+    RunBench("string/Split(16 fields)", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            Split(line, ',', &fields);
+            g_sink += fields.size();
+        }
+    });
+    std::vector<std::string> copies;
+    RunBench("string/Split(16 fields,string)", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            Split(line, ',', &copies);
+            g_sink += copies.size();
+        }
+    });
+    std::string bytes(64, 0);
+    for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = (char)(i * 37);
+    std::string hex = ToHexString(bytes);
+    RunBench("string/ToHexString(64)", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) g_sink += ToHexString(bytes).size();
+    });
+    RunBench("string/ParseFromHexString(64)", n, 5, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            g_sink += ParseFromHexString(hex).size();
+        }
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!ParseOptions(argc, argv)) {
+        Usage(argv[0]);
+        return 1;
+    }
+    Note("streamvbyte simd %s\n",
+         IsStreamVByteSimdSupported() ? "on" : "off");
+    Note("crc32c kernel %s\n", crc32c::KernelName(crc32c::CurrentKernel()));
+    Note("tsc invariant %d, %.3f ticks/ns\n", TscIsInvariant(),
+         TscTicksPerNano());
+    PrintHeader();
+    BenchCoding();
+    BenchCrc32c();
+    BenchLog();
+    BenchDirScan();
+    BenchMappedFile();
+    BenchClock();
+    BenchQueue();
+    BenchAsyncWorkerPool();
+    BenchHash();
+    BenchString();
+    BenchTrace();
+    BenchMetrics();
+    BenchRateLimit();
+    BenchRandom();
+    BenchWorkload();
+    PrintFooter();
+    return 0;
+}
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
@@ -0,0 +1,145 @@
+#include "buffer.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+
+namespace cutils {
+
+const size_t BufferWriter::kMaxChunkSize;
+
+BufferWriter::BufferWriter(size_t reserve, size_t chunk_size)
+    : seg_begin_(nullptr), cur_(nullptr), limit_(nullptr),
+      first_chunk_size_(std::max<size_t>(reserve, 64)),
+      chunk_size_(std::max<size_t>(chunk_size, 64)),
+      next_chunk_size_(chunk_size_), sealed_size_(0) {
+    char* chunk = (char*)malloc(first_chunk_size_);
+    assert(chunk != nullptr);
+    chunks_.push_back(chunk);
+    seg_begin_ = cur_ = chunk;
+    limit_ = chunk + first_chunk_size_;
+}
+
+BufferWriter::~BufferWriter() {
+    for (auto chunk : chunks_) {
+        free(chunk);
+    }
+}
+
+void BufferWriter::SealSegment() {
+    if (cur_ != seg_begin_) {
+        struct iovec iov;
+        iov.iov_base = seg_begin_;
+        iov.iov_len = cur_ - seg_begin_;
+        segments_.push_back(iov);
+        sealed_size_ += iov.iov_len;
+    }
+    seg_begin_ = cur_;
+}
+
+void BufferWriter::NewChunk(size_t n) {
+    SealSegment();
+    size_t sz = std::max(n, next_chunk_size_);
+    next_chunk_size_ = std::min(next_chunk_size_ * 2, kMaxChunkSize);
+    char* chunk = (char*)malloc(sz);
+    assert(chunk != nullptr);
+    chunks_.push_back(chunk);
+    seg_begin_ = cur_ = chunk;
+    limit_ = chunk + sz;
+}
+
+void BufferWriter::Append(const char* data, size_t n) {
+    while (n > 0) {
+        if (cur_ == limit_) NewChunk(1);
+        size_t len = std::min<size_t>(n, limit_ - cur_);
+        memcpy(cur_, data, len);
+        cur_ += len;
+        data += len;
+        n -= len;
+    }
+}
+
+void BufferWriter::AppendRef(const Slice& s) {
+    if (s.empty()) return;
+    SealSegment();
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(s.data());
+    iov.iov_len = s.size();
+    segments_.push_back(iov);
+    sealed_size_ += s.size();
+    // later writes go on in the rest of the current chunk
+}
+
+void BufferWriter::GetIovec(std::vector<struct iovec>* iov) const {
+    iov->insert(iov->end(), segments_.begin(), segments_.end());
+    if (cur_ != seg_begin_) {
+        struct iovec last;
+        last.iov_base = seg_begin_;
+        last.iov_len = cur_ - seg_begin_;
+        iov->push_back(last);
+    }
+}
+
+void BufferWriter::CopyTo(std::string* dst) const {
+    dst->reserve(dst->size() + size());
+    for (auto& iov : segments_) {
+        dst->append((const char*)iov.iov_base, iov.iov_len);
+    }
+    dst->append(seg_begin_, cur_ - seg_begin_);
+}
+
+std::string BufferWriter::ToString() const {
+    std::string res;
+    CopyTo(&res);
+    return res;
+}
+
+int BufferWriter::WriteTo(int fd) const {
+    std::vector<struct iovec> iov;
+    GetIovec(&iov);
+    size_t i = 0;
+    while (i < iov.size()) {
+        int cnt = std::min<size_t>(iov.size() - i, IOV_MAX);
+        ssize_t ret = writev(fd, &iov[i], cnt);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        // skip what has been written, a partial iovec is adjusted in place
+        size_t done = ret;
+        while (i < iov.size() && done >= iov[i].iov_len) {
+            done -= iov[i].iov_len;
+            ++i;
+        }
+        if (done > 0) {
+            iov[i].iov_base = (char*)iov[i].iov_base + done;
+            iov[i].iov_len -= done;
+        }
+    }
+    return 0;
+}
+
+void BufferWriter::Clear() {
+    for (size_t i = 1; i < chunks_.size(); ++i) {
+        free(chunks_[i]);
+    }
+    chunks_.resize(1);
+    segments_.clear();
+    sealed_size_ = 0;
+    next_chunk_size_ = chunk_size_;
+    seg_begin_ = cur_ = chunks_[0];
+    limit_ = chunks_[0] + first_chunk_size_;
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
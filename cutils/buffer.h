@@ -0,0 +1,262 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <string>
+#include <vector>
+
+#include "coding.h"
+#include "slice.h"
+
+namespace cutils {
+
+// BufferWriter serializes through a raw pointer cursor into a list of
+// chunks, with the same encodings as the Put.../Append... routines of
+// coding.h.
+//
+// Each Put... makes sure the current chunk has room for the whole value
+// (one compare in the common case), so a value never straddles two chunks
+// and written bytes never move.  The output is a list of segments that can
+// go to writev() as is; AppendRef() adds external memory to that list
+// without copying it.
+class BufferWriter {
+public:
+    // "reserve" is the size of the first chunk, later chunks start at
+    // "chunk_size" and double up to kMaxChunkSize.
+    explicit BufferWriter(size_t reserve = 4096, size_t chunk_size = 4096);
+    ~BufferWriter();
+
+    BufferWriter(const BufferWriter&) = delete;
+    BufferWriter& operator=(const BufferWriter&) = delete;
+
+    static const size_t kMaxChunkSize = 1 << 20;
+
+    // little endian, as PutFixed32/PutVarint32/... in coding.h
+    void PutFixed32(uint32_t v) {
+        EncodeFixed32(Ensure(4), v);
+        cur_ += 4;
+    }
+
+    void PutFixed64(uint64_t v) {
+        EncodeFixed64(Ensure(8), v);
+        cur_ += 8;
+    }
+
+    void PutVarint32(uint32_t v) {
+        cur_ = EncodeVarint32(Ensure(kMaxVarint32Length), v);
+    }
+
+    void PutVarint64(uint64_t v) {
+        cur_ = EncodeVarint64(Ensure(kMaxVarint64Length), v);
+    }
+
+    void PutZigZagVarint32(int32_t v) { PutVarint32(ZigZagEncode32(v)); }
+    void PutZigZagVarint64(int64_t v) { PutVarint64(ZigZagEncode64(v)); }
+
+    void PutVarint32Batch(const uint32_t* values, size_t n) {
+        cur_ = EncodeVarint32Batch(Ensure(n * kMaxVarint32Length), values, n);
+    }
+
+    void PutVarint64Batch(const uint64_t* values, size_t n) {
+        cur_ = EncodeVarint64Batch(Ensure(n * kMaxVarint64Length), values, n);
+    }
+
+    void PutLengthPrefixedSlice(const Slice& value) {
+        PutVarint32(value.size());
+        Append(value.data(), value.size());
+    }
+
+    // big endian, as AppendFixed8/16/32/64 in coding.h
+    void AppendFixed8(uint8_t v) {
+        *Ensure(1) = v;
+        cur_ += 1;
+    }
+
+    void AppendFixed16(uint16_t v) {
+        char* p = Ensure(2);
+        p[0] = v >> 8;
+        p[1] = v & 0xff;
+        cur_ += 2;
+    }
+
+    void AppendFixed32(uint32_t v) {
+        EncodeBigEndian32(Ensure(4), v);
+        cur_ += 4;
+    }
+
+    void AppendFixed64(uint64_t v) {
+        EncodeBigEndian(Ensure(8), v);
+        cur_ += 8;
+    }
+
+    // Copy data[0,n-1], filling the current chunk before starting a new one
+    void Append(const char* data, size_t n);
+    void Append(const Slice& s) { Append(s.data(), s.size()); }
+
+    // Add "s" to the output without copying it.  The memory has to stay
+    // valid until the output has been consumed.
+    void AppendRef(const Slice& s);
+
+    // Return n contiguous bytes for the caller to fill, and move the cursor
+    // past them
+    char* Reserve(size_t n) {
+        char* p = Ensure(n);
+        cur_ += n;
+        return p;
+    }
+
+    // Total bytes written
+    size_t size() const { return sealed_size_ + (cur_ - seg_begin_); }
+    bool empty() const { return size() == 0; }
+
+    // Append one iovec per segment to *iov
+    void GetIovec(std::vector<struct iovec>* iov) const;
+
+    // Append the whole output to *dst
+    void CopyTo(std::string* dst) const;
+    std::string ToString() const;
+
+    // writev() the whole output to fd, retrying partial writes.
+    // Return 0 or -errno.
+    int WriteTo(int fd) const;
+
+    // Drop the output, keep the first chunk for reuse
+    void Clear();
+
+private:
+    char* Ensure(size_t n) {
+        if (static_cast<size_t>(limit_ - cur_) < n) NewChunk(n);
+        return cur_;
+    }
+
+    void NewChunk(size_t n);
+    void SealSegment();
+
+    std::vector<char*> chunks_;
+    std::vector<struct iovec> segments_;
+    char* seg_begin_;
+    char* cur_;
+    char* limit_;
+    size_t first_chunk_size_;
+    size_t chunk_size_;
+    size_t next_chunk_size_;
+    size_t sealed_size_;
+};
+
+// BufferReader is a bounds-checked cursor over a Slice, reading what
+// BufferWriter or the coding.h routines wrote.
+//
+// Errors are sticky: once a read fails (truncated or malformed input) ok()
+// stays false and every later read returns 0 / an empty Slice, so a whole
+// record can be parsed before checking ok() once.
+class BufferReader {
+public:
+    explicit BufferReader(const Slice& input) : in_(input), ok_(true) {}
+
+    bool ok() const { return ok_; }
+    size_t remaining() const { return in_.size(); }
+    bool empty() const { return in_.empty(); }
+    Slice rest() const { return in_; }
+
+    uint32_t GetFixed32() {
+        if (!Need(4)) return 0;
+        uint32_t v = DecodeFixed32(in_.data());
+        in_.remove_prefix(4);
+        return v;
+    }
+
+    uint64_t GetFixed64() {
+        if (!Need(8)) return 0;
+        uint64_t v = DecodeFixed64(in_.data());
+        in_.remove_prefix(8);
+        return v;
+    }
+
+    uint32_t GetVarint32() {
+        uint32_t v = 0;
+        if (ok_ && !cutils::GetVarint32(&in_, &v)) Fail();
+        return ok_ ? v : 0;
+    }
+
+    uint64_t GetVarint64() {
+        uint64_t v = 0;
+        if (ok_ && !cutils::GetVarint64(&in_, &v)) Fail();
+        return ok_ ? v : 0;
+    }
+
+    int32_t GetZigZagVarint32() { return ZigZagDecode32(GetVarint32()); }
+    int64_t GetZigZagVarint64() { return ZigZagDecode64(GetVarint64()); }
+
+    void GetVarint32Batch(uint32_t* values, size_t n) {
+        if (ok_ && !cutils::GetVarint32Batch(&in_, values, n)) Fail();
+    }
+
+    void GetVarint64Batch(uint64_t* values, size_t n) {
+        if (ok_ && !cutils::GetVarint64Batch(&in_, values, n)) Fail();
+    }
+
+    Slice GetLengthPrefixedSlice() {
+        Slice s;
+        if (ok_ && !cutils::GetLengthPrefixedSlice(&in_, &s)) Fail();
+        return ok_ ? s : Slice();
+    }
+
+    // big endian, as RemoveFixed8/16/32/64 in coding.h
+    uint8_t RemoveFixed8() {
+        if (!Need(1)) return 0;
+        uint8_t v = in_[0];
+        in_.remove_prefix(1);
+        return v;
+    }
+
+    uint16_t RemoveFixed16() {
+        if (!Need(2)) return 0;
+        const unsigned char* p =
+            reinterpret_cast<const unsigned char*>(in_.data());
+        uint16_t v = (p[0] << 8) | p[1];
+        in_.remove_prefix(2);
+        return v;
+    }
+
+    uint32_t RemoveFixed32() {
+        if (!Need(4)) return 0;
+        uint32_t v = DecodeBigEndian32(in_.data());
+        in_.remove_prefix(4);
+        return v;
+    }
+
+    uint64_t RemoveFixed64() {
+        if (!Need(8)) return 0;
+        uint64_t v = DecodeBigEndian(in_.data());
+        in_.remove_prefix(8);
+        return v;
+    }
+
+    // Return the next n bytes without copying them
+    Slice GetBytes(size_t n) {
+        if (!Need(n)) return Slice();
+        Slice s(in_.data(), n);
+        in_.remove_prefix(n);
+        return s;
+    }
+
+    void Skip(size_t n) {
+        if (Need(n)) in_.remove_prefix(n);
+    }
+
+private:
+    bool Need(size_t n) {
+        if (ok_ && in_.size() < n) Fail();
+        return ok_;
+    }
+
+    void Fail() {
+        ok_ = false;
+        in_.clear();
+    }
+
+    Slice in_;
+    bool ok_;
+};
+
+} // namespace cutils
@@ -0,0 +1,55 @@
+#include "cached_clock.h"
+
+#include <time.h>
+
+#include "cutils.h"
+
+namespace cutils {
+
+std::atomic<uint64_t> CachedClock::wall_ms_(0);
+std::atomic<uint64_t> CachedClock::mono_ms_(0);
+
+void CachedClock::Update() {
+    wall_ms_.store(GetTimeStampInMS(), std::memory_order_relaxed);
+    mono_ms_.store(cutils::MonotonicMillis(), std::memory_order_relaxed);
+}
+
+void CachedClock::Ticker(bool& stop) {
+    SetThreadTitle("cached_clock");
+    // sleep to absolute deadlines, so the period does not drift by the
+    // time spent updating
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!IsStopped(stop)) {
+        Update();
+        next.tv_nsec += 1000000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+}
+
+void CachedClock::Start() {
+    hassert(bg_ == nullptr);
+    // valid before Start() returns
+    Update();
+    bg_ = AsyncWorker::Make(&CachedClock::Ticker, this);
+}
+
+void CachedClock::Stop() {
+    bg_ = nullptr;
+    wall_ms_.store(0, std::memory_order_relaxed);
+    mono_ms_.store(0, std::memory_order_relaxed);
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
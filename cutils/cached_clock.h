@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+#include "async_worker.h"
+#include "clock.h"
+#include "singleton.h"
+#include "timer.h"
+
+namespace cutils {
+
+// Millisecond clocks cached by a background thread that refreshes them
+// every millisecond, so that per request time checks (rate limits,
+// expiry) cost one relaxed load instead of a clock_gettime().
+//
+// The values lag the real clocks by up to about a millisecond plus
+// scheduling delay.  Until Start() is called, and after Stop(), the
+// readers fall back to the real clocks.
+//
+//   CachedClock::GetInstance()->Start();
+//   ...
+//   if (CachedMonotonicMillis() > deadline) ...
+class CachedClock : public Singleton<CachedClock> {
+public:
+    ~CachedClock() { Stop(); }
+
+    void Start();
+    void Stop();
+    bool Running() const { return bg_ != nullptr; }
+
+    // 0 when not running
+    static uint64_t WallMillis() {
+        return wall_ms_.load(std::memory_order_relaxed);
+    }
+    static uint64_t MonotonicMillis() {
+        return mono_ms_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void Ticker(bool& stop);
+    void Update();
+
+    static std::atomic<uint64_t> wall_ms_;
+    static std::atomic<uint64_t> mono_ms_;
+    AsyncWorkerPtr bg_ = nullptr;
+};
+
+// GetTimeStampInMS() from the cache
+inline uint64_t CachedTimeStampInMS() {
+    uint64_t ms = CachedClock::WallMillis();
+    return ms != 0 ? ms : GetTimeStampInMS();
+}
+
+// cutils::MonotonicMillis() from the cache
+inline uint64_t CachedMonotonicMillis() {
+    uint64_t ms = CachedClock::MonotonicMillis();
+    return ms != 0 ? ms : cutils::MonotonicMillis();
+}
+
+} // namespace cutils
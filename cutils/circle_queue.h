@@ -2,16 +2,29 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstdlib>
 
 namespace cutils {
 
 typedef void *CircleQueueElt_t;
 
+// Bounded ring of pointer sized elements.  Any number of threads may
+// PushByMultiThread() against one thread calling TakeByOneThread() /
+// MultiTakeByOneThread() / Back(); Push() and Take() are for a single
+// producer and a single consumer.
+//
+// A producer claims a slot by advancing the head and only then stores
+// its element, so a zero element marks a claimed slot not written yet:
+// elements must be non zero, and the taking side returns -2 on such a
+// slot, to be retried.  Head, tail and slots are accessed with __atomic
+// builtins: a slot is stored with release and loaded with acquire, and
+// the consumer clears a slot before releasing the tail that lets a
+// producer claim it again.
 template <typename Type>
 class clsCircleQueue {
  private:
-  volatile unsigned long m_ulHead;
-  volatile unsigned long m_ulTail;
+  unsigned long m_ulHead;
+  unsigned long m_ulTail;
 
   uint32_t m_iSize;
   Type *m_ptElt;
@@ -76,36 +89,40 @@ void clsCircleQueue<Type>::Resize(uint32_t iSize) {
   if (m_ptElt != nullptr) free(m_ptElt), m_ptElt = nullptr;
 
   m_iSize = iSize;
-  m_ptElt = (Type *)malloc(iSize * sizeof(Type));
+  m_ptElt = (Type *)calloc(iSize, sizeof(Type));
   assert(m_ptElt != nullptr);
 }
 
 template <typename Type>
 bool clsCircleQueue<Type>::IsFull() {
-  return m_ulHead - m_ulTail >= m_iSize;
+  unsigned long ulTail = __atomic_load_n(&m_ulTail, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&m_ulHead, __ATOMIC_ACQUIRE) - ulTail >= m_iSize;
 }
 
 template <typename Type>
 uint32_t clsCircleQueue<Type>::Size() {
-  return m_ulHead - m_ulTail;
+  unsigned long ulTail = __atomic_load_n(&m_ulTail, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&m_ulHead, __ATOMIC_ACQUIRE) - ulTail;
 }
 
 template <typename Type>
 int clsCircleQueue<Type>::TakeByOneThread(Type *ptElt) {
   assert(m_iSize != 0);
 
-  if (m_ulHead <= m_ulTail) {
+  unsigned long ulTail = __atomic_load_n(&m_ulTail, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&m_ulHead, __ATOMIC_ACQUIRE) <= ulTail) {
     return -1;
   }
 
-  *ptElt = m_ptElt[m_ulTail % m_iSize];
+  Type *ptSlot = &m_ptElt[ulTail % m_iSize];
+  __atomic_load(ptSlot, ptElt, __ATOMIC_ACQUIRE);
   if (*ptElt == 0) {
     return -2;
   }
 
-  m_ptElt[m_ulTail % m_iSize] = 0;
-
-  m_ulTail++;
+  Type tZero = 0;
+  __atomic_store(ptSlot, &tZero, __ATOMIC_RELAXED);
+  __atomic_store_n(&m_ulTail, ulTail + 1, __ATOMIC_RELEASE);
 
   return 0;
 }
@@ -114,25 +131,30 @@ template <typename Type>
 int clsCircleQueue<Type>::MultiTakeByOneThread(Type *ptElt, int iMaxCnt) {
   assert(m_iSize != 0);
 
-  if (m_ulHead <= m_ulTail) {
+  unsigned long ulTail = __atomic_load_n(&m_ulTail, __ATOMIC_RELAXED);
+  unsigned long ulHead = __atomic_load_n(&m_ulHead, __ATOMIC_ACQUIRE);
+  if (ulHead <= ulTail) {
     return -1;
   }
 
-  unsigned long iCnt = m_ulHead - m_ulTail;
-  iMaxCnt = (iCnt <= iMaxCnt ? iCnt : iMaxCnt);
+  unsigned long iCnt = ulHead - ulTail;
+  iMaxCnt = (iCnt <= (unsigned long)iMaxCnt ? iCnt : iMaxCnt);
 
-  for (int i = 0; i < iMaxCnt; i++) {
-    ptElt[i] = m_ptElt[m_ulTail % m_iSize];
+  Type tZero = 0;
+  int i = 0;
+  for (; i < iMaxCnt; i++) {
+    Type *ptSlot = &m_ptElt[(ulTail + i) % m_iSize];
+    __atomic_load(ptSlot, &ptElt[i], __ATOMIC_ACQUIRE);
 
     if (ptElt[i] == 0) {
-      return i;
+      break;
     }
 
-    m_ptElt[m_ulTail % m_iSize] = 0;
-    m_ulTail++;
+    __atomic_store(ptSlot, &tZero, __ATOMIC_RELAXED);
   }
+  __atomic_store_n(&m_ulTail, ulTail + i, __ATOMIC_RELEASE);
 
-  return iMaxCnt;
+  return i;
 }
 
 template <typename Type>
@@ -158,14 +180,15 @@ template <typename Type>
 int clsCircleQueue<Type>::PushByMultiThreadInner(Type tElt) {
   assert(m_iSize != 0);
 
-  volatile unsigned long ulHead = m_ulHead;
+  unsigned long ulHead = __atomic_load_n(&m_ulHead, __ATOMIC_RELAXED);
 
-  if (ulHead >= m_iSize + m_ulTail) {
+  if (ulHead >= m_iSize + __atomic_load_n(&m_ulTail, __ATOMIC_ACQUIRE)) {
     return -1;
   }
 
-  if (__sync_bool_compare_and_swap(&m_ulHead, ulHead, ulHead + 1)) {
-    m_ptElt[ulHead % m_iSize] = tElt;
+  if (__atomic_compare_exchange_n(&m_ulHead, &ulHead, ulHead + 1, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    __atomic_store(&m_ptElt[ulHead % m_iSize], &tElt, __ATOMIC_RELEASE);
     return 0;
   }
 
@@ -174,24 +197,26 @@ int clsCircleQueue<Type>::PushByMultiThreadInner(Type tElt) {
 
 template <typename Type>
 int clsCircleQueue<Type>::Take(Type *ptElt) {
-  if (m_ulHead <= m_ulTail) {
+  unsigned long ulTail = __atomic_load_n(&m_ulTail, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&m_ulHead, __ATOMIC_ACQUIRE) <= ulTail) {
     return -1;
   }
 
-  *ptElt = m_ptElt[m_ulTail % m_iSize];
-  m_ulTail++;
+  __atomic_load(&m_ptElt[ulTail % m_iSize], ptElt, __ATOMIC_RELAXED);
+  __atomic_store_n(&m_ulTail, ulTail + 1, __ATOMIC_RELEASE);
 
   return 0;
 }
 
 template <typename Type>
 int clsCircleQueue<Type>::Push(Type tElt) {
-  if (m_ulHead >= m_iSize + m_ulTail) {
+  unsigned long ulHead = __atomic_load_n(&m_ulHead, __ATOMIC_RELAXED);
+  if (ulHead >= m_iSize + __atomic_load_n(&m_ulTail, __ATOMIC_ACQUIRE)) {
     return -1;
   }
 
-  m_ptElt[m_ulHead % m_iSize] = tElt;
-  m_ulHead++;
+  __atomic_store(&m_ptElt[ulHead % m_iSize], &tElt, __ATOMIC_RELAXED);
+  __atomic_store_n(&m_ulHead, ulHead + 1, __ATOMIC_RELEASE);
 
   return 0;
 }
@@ -200,11 +225,12 @@ template <typename Type>
 int clsCircleQueue<Type>::Back(Type *ptElt) {
   assert(m_iSize != 0);
 
-  if (m_ulHead <= m_ulTail) {
+  unsigned long ulTail = __atomic_load_n(&m_ulTail, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&m_ulHead, __ATOMIC_ACQUIRE) <= ulTail) {
     return -1;
   }
 
-  *ptElt = m_ptElt[m_ulTail % m_iSize];
+  __atomic_load(&m_ptElt[ulTail % m_iSize], ptElt, __ATOMIC_ACQUIRE);
   if (*ptElt == 0) {
     return -2;
   }
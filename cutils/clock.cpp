@@ -0,0 +1,51 @@
+#include "clock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace cutils {
+
+bool TscIsInvariant() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007) return false;
+    __cpuid(0x80000007, eax, ebx, ecx, edx);
+    return (edx & (1U << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+static double CalibrateTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    // spin rather than sleep, so the core does not drop to a deep
+    // C-state in the middle on hosts without an invariant TSC
+    const uint64_t kSpinNanos = 10 * 1000 * 1000;
+    uint64_t t0 = MonotonicNanos();
+    uint64_t c0 = ReadTsc();
+    uint64_t t1, c1;
+    do {
+        t1 = MonotonicNanos();
+        c1 = ReadTsc();
+    } while (t1 - t0 < kSpinNanos);
+    return static_cast<double>(c1 - c0) / (t1 - t0);
+#else
+    return 1.0;
+#endif
+}
+
+double TscTicksPerNano() {
+    static const double ticks_per_nano = CalibrateTsc();
+    return ticks_per_nano;
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace cutils {
+
+// Time sources.  clock_gettime() is served by the vDSO for all of the
+// clocks below, so none of them enters the kernel.
+//
+//   Monotonic        CLOCK_MONOTONIC: ns resolution, never steps (NTP only
+//                    slews it), for measuring intervals and deadlines
+//   CoarseMonotonic  CLOCK_MONOTONIC_COARSE: the time of the last tick, so
+//                    1-4ms resolution, but cheaper still
+//   Wall             CLOCK_REALTIME: for timestamps that leave the process
+
+inline uint64_t ClockNanos(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+inline uint64_t MonotonicNanos() { return ClockNanos(CLOCK_MONOTONIC); }
+inline uint64_t MonotonicMicros() { return MonotonicNanos() / 1000; }
+inline uint64_t MonotonicMillis() { return MonotonicNanos() / 1000000; }
+
+inline uint64_t CoarseMonotonicNanos() {
+    return ClockNanos(CLOCK_MONOTONIC_COARSE);
+}
+inline uint64_t CoarseMonotonicMillis() {
+    return CoarseMonotonicNanos() / 1000000;
+}
+
+inline uint64_t WallNanos() { return ClockNanos(CLOCK_REALTIME); }
+
+// The CPU time stamp counter, or MonotonicNanos() where there is none.
+// Only meaningful for intervals on a host where TscIsInvariant().
+inline uint64_t ReadTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return MonotonicNanos();
+#endif
+}
+
+// Whether the TSC ticks at a constant rate whatever the P- and C-state
+// (CPUID 0x80000007 EDX bit 8), which also means it is synchronized
+// across cores on any recent machine.
+bool TscIsInvariant();
+
+// TSC ticks per nanosecond, measured once against CLOCK_MONOTONIC on the
+// first call (which takes about 10ms).  1.0 without a TSC.
+double TscTicksPerNano();
+
+inline uint64_t TscToNanos(uint64_t ticks) {
+    return static_cast<uint64_t>(ticks / TscTicksPerNano());
+}
+
+// Interval timer on the TSC, for timing short hot paths
+class CycleTimer {
+public:
+    CycleTimer() : start_(ReadTsc()) {}
+
+    void Reset() { start_ = ReadTsc(); }
+    uint64_t ElapsedCycles() const { return ReadTsc() - start_; }
+    uint64_t ElapsedNanos() const { return TscToNanos(ElapsedCycles()); }
+
+private:
+    uint64_t start_;
+};
+
+} // namespace cutils
@@ -5,6 +5,11 @@
 #include "coding.h"
 
 #include <arpa/inet.h>
+#include <assert.h>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace cutils {
 
@@ -49,17 +54,18 @@ void RemoveFixed8(cutils::Slice* key, uint8_t* i) {
 }
 
 void RemoveFixed16(cutils::Slice* key, uint16_t* i) {
-  if (i) *i = ntohs(*(uint16_t *)key->data());
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(key->data());
+  if (i) *i = (p[0] << 8) | p[1];
   key->remove_prefix(2);
 }
 
 void RemoveFixed32(cutils::Slice* key, uint32_t* i) {
-  if (i) *i = ntohl(*(uint32_t *)key->data());
+  if (i) *i = DecodeBigEndian32(key->data());
   key->remove_prefix(4);
 }
 
 void RemoveFixed64(cutils::Slice* key, uint64_t* i) {
-  if (i) *i = ntohll(*(uint64_t *)key->data());
+  if (i) *i = DecodeBigEndian(key->data());
   key->remove_prefix(8);
 }
 
@@ -247,6 +253,474 @@ bool GetLengthPrefixedSlice(Slice* input, Slice* result) {
   }
 }
 
+char* EncodeVarint32Batch(char* dst, const uint32_t* values, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (values[i] < 128) {
+      *(dst++) = static_cast<char>(values[i]);
+    } else {
+      dst = EncodeVarint32(dst, values[i]);
+    }
+  }
+  return dst;
+}
+
+char* EncodeVarint64Batch(char* dst, const uint64_t* values, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (values[i] < 128) {
+      *(dst++) = static_cast<char>(values[i]);
+    } else {
+      dst = EncodeVarint64(dst, values[i]);
+    }
+  }
+  return dst;
+}
+
+void PutVarint32Batch(std::string* dst, const uint32_t* values, size_t n) {
+  size_t old_size = dst->size();
+  dst->resize(old_size + n * kMaxVarint32Length);
+  char* base = &(*dst)[0];
+  char* end = EncodeVarint32Batch(base + old_size, values, n);
+  dst->resize(end - base);
+}
+
+void PutVarint64Batch(std::string* dst, const uint64_t* values, size_t n) {
+  size_t old_size = dst->size();
+  dst->resize(old_size + n * kMaxVarint64Length);
+  char* base = &(*dst)[0];
+  char* end = EncodeVarint64Batch(base + old_size, values, n);
+  dst->resize(end - base);
+}
+
+namespace {
+
+inline const char* GetVarintPtr(const char* p, const char* limit,
+                                uint32_t* value) {
+  return GetVarint32Ptr(p, limit, value);
+}
+
+inline const char* GetVarintPtr(const char* p, const char* limit,
+                                uint64_t* value) {
+  return GetVarint64Ptr(p, limit, value);
+}
+
+// Same as GetVarint32PtrFallback/GetVarint64Ptr, for bytes that are known
+// to be readable.  At most kMaxBytes bytes are consumed.
+template <typename T, int kMaxBytes>
+inline const char* DecodeVarintUnchecked(const char* p, T* value) {
+  const unsigned char* q = reinterpret_cast<const unsigned char*>(p);
+  T result = 0;
+  for (int i = 0, shift = 0; i < kMaxBytes; i++, shift += 7) {
+    T byte = *(q++);
+    if (byte & 128) {
+      // More bytes are present
+      result |= ((byte & 127) << shift);
+    } else {
+      result |= (byte << shift);
+      *value = result;
+      return reinterpret_cast<const char*>(q);
+    }
+  }
+  return NULL;
+}
+
+#if defined(__SSE2__)
+// Widen 16 single-byte values into out[0,15]
+inline void StoreBytes(__m128i x, uint32_t* out) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_unpacklo_epi8(x, zero);
+  __m128i hi = _mm_unpackhi_epi8(x, zero);
+  __m128i* o = reinterpret_cast<__m128i*>(out);
+  _mm_storeu_si128(o + 0, _mm_unpacklo_epi16(lo, zero));
+  _mm_storeu_si128(o + 1, _mm_unpackhi_epi16(lo, zero));
+  _mm_storeu_si128(o + 2, _mm_unpacklo_epi16(hi, zero));
+  _mm_storeu_si128(o + 3, _mm_unpackhi_epi16(hi, zero));
+}
+
+inline void StoreBytes(__m128i x, uint64_t* out) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_unpacklo_epi8(x, zero);
+  __m128i hi = _mm_unpackhi_epi8(x, zero);
+  __m128i w[4] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                  _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+  __m128i* o = reinterpret_cast<__m128i*>(out);
+  for (int i = 0; i < 4; i++) {
+    _mm_storeu_si128(o + 2 * i, _mm_unpacklo_epi32(w[i], zero));
+    _mm_storeu_si128(o + 2 * i + 1, _mm_unpackhi_epi32(w[i], zero));
+  }
+}
+#endif
+
+template <typename T, int kMaxBytes>
+const char* DecodeVarintBatch(const char* p, const char* limit, T* values,
+                              size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  // Look at 16 bytes at a time.  The clear high bits are the terminating
+  // bytes, so every value ending inside the window can be decoded without
+  // bounds checks; a window without any high bit set holds 16 values.
+  while (n - i >= 16 && limit - p >= 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(x);
+    if (mask == 0) {
+      StoreBytes(x, values + i);
+      p += 16;
+      i += 16;
+      continue;
+    }
+    int cnt = __builtin_popcount(~mask & 0xffff);
+    if (cnt == 0) break;  // malformed, let the checked loop report it
+    for (int k = 0; k < cnt; k++) {
+      p = DecodeVarintUnchecked<T, kMaxBytes>(p, values + (i++));
+      if (p == NULL) return NULL;
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    p = GetVarintPtr(p, limit, values + i);
+    if (p == NULL) return NULL;
+  }
+  return p;
+}
+
+}  // namespace
+
+const char* DecodeVarint32Batch(const char* p, const char* limit,
+                                uint32_t* values, size_t n) {
+  return DecodeVarintBatch<uint32_t, kMaxVarint32Length>(p, limit, values, n);
+}
+
+const char* DecodeVarint64Batch(const char* p, const char* limit,
+                                uint64_t* values, size_t n) {
+  return DecodeVarintBatch<uint64_t, kMaxVarint64Length>(p, limit, values, n);
+}
+
+bool GetVarint32Batch(Slice* input, uint32_t* values, size_t n) {
+  const char* p = input->data();
+  const char* limit = p + input->size();
+  const char* q = DecodeVarint32Batch(p, limit, values, n);
+  if (q == NULL) {
+    return false;
+  } else {
+    *input = Slice(q, limit - q);
+    return true;
+  }
+}
+
+bool GetVarint64Batch(Slice* input, uint64_t* values, size_t n) {
+  const char* p = input->data();
+  const char* limit = p + input->size();
+  const char* q = DecodeVarint64Batch(p, limit, values, n);
+  if (q == NULL) {
+    return false;
+  } else {
+    *input = Slice(q, limit - q);
+    return true;
+  }
+}
+
+void PutZigZagVarint32(std::string* dst, int32_t v) {
+  PutVarint32(dst, ZigZagEncode32(v));
+}
+
+void PutZigZagVarint64(std::string* dst, int64_t v) {
+  PutVarint64(dst, ZigZagEncode64(v));
+}
+
+bool GetZigZagVarint32(Slice* input, int32_t* value) {
+  uint32_t v;
+  if (!GetVarint32(input, &v)) return false;
+  *value = ZigZagDecode32(v);
+  return true;
+}
+
+bool GetZigZagVarint64(Slice* input, int64_t* value) {
+  uint64_t v;
+  if (!GetVarint64(input, &v)) return false;
+  *value = ZigZagDecode64(v);
+  return true;
+}
+
+void DeltaEncode32(const uint32_t* in, size_t n, uint32_t* out,
+                   uint32_t prev) {
+  for (size_t i = 0; i < n; i++) {
+    uint32_t v = in[i];
+    out[i] = v - prev;
+    prev = v;
+  }
+}
+
+void DeltaDecode32(const uint32_t* in, size_t n, uint32_t* out,
+                   uint32_t prev) {
+  for (size_t i = 0; i < n; i++) {
+    prev += in[i];
+    out[i] = prev;
+  }
+}
+
+void DeltaEncode64(const uint64_t* in, size_t n, uint64_t* out,
+                   uint64_t prev) {
+  for (size_t i = 0; i < n; i++) {
+    uint64_t v = in[i];
+    out[i] = v - prev;
+    prev = v;
+  }
+}
+
+void DeltaDecode64(const uint64_t* in, size_t n, uint64_t* out,
+                   uint64_t prev) {
+  for (size_t i = 0; i < n; i++) {
+    prev += in[i];
+    out[i] = prev;
+  }
+}
+
+void PutDeltaOfDelta64(std::string* dst, const int64_t* in, size_t n) {
+  // Work on uint64_t so that wrapping is well defined
+  uint64_t prev = 0, prev_delta = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t v = static_cast<uint64_t>(in[i]);
+    uint64_t delta = v - prev;
+    PutVarint64(dst, ZigZagEncode64(static_cast<int64_t>(delta - prev_delta)));
+    prev = v;
+    prev_delta = i == 0 ? 0 : delta;
+  }
+}
+
+bool GetDeltaOfDelta64(Slice* input, int64_t* out, size_t n) {
+  Slice in = *input;
+  uint64_t prev = 0, prev_delta = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t dod;
+    if (!GetVarint64(&in, &dod)) return false;
+    uint64_t delta = prev_delta + static_cast<uint64_t>(ZigZagDecode64(dod));
+    prev += delta;
+    out[i] = static_cast<int64_t>(prev);
+    prev_delta = i == 0 ? 0 : delta;
+  }
+  *input = in;
+  return true;
+}
+
+int MaxBitWidth32(const uint32_t* in, size_t n) {
+  uint32_t acc = 0;
+  for (size_t i = 0; i < n; i++) {
+    acc |= in[i];
+  }
+  return acc == 0 ? 0 : 32 - __builtin_clz(acc);
+}
+
+// The four lanes of a block always see the same shift sequence, so the SSE2
+// version is the scalar algorithm applied to 4 lanes at once.
+char* PackBlock128(const uint32_t* in, uint32_t base, int bits, char* dst) {
+  if (bits == 0) return dst;
+#if defined(__SSE2__)
+  const __m128i vbase = _mm_set1_epi32(base);
+  __m128i* out = reinterpret_cast<__m128i*>(dst);
+  __m128i acc = _mm_setzero_si128();
+  int shift = 0;
+  for (int k = 0; k < 32; k++) {
+    __m128i v = _mm_sub_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4 * k)), vbase);
+    acc = _mm_or_si128(acc, _mm_sll_epi32(v, _mm_cvtsi32_si128(shift)));
+    shift += bits;
+    if (shift >= 32) {
+      _mm_storeu_si128(out++, acc);
+      shift -= 32;
+      acc = _mm_srl_epi32(v, _mm_cvtsi32_si128(bits - shift));
+    }
+  }
+#else
+  for (int lane = 0; lane < 4; lane++) {
+    uint32_t acc = 0;
+    int shift = 0, w = 0;
+    for (int k = 0; k < 32; k++) {
+      uint32_t v = in[4 * k + lane] - base;
+      acc |= v << shift;
+      shift += bits;
+      if (shift >= 32) {
+        EncodeFixed32(dst + 4 * (4 * w + lane), acc);
+        w++;
+        shift -= 32;
+        acc = shift ? v >> (bits - shift) : 0;
+      }
+    }
+  }
+#endif
+  return dst + 16 * bits;
+}
+
+const char* UnpackBlock128(const char* src, uint32_t base, int bits,
+                           uint32_t* out) {
+  if (bits == 0) {
+    for (size_t i = 0; i < kBitPackBlockSize; i++) out[i] = base;
+    return src;
+  }
+  const uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+#if defined(__SSE2__)
+  const __m128i* in = reinterpret_cast<const __m128i*>(src);
+  const __m128i vbase = _mm_set1_epi32(base);
+  const __m128i vmask = _mm_set1_epi32(mask);
+  __m128i cur = _mm_loadu_si128(in++);
+  int shift = 0;
+  for (int k = 0; k < 32; k++) {
+    __m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(shift));
+    shift += bits;
+    if (shift >= 32) {
+      shift -= 32;
+      if (k != 31) cur = _mm_loadu_si128(in++);
+      if (shift > 0) {
+        v = _mm_or_si128(v, _mm_sll_epi32(cur, _mm_cvtsi32_si128(bits - shift)));
+      }
+    }
+    v = _mm_add_epi32(_mm_and_si128(v, vmask), vbase);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * k), v);
+  }
+#else
+  for (int lane = 0; lane < 4; lane++) {
+    int shift = 0, w = 0;
+    uint32_t cur = DecodeFixed32(src + 4 * lane);
+    for (int k = 0; k < 32; k++) {
+      uint32_t v = cur >> shift;
+      shift += bits;
+      if (shift >= 32) {
+        shift -= 32;
+        if (k != 31) cur = DecodeFixed32(src + 4 * (4 * (++w) + lane));
+        if (shift > 0) v |= cur << (bits - shift);
+      }
+      out[4 * k + lane] = (v & mask) + base;
+    }
+  }
+#endif
+  return src + 16 * bits;
+}
+
+uint32_t UnpackBlock128At(const char* src, uint32_t base, int bits,
+                          size_t i) {
+  if (bits == 0) return base;
+  const uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+  size_t lane = i & 3;
+  size_t bit = (i >> 2) * bits;
+  size_t w = bit >> 5;
+  int shift = bit & 31;
+  uint32_t v = DecodeFixed32(src + 4 * (4 * w + lane)) >> shift;
+  if (shift + bits > 32) {
+    v |= DecodeFixed32(src + 4 * (4 * (w + 1) + lane)) << (32 - shift);
+  }
+  return (v & mask) + base;
+}
+
+void PutBitPacked32(std::string* dst, const uint32_t* in, size_t n,
+                    bool delta) {
+  const size_t num_blocks = (n + kBitPackBlockSize - 1) / kBitPackBlockSize;
+  PutVarint32(dst, n);
+  dst->push_back(delta ? 1 : 0);
+  const size_t offsets = dst->size();
+  dst->resize(offsets + 4 * num_blocks);
+  const size_t blocks = dst->size();
+  // worst case, so that the blocks are written without reallocation
+  dst->reserve(blocks + num_blocks * (5 + 16 * 32));
+
+  uint32_t buf[kBitPackBlockSize];
+  for (size_t b = 0; b < num_blocks; b++) {
+    const uint32_t* v = in + b * kBitPackBlockSize;
+    size_t cnt = std::min(kBitPackBlockSize, n - b * kBitPackBlockSize);
+    uint32_t base;
+    if (delta) {
+      base = v[0];
+      buf[0] = 0;
+      DeltaEncode32(v + 1, cnt - 1, buf + 1, v[0]);
+      for (size_t i = cnt; i < kBitPackBlockSize; i++) buf[i] = 0;
+    } else {
+      base = v[0];
+      for (size_t i = 1; i < cnt; i++) base = std::min(base, v[i]);
+      for (size_t i = 0; i < cnt; i++) buf[i] = v[i] - base;
+      for (size_t i = cnt; i < kBitPackBlockSize; i++) buf[i] = 0;
+    }
+    int bits = MaxBitWidth32(buf, kBitPackBlockSize);
+
+    EncodeFixed32(&(*dst)[offsets + 4 * b], dst->size() - blocks);
+    PutFixed32(dst, base);
+    dst->push_back(static_cast<char>(bits));
+    size_t pos = dst->size();
+    dst->resize(pos + 16 * bits);
+    PackBlock128(buf, 0, bits, &(*dst)[pos]);
+  }
+}
+
+bool BitPackedReader32::Init(Slice* input) {
+  Slice in = *input;
+  uint32_t n;
+  if (!GetVarint32(&in, &n) || in.size() < 1) return false;
+  uint8_t flags = in[0];
+  if (flags > 1) return false;
+  in.remove_prefix(1);
+
+  size_t num_blocks = (n + kBitPackBlockSize - 1) / kBitPackBlockSize;
+  if (in.size() / 4 < num_blocks) return false;
+  const char* offsets = in.data();
+  in.remove_prefix(4 * num_blocks);
+
+  // Blocks are laid out back to back, check every one of them now so that
+  // the accessors need no bounds checks
+  const char* blocks = in.data();
+  size_t pos = 0;
+  for (size_t b = 0; b < num_blocks; b++) {
+    if (DecodeFixed32(offsets + 4 * b) != pos) return false;
+    if (in.size() - pos < 5) return false;
+    uint8_t bits = blocks[pos + 4];
+    if (bits > 32 || in.size() - pos - 5 < 16u * bits) return false;
+    pos += 5 + 16 * bits;
+  }
+
+  n_ = n;
+  delta_ = (flags == 1);
+  offsets_ = offsets;
+  blocks_ = blocks;
+  num_blocks_ = num_blocks;
+  in.remove_prefix(pos);
+  *input = in;
+  return true;
+}
+
+size_t BitPackedReader32::DecodeBlock(size_t b, uint32_t* out) const {
+  assert(b < num_blocks_);
+  const char* p = Block(b);
+  uint32_t base = DecodeFixed32(p);
+  int bits = static_cast<uint8_t>(p[4]);
+  if (delta_) {
+    UnpackBlock128(p + 5, 0, bits, out);
+    DeltaDecode32(out, kBitPackBlockSize, out, base);
+  } else {
+    UnpackBlock128(p + 5, base, bits, out);
+  }
+  return std::min(kBitPackBlockSize, n_ - b * kBitPackBlockSize);
+}
+
+uint32_t BitPackedReader32::Get(size_t i) const {
+  assert(i < n_);
+  size_t b = i / kBitPackBlockSize;
+  if (delta_) {
+    uint32_t buf[kBitPackBlockSize];
+    DecodeBlock(b, buf);
+    return buf[i % kBitPackBlockSize];
+  }
+  const char* p = Block(b);
+  return UnpackBlock128At(p + 5, DecodeFixed32(p), static_cast<uint8_t>(p[4]),
+                          i % kBitPackBlockSize);
+}
+
+void BitPackedReader32::DecodeAll(uint32_t* out) const {
+  size_t full = n_ / kBitPackBlockSize;
+  for (size_t b = 0; b < full; b++) {
+    DecodeBlock(b, out + b * kBitPackBlockSize);
+  }
+  if (full < num_blocks_) {
+    uint32_t buf[kBitPackBlockSize];
+    size_t cnt = DecodeBlock(full, buf);
+    memcpy(out + full * kBitPackBlockSize, buf, cnt * sizeof(uint32_t));
+  }
+}
+
 }  // namespace cutils
 
 //gzrd_Lib_CPP_Version_ID--start
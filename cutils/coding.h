@@ -55,6 +55,26 @@ extern const char* GetVarint64Ptr(const char* p, const char* limit,
 // Returns the length of the varint32 or varint64 encoding of "v"
 extern int VarintLength(uint64_t v);
 
+// Maximum encoded length of a single varint32 / varint64
+static const int kMaxVarint32Length = 5;
+static const int kMaxVarint64Length = 10;
+
+// Batch versions of the varint routines.  The wire format is exactly the
+// same as "n" consecutive PutVarint32/PutVarint64 calls, so data written by
+// either side can be read by the other.
+//
+// Put...Batch grows "dst" once for the whole batch instead of once per value.
+extern void PutVarint32Batch(std::string* dst, const uint32_t* values,
+                             size_t n);
+extern void PutVarint64Batch(std::string* dst, const uint64_t* values,
+                             size_t n);
+
+// Decode "n" values from the beginning of "input" into values[0,n-1] and
+// advance "input" past them.  Return false if the input is truncated or
+// malformed, in which case "input" is left unchanged.
+extern bool GetVarint32Batch(Slice* input, uint32_t* values, size_t n);
+extern bool GetVarint64Batch(Slice* input, uint64_t* values, size_t n);
+
 // Lower-level versions of Put... that write directly into a character buffer
 // REQUIRES: dst has enough space for the value being written
 extern void EncodeFixed32(char* dst, uint32_t value);
@@ -66,6 +86,19 @@ extern void EncodeFixed64(char* dst, uint64_t value);
 extern char* EncodeVarint32(char* dst, uint32_t value);
 extern char* EncodeVarint64(char* dst, uint64_t value);
 
+// Encode values[0,n-1] and return a pointer just past the last byte written.
+// REQUIRES: dst has at least n * kMaxVarint32Length (or kMaxVarint64Length)
+// bytes of space
+extern char* EncodeVarint32Batch(char* dst, const uint32_t* values, size_t n);
+extern char* EncodeVarint64Batch(char* dst, const uint64_t* values, size_t n);
+
+// Decode "n" values from [p..limit-1] into values[0,n-1].  Return a pointer
+// just past the last parsed value, or NULL on error.
+extern const char* DecodeVarint32Batch(const char* p, const char* limit,
+                                       uint32_t* values, size_t n);
+extern const char* DecodeVarint64Batch(const char* p, const char* limit,
+                                       uint64_t* values, size_t n);
+
 // Lower-level versions of Get... that read directly from a character buffer
 // without any bounds checking.
 
@@ -142,4 +175,120 @@ inline uint64_t DecodeBigEndian(const char* ptr) {
   return (hi << 32) | lo;
 }
 
+// Zigzag coding maps signed integers to unsigned ones so that small
+// magnitudes (positive or negative) get a short varint encoding:
+// 0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3, ...
+inline uint32_t ZigZagEncode32(int32_t v) {
+  return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+inline int32_t ZigZagDecode32(uint32_t v) {
+  return static_cast<int32_t>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+inline uint64_t ZigZagEncode64(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t ZigZagDecode64(uint64_t v) {
+  return static_cast<int64_t>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+extern void PutZigZagVarint32(std::string* dst, int32_t value);
+extern void PutZigZagVarint64(std::string* dst, int64_t value);
+extern bool GetZigZagVarint32(Slice* input, int32_t* value);
+extern bool GetZigZagVarint64(Slice* input, int64_t* value);
+
+// Delta coding: out[i] = in[i] - in[i - 1] with in[-1] = "prev", and the
+// reverse prefix sum.  Arithmetic wraps, so any input round-trips; sorted
+// input gives small deltas.  "out" may be the same array as "in".
+extern void DeltaEncode32(const uint32_t* in, size_t n, uint32_t* out,
+                          uint32_t prev = 0);
+extern void DeltaDecode32(const uint32_t* in, size_t n, uint32_t* out,
+                          uint32_t prev = 0);
+extern void DeltaEncode64(const uint64_t* in, size_t n, uint64_t* out,
+                          uint64_t prev = 0);
+extern void DeltaDecode64(const uint64_t* in, size_t n, uint64_t* out,
+                          uint64_t prev = 0);
+
+// Delta-of-delta coding for series with a near constant step, such as
+// timestamps: in[0], in[1] - in[0], then the change of the delta, every
+// one as a zigzag varint64.  A regular series costs one byte per value.
+extern void PutDeltaOfDelta64(std::string* dst, const int64_t* in, size_t n);
+extern bool GetDeltaOfDelta64(Slice* input, int64_t* out, size_t n);
+
+// Frame-of-reference bit packing in blocks of kBitPackBlockSize values.
+//
+// A block stores (value - base) with the same bit width for all 128
+// values, in the 4-lane interleaved layout of SIMD-BP128: value i goes to
+// lane i % 4, every lane is packed LSB first into 32-bit words, and word j
+// of lane l is the (4 * j + l)-th little endian word of the block.  A block
+// of width "bits" takes exactly 16 * bits bytes.
+static const size_t kBitPackBlockSize = 128;
+
+// Number of bits needed by the largest of in[0,n-1] (0 when all are 0)
+extern int MaxBitWidth32(const uint32_t* in, size_t n);
+
+// Pack in[0,127] - base with "bits" bits each and return a pointer just
+// past the 16 * bits bytes written.
+// REQUIRES: 0 <= bits <= 32 and every in[i] - base fits in "bits" bits
+extern char* PackBlock128(const uint32_t* in, uint32_t base, int bits,
+                          char* dst);
+
+// Unpack a block written by PackBlock128 into out[0,127] and return a
+// pointer just past it.
+extern const char* UnpackBlock128(const char* src, uint32_t base, int bits,
+                                  uint32_t* out);
+
+// Return value "i" (0 <= i < 128) of a packed block without unpacking it
+extern uint32_t UnpackBlock128At(const char* src, uint32_t base, int bits,
+                                 size_t i);
+
+// Append in[0,n-1] as a sequence of packed blocks to *dst:
+//   varint32 n, 1 byte flags, fixed32 offset of every block, blocks
+//   block: fixed32 base, 1 byte bits, 16 * bits bytes of packed values
+// With "delta" (sorted input) a block holds its first value as base and
+// the differences between neighbours as packed values, otherwise base is
+// the block minimum.
+extern void PutBitPacked32(std::string* dst, const uint32_t* in, size_t n,
+                           bool delta = false);
+
+// Random access reader over what PutBitPacked32 wrote.  Decodes straight
+// into caller buffers and never copies the input, which must outlive it.
+class BitPackedReader32 {
+ public:
+  BitPackedReader32() : n_(0), delta_(false), offsets_(NULL), blocks_(NULL),
+                        num_blocks_(0) {}
+
+  // Parse and validate the header and all block headers.  On success
+  // advance *input past the packed data.
+  bool Init(Slice* input);
+
+  size_t size() const { return n_; }
+  size_t num_blocks() const { return num_blocks_; }
+
+  // Decode block "b" into out[0,kBitPackBlockSize-1] and return the
+  // number of valid values in it.
+  // REQUIRES: b < num_blocks()
+  size_t DecodeBlock(size_t b, uint32_t* out) const;
+
+  // Return value "i".  Costs a block decode with delta coding.
+  // REQUIRES: i < size()
+  uint32_t Get(size_t i) const;
+
+  // Decode every value into out[0,size()-1]
+  void DecodeAll(uint32_t* out) const;
+
+ private:
+  const char* Block(size_t b) const {
+    return blocks_ + DecodeFixed32(offsets_ + 4 * b);
+  }
+
+  size_t n_;
+  bool delta_;
+  const char* offsets_;
+  const char* blocks_;
+  size_t num_blocks_;
+};
+
 }  // namespace cutils
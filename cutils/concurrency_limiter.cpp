@@ -0,0 +1,114 @@
+#include "concurrency_limiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cutils {
+
+ConcurrencyLimiter::ConcurrencyLimiter(const Options& options)
+    : options_(options), limit_(options.initial_limit), inflight_(0),
+      limit_value_(options.initial_limit) {}
+
+bool ConcurrencyLimiter::TryAcquire() {
+    int inflight = inflight_.load(std::memory_order_relaxed);
+    do {
+        if (inflight >= limit_.load(std::memory_order_relaxed)) return false;
+    } while (!inflight_.compare_exchange_weak(inflight, inflight + 1,
+                                              std::memory_order_relaxed));
+    return true;
+}
+
+void ConcurrencyLimiter::Release(uint64_t rtt_ns, bool dropped) {
+    int inflight = inflight_.fetch_sub(1, std::memory_order_relaxed);
+    if (rtt_ns == 0 && !dropped) return;
+
+    uint64_t now = MonotonicNanos();
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (window_samples_ == 0) window_begin_ = now;
+    if (!dropped) {
+        // the RTT of a drop, often 0, is not the downstream's latency
+        window_sum_ += rtt_ns;
+        ++window_rtt_samples_;
+    }
+    ++window_samples_;
+    window_max_inflight_ = std::max(window_max_inflight_, inflight);
+    window_dropped_ |= dropped;
+    if (window_samples_ >= options_.min_window_samples &&
+        now - window_begin_ >= options_.window_ns) {
+        UpdateLimit(now);
+    }
+}
+
+void ConcurrencyLimiter::UpdateLimit(uint64_t now) {
+    // a window of drops only backs off, its RTT is the last one
+    uint64_t rtt = window_rtt_samples_ > 0
+                       ? window_sum_ / window_rtt_samples_
+                       : window_rtt_;
+    double limit = limit_value_;
+
+    // grow only when the limit is what held requests back
+    bool app_limited = window_max_inflight_ * 2 < limit;
+
+    if (window_dropped_ ||
+        (options_.algorithm == kAimd && options_.timeout_ns != 0 &&
+         rtt > options_.timeout_ns)) {
+        limit *= options_.backoff_ratio;
+    } else if (options_.algorithm == kAimd) {
+        if (!app_limited) limit += 1;
+    } else if (options_.probe_windows > 0 &&
+               ++windows_ % options_.probe_windows == 0) {
+        min_rtt_ = 0;
+        limit = std::sqrt(std::min(limit, (double)window_max_inflight_));
+    } else {
+        if (min_rtt_ == 0 || rtt < min_rtt_) min_rtt_ = rtt;
+        double gradient = std::max(0.5, std::min(1.0,
+                    options_.rtt_tolerance * min_rtt_ / rtt));
+        double target = limit * gradient + std::sqrt(limit);
+        if (!app_limited || target < limit) {
+            limit = limit * (1 - options_.smoothing) +
+                    target * options_.smoothing;
+        }
+    }
+
+    limit_value_ = std::max<double>(
+        options_.min_limit, std::min<double>(options_.max_limit, limit));
+    limit_.store((int)limit_value_, std::memory_order_relaxed);
+
+    window_rtt_ = rtt;
+    window_begin_ = now;
+    window_sum_ = 0;
+    window_rtt_samples_ = 0;
+    window_samples_ = 0;
+    window_max_inflight_ = 0;
+    window_dropped_ = false;
+}
+
+bool ConcurrencyLimiter::TryAddTask(AsyncWorkerPool* pool, AsyncTask task) {
+    if (!TryAcquire()) return false;
+    uint64_t begin = MonotonicNanos();
+    pool->AddTask([this, task, begin] {
+        task();
+        Release(std::max<uint64_t>(MonotonicNanos() - begin, 1));
+    });
+    return true;
+}
+
+uint64_t ConcurrencyLimiter::WindowRttNanos() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return window_rtt_;
+}
+
+uint64_t ConcurrencyLimiter::MinRttNanos() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return min_rtt_;
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#include "async_worker.h"
+
+namespace cutils {
+
+// Limits the number of requests in flight to a downstream, adjusting the
+// limit from the latency and drops it observes, so the limit follows the
+// capacity of the downstream instead of a configured rate.
+//
+//   if (!limiter.TryAcquire()) return shed();
+//   uint64_t beg = MonotonicNanos();
+//   int ret = Call();
+//   limiter.Release(MonotonicNanos() - beg, ret == -ETIMEDOUT);
+//
+// Samples are gathered into windows of at least window_ns and
+// min_window_samples; at the end of each window the limit moves once, by
+// one of
+//
+//   kAimd      +1 if the window saw no drop and the limit was actually
+//              used, times backoff_ratio if it saw a drop or its mean
+//              RTT is above timeout_ns
+//   kGradient  Vegas style, as Netflix's gradient limiter: the limit is
+//              scaled by min RTT * rtt_tolerance / window RTT (within
+//              [0.5, 1]), plus sqrt(limit) of headroom for queueing, and
+//              smoothed.  The min RTT is the lowest window RTT seen; every
+//              probe_windows windows it is forgotten and the limit cut
+//              to the square root of the concurrency in use, so that a
+//              downstream that got faster, or a start already overloaded,
+//              is measured at low concurrency again.  Drops back off as
+//              with kAimd.
+//
+// The window RTT is the mean over the samples that were not dropped.
+//
+// Neither grows the limit while less than half of it is in use.
+//
+// TryAcquire() is one CAS; Release() takes a mutex to add the sample.
+class ConcurrencyLimiter {
+public:
+    enum Algorithm {
+        kAimd = 0,
+        kGradient = 1,
+    };
+
+    struct Options {
+        Algorithm algorithm = kGradient;
+        int initial_limit = 20;
+        int min_limit = 1;
+        int max_limit = 1000;
+
+        uint64_t window_ns = 100 * 1000 * 1000;
+        int min_window_samples = 10;
+
+        double backoff_ratio = 0.9;
+        uint64_t timeout_ns = 0; // kAimd, 0 for none
+
+        double rtt_tolerance = 1.5; // kGradient
+        double smoothing = 0.2;
+        int probe_windows = 100;
+    };
+
+    ConcurrencyLimiter() : ConcurrencyLimiter(Options()) {}
+    explicit ConcurrencyLimiter(const Options& options);
+
+    ConcurrencyLimiter(const ConcurrencyLimiter&) = delete;
+    ConcurrencyLimiter& operator=(const ConcurrencyLimiter&) = delete;
+
+    // Take a slot if fewer than Limit() requests are in flight
+    bool TryAcquire();
+
+    // Return the slot of a finished request with its latency.  "dropped"
+    // marks a timeout, overload error or similar sign of congestion.  A
+    // request that says nothing about the downstream (cancelled, failed
+    // locally) passes rtt_ns 0 and is not sampled.
+    void Release(uint64_t rtt_ns, bool dropped = false);
+
+    // TryAcquire() in front of pool->AddTask(); the slot is released with
+    // the time from here to the end of the task, queueing included.
+    // Return false, without queueing, if the limit is reached.
+    bool TryAddTask(AsyncWorkerPool* pool, AsyncTask task);
+
+    int Limit() const { return limit_.load(std::memory_order_relaxed); }
+    int InFlight() const { return inflight_.load(std::memory_order_relaxed); }
+
+    // Mean RTT of the last window, and the lowest since the last probe
+    // (kGradient)
+    uint64_t WindowRttNanos() const;
+    uint64_t MinRttNanos() const;
+
+private:
+    void UpdateLimit(uint64_t now);
+
+    const Options options_;
+    std::atomic<int> limit_;
+    std::atomic<int> inflight_;
+
+    mutable std::mutex mutex_; // everything below
+    double limit_value_;
+    uint64_t window_begin_ = 0;
+    uint64_t window_sum_ = 0;      // RTTs of the samples not dropped
+    int window_rtt_samples_ = 0;
+    int window_samples_ = 0;
+    int window_max_inflight_ = 0;
+    bool window_dropped_ = false;
+    uint64_t window_rtt_ = 0;
+    uint64_t min_rtt_ = 0;
+    int windows_ = 0;
+};
+
+} // namespace cutils
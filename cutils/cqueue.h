@@ -135,7 +135,7 @@ public:
             }
         }
 
-        return std::move(vec);
+        return vec;
     }
 
     std::vector<std::unique_ptr<EntryType>> BatchPop(size_t iMaxBatchSize) {
@@ -162,7 +162,7 @@ public:
         }
 
         assert(false == vec.empty());
-        return std::move(vec);
+        return vec;
     }
 
     int BatchPopNoWait(
@@ -12,17 +12,22 @@
 
 #include "crc32c.h"
 #include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
-#include <linux/version.h>
-#ifndef RHEL_MAJOR
-// disable SSE42 if SUSE
-#undef HAVE_SSE42
-#endif
-
-#ifdef HAVE_SSE42
+// The x86 kernels are built with function level target attributes and
+// picked by CPUID at runtime, so the library needs no -msse4.2/-mpclmul
+// and one binary runs everywhere.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC32C_X86 1
 #include <nmmintrin.h>
 #include <wmmintrin.h>
+#define CRC32C_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define CRC32C_TARGET_PCLMUL __attribute__((target("sse4.2,pclmul")))
 #endif
+#include "async_worker.h"
 #include "coding.h"
 
 #ifdef __powerpc64__
@@ -235,7 +240,7 @@ static inline uint32_t LE_LOAD32(const uint8_t* p) {
   return DecodeFixed32(reinterpret_cast<const char*>(p));
 }
 
-#if defined(HAVE_SSE42) && (defined(__LP64__) || defined(_WIN64))
+#ifdef CRC32C_X86
 static inline uint64_t LE_LOAD64(const uint8_t* p) {
   return DecodeFixed64(reinterpret_cast<const char*>(p));
 }
@@ -253,19 +258,13 @@ static inline void Slow_CRC32(uint64_t* l, uint8_t const** p) {
        table1_[(c >> 16) & 0xff] ^ table0_[c >> 24];
 }
 
+#ifdef CRC32C_X86
+CRC32C_TARGET_SSE42
 static inline void Fast_CRC32(uint64_t* l, uint8_t const** p) {
-#ifndef HAVE_SSE42
-  Slow_CRC32(l, p);
-#elif defined(__LP64__) || defined(_WIN64)
   *l = _mm_crc32_u64(*l, LE_LOAD64(*p));
   *p += 8;
-#else
-  *l = _mm_crc32_u32(static_cast<unsigned int>(*l), LE_LOAD32(*p));
-  *p += 4;
-  *l = _mm_crc32_u32(static_cast<unsigned int>(*l), LE_LOAD32(*p));
-  *p += 4;
-#endif
 }
+#endif
 
 template <void (*CRC32)(uint64_t*, uint8_t const**)>
 uint32_t ExtendImpl(uint32_t crc, const char* buf, size_t size) {
@@ -310,39 +309,37 @@ uint32_t ExtendImpl(uint32_t crc, const char* buf, size_t size) {
   return static_cast<uint32_t>(l ^ 0xffffffffu);
 }
 
+static uint32_t ExtendTable(uint32_t crc, const char* buf, size_t size) {
+  return ExtendImpl<Slow_CRC32>(crc, buf, size);
+}
+
+#ifdef CRC32C_X86
+// flatten, so that ExtendImpl and Fast_CRC32 are inlined into a single
+// sse4.2 function instead of calling Fast_CRC32 every 8 bytes
+CRC32C_TARGET_SSE42 __attribute__((flatten))
+static uint32_t ExtendSSE42(uint32_t crc, const char* buf, size_t size) {
+  return ExtendImpl<Fast_CRC32>(crc, buf, size);
+}
+#endif
+
 // Detect if SS42 or not.
 #ifndef HAVE_POWER8
 
 static bool isSSE42() {
-#ifndef HAVE_SSE42
-  return false;
-#elif defined(__GNUC__) && defined(__x86_64__) && !defined(IOS_CROSS_COMPILE)
+#ifdef CRC32C_X86
   uint32_t c_;
   __asm__("cpuid" : "=c"(c_) : "a"(1) : "ebx", "edx");
   return c_ & (1U << 20);  // copied from CpuId.h in Folly. Test SSE42
-#elif defined(_WIN64)
-  int info[4];
-  __cpuidex(info, 0x00000001, 0);
-  return (info[2] & ((int)1 << 20)) != 0;
 #else
   return false;
 #endif
 }
 
 static bool isPCLMULQDQ() {
-#ifndef HAVE_SSE42
-  // in build_detect_platform we set this macro when both SSE42 and PCLMULQDQ
-  // are
-  // supported by compiler
-  return false;
-#elif defined(__GNUC__) && defined(__x86_64__) && !defined(IOS_CROSS_COMPILE)
+#ifdef CRC32C_X86
   uint32_t c_;
   __asm__("cpuid" : "=c"(c_) : "a"(1) : "ebx", "edx");
   return c_ & (1U << 1);  // PCLMULQDQ is in bit 1 (not bit 0)
-#elif defined(_WIN64)
-  int info[4];
-  __cpuidex(info, 0x00000001, 0);
-  return (info[2] & ((int)1 << 1)) != 0;
 #else
   return false;
 #endif
@@ -434,7 +431,7 @@ std::string IsFastCrc32Supported() {
  * <davejwatson@fb.com>
  *
 */
-#if defined HAVE_SSE42 && defined HAVE_PCLMUL
+#ifdef CRC32C_X86
 
 #define CRCtriplet(crc, buf, offset)                  \
   crc##0 = _mm_crc32_u64(crc##0, *(buf##0 + offset)); \
@@ -446,11 +443,11 @@ std::string IsFastCrc32Supported() {
   crc##1 = _mm_crc32_u64(crc##1, *(buf##1 + offset));
 
 #define CRCsinglet(crc, buf, offset) \
-  crc = _mm_crc32_u64(crc, *(uint64_t*)(buf + offset));
+  crc = _mm_crc32_u64(crc, LE_LOAD64(buf + offset));
 
 // Numbers taken directly from intel whitepaper.
 // clang-format off
-const uint64_t clmul_constants[] = {
+static const uint64_t clmul_constants[] = {
     0x14cd00bd6, 0x105ec76f0, 0x0ba4fc28e, 0x14cd00bd6,
     0x1d82c63da, 0x0f20c0dfe, 0x09e4addf8, 0x0ba4fc28e,
     0x039d3b296, 0x1384aa63a, 0x102f9b8a2, 0x1d82c63da,
@@ -525,17 +522,18 @@ __attribute__((__no_sanitize__("alignment")))
 __attribute__((__no_sanitize_undefined__))
 #endif
 #endif
-inline void align_to_8(
+CRC32C_TARGET_SSE42
+static inline void align_to_8(
     size_t len,
     uint64_t& crc0, // crc so far, updated on return
     const unsigned char*& next) { // next data pointer, updated on return
   uint32_t crc32bit = static_cast<uint32_t>(crc0);
   if (len & 0x04) {
-    crc32bit = _mm_crc32_u32(crc32bit, *(uint32_t*)next);
+    crc32bit = _mm_crc32_u32(crc32bit, LE_LOAD32(next));
     next += sizeof(uint32_t);
   }
   if (len & 0x02) {
-    crc32bit = _mm_crc32_u16(crc32bit, *(uint16_t*)next);
+    crc32bit = _mm_crc32_u16(crc32bit, next[0] | (next[1] << 8));
     next += sizeof(uint16_t);
   }
   if (len & 0x01) {
@@ -549,7 +547,8 @@ inline void align_to_8(
 // CombineCRC performs pclmulqdq multiplication of 2 partial CRC's and a well
 // chosen constant and xor's these with the remaining CRC.
 //
-inline uint64_t CombineCRC(
+CRC32C_TARGET_PCLMUL
+static inline uint64_t CombineCRC(
     size_t block_size,
     uint64_t crc0,
     uint64_t crc1,
@@ -576,7 +575,8 @@ __attribute__((__no_sanitize__("alignment")))
 __attribute__((__no_sanitize_undefined__))
 #endif
 #endif
-uint32_t crc32c_3way(uint32_t crc, const char* buf, size_t len) {
+CRC32C_TARGET_PCLMUL
+static uint32_t crc32c_3way(uint32_t crc, const char* buf, size_t len) {
   const unsigned char* next = (const unsigned char*)buf;
   uint64_t count;
   uint64_t crc0, crc1, crc2;
@@ -1109,33 +1109,341 @@ uint32_t crc32c_3way(uint32_t crc, const char* buf, size_t len) {
   }
 }
 
-#endif //HAVE_SSE42 && HAVE_PCLMUL
+// Copy-and-checksum kernels: every qword is loaded once, stored to dst and
+// fed to crc32, so the source is only read once.
 
-static inline Function Choose_Extend() {
-#ifndef HAVE_POWER8
-  if (isSSE42()) {
-    if (isPCLMULQDQ()) {
-#if defined HAVE_SSE42  && defined HAVE_PCLMUL && !defined NO_THREEWAY_CRC32C
-      return crc32c_3way;
+static inline void LE_STORE64(unsigned char* p, uint64_t v) {
+  memcpy(p, &v, sizeof(v));
+}
+
+CRC32C_TARGET_SSE42
+static uint32_t CopySSE42(uint32_t crc, char* dst, const char* src,
+                          size_t len) {
+  const unsigned char* next = (const unsigned char*)src;
+  unsigned char* out = (unsigned char*)dst;
+  uint64_t crc0 = crc ^ 0xffffffffu;
+  for (; len >= 8; len -= 8, next += 8, out += 8) {
+    uint64_t v = LE_LOAD64(next);
+    LE_STORE64(out, v);
+    crc0 = _mm_crc32_u64(crc0, v);
+  }
+  memcpy(out, next, len);
+  align_to_8(len, crc0, next);
+  return (uint32_t)crc0 ^ 0xffffffffu;
+}
+
+// Same block structure as crc32c_3way: three lanes of block_size qwords
+// run as independent crc32 chains and are merged by CombineCRC, which
+// folds in the last qword of the third lane itself.
+CRC32C_TARGET_PCLMUL
+static uint32_t Copy3way(uint32_t crc, char* dst, const char* src,
+                         size_t len) {
+  const unsigned char* next = (const unsigned char*)src;
+  unsigned char* out = (unsigned char*)dst;
+  uint64_t crc0 = crc ^ 0xffffffffu;
+  if (len > 216) {
+    // CombineCRC loads from the source directly, so align it
+    size_t align_bytes = (8 - (uintptr_t)next) & 7;
+    memcpy(out, next, align_bytes);
+    out += align_bytes;
+    len -= align_bytes;
+    align_to_8(align_bytes, crc0, next);
+
+    size_t block_size;
+    while ((block_size = std::min<size_t>(len / 24, 128)) >= 8) {
+      const size_t lane = block_size * 8;
+      uint64_t crc1 = 0, crc2 = 0;
+      for (size_t i = 0; i + 8 < lane; i += 8) {
+        uint64_t v0 = LE_LOAD64(next + i);
+        uint64_t v1 = LE_LOAD64(next + lane + i);
+        uint64_t v2 = LE_LOAD64(next + 2 * lane + i);
+        LE_STORE64(out + i, v0);
+        LE_STORE64(out + lane + i, v1);
+        LE_STORE64(out + 2 * lane + i, v2);
+        crc0 = _mm_crc32_u64(crc0, v0);
+        crc1 = _mm_crc32_u64(crc1, v1);
+        crc2 = _mm_crc32_u64(crc2, v2);
+      }
+      uint64_t v0 = LE_LOAD64(next + lane - 8);
+      uint64_t v1 = LE_LOAD64(next + 2 * lane - 8);
+      LE_STORE64(out + lane - 8, v0);
+      LE_STORE64(out + 2 * lane - 8, v1);
+      memcpy(out + 3 * lane - 8, next + 3 * lane - 8, 8);
+      crc0 = _mm_crc32_u64(crc0, v0);
+      crc1 = _mm_crc32_u64(crc1, v1);
+      next += 3 * lane;
+      out += 3 * lane;
+      len -= 3 * lane;
+      crc0 = CombineCRC(block_size, crc0, crc1, crc2, (const uint64_t*)next);
+    }
+  }
+  return CopySSE42((uint32_t)crc0 ^ 0xffffffffu, (char*)out,
+                   (const char*)next, len);
+}
+
+// Records at least this long get the 3-way kernel of their own
+static const size_t kBatchLongRecord = 2048;
+
+// Finish one record of a batch from the running crc
+CRC32C_TARGET_SSE42
+static inline uint32_t BatchFinishSSE42(uint64_t crc, const unsigned char* next,
+                                        size_t len, bool mask) {
+  for (; len >= 8; len -= 8, next += 8) {
+    crc = _mm_crc32_u64(crc, LE_LOAD64(next));
+  }
+  align_to_8(len, crc, next);
+  uint32_t res = (uint32_t)crc ^ 0xffffffffu;
+  return mask ? Mask(res) : res;
+}
+
+// Checksum four records at a time with four interleaved crc32 chains up to
+// the length of the shortest one, so the 3 cycle latency of crc32 is
+// hidden; what is left of each record is finished on its own.
+template <typename Source>
+CRC32C_TARGET_SSE42
+static void BatchSSE42(const Source& src, size_t n, uint32_t* crcs,
+                       bool mask, Function extend) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const unsigned char* p0 = (const unsigned char*)src.data(i);
+    const unsigned char* p1 = (const unsigned char*)src.data(i + 1);
+    const unsigned char* p2 = (const unsigned char*)src.data(i + 2);
+    const unsigned char* p3 = (const unsigned char*)src.data(i + 3);
+    size_t l0 = src.size(i), l1 = src.size(i + 1);
+    size_t l2 = src.size(i + 2), l3 = src.size(i + 3);
+    size_t common = std::min(std::min(l0, l1), std::min(l2, l3)) & ~(size_t)7;
+    if (common >= kBatchLongRecord) {
+      for (int j = 0; j < 4; j++) {
+        uint32_t crc = extend(0, src.data(i + j), src.size(i + j));
+        crcs[i + j] = mask ? Mask(crc) : crc;
+      }
+      continue;
+    }
+    uint64_t c0 = 0xffffffffu, c1 = 0xffffffffu;
+    uint64_t c2 = 0xffffffffu, c3 = 0xffffffffu;
+    for (size_t k = 0; k < common; k += 8) {
+      c0 = _mm_crc32_u64(c0, LE_LOAD64(p0 + k));
+      c1 = _mm_crc32_u64(c1, LE_LOAD64(p1 + k));
+      c2 = _mm_crc32_u64(c2, LE_LOAD64(p2 + k));
+      c3 = _mm_crc32_u64(c3, LE_LOAD64(p3 + k));
+    }
+    crcs[i] = BatchFinishSSE42(c0, p0 + common, l0 - common, mask);
+    crcs[i + 1] = BatchFinishSSE42(c1, p1 + common, l1 - common, mask);
+    crcs[i + 2] = BatchFinishSSE42(c2, p2 + common, l2 - common, mask);
+    crcs[i + 3] = BatchFinishSSE42(c3, p3 + common, l3 - common, mask);
+  }
+  for (; i < n; i++) {
+    uint32_t crc = extend(0, src.data(i), src.size(i));
+    crcs[i] = mask ? Mask(crc) : crc;
+  }
+}
+
+#endif  // CRC32C_X86
+
+// Copy a cache friendly piece at a time and checksum it while it is hot
+static uint32_t CopyTable(uint32_t crc, char* dst, const char* src,
+                          size_t len) {
+  const size_t kPiece = 4096;
+  while (len > 0) {
+    size_t n = std::min(len, kPiece);
+    memcpy(dst, src, n);
+    crc = ExtendTable(crc, dst, n);
+    dst += n;
+    src += n;
+    len -= n;
+  }
+  return crc;
+}
+
+bool IsKernelSupported(Kernel kernel) {
+  switch (kernel) {
+    case kAuto:
+    case kTable:
+      return true;
+#ifdef CRC32C_X86
+    case kSSE42:
+      return isSSE42();
+    case kSSE42Pclmul:
+      return isSSE42() && isPCLMULQDQ();
+#endif
+#if defined(HAVE_POWER8) && defined(HAS_ALTIVEC)
+    case kPower8:
+      return isAltiVec();
+#endif
+    default:
+      return false;
+  }
+}
+
+const char* KernelName(Kernel kernel) {
+  switch (kernel) {
+    case kAuto:
+      return "auto";
+    case kTable:
+      return "table";
+    case kSSE42:
+      return "sse4.2";
+    case kSSE42Pclmul:
+      return "sse4.2+pclmul";
+    case kPower8:
+      return "power8";
+  }
+  return "unknown";
+}
+
+static Function KernelFunction(Kernel kernel) {
+  switch (kernel) {
+#ifdef CRC32C_X86
+    case kSSE42:
+      return ExtendSSE42;
+    case kSSE42Pclmul:
+#ifdef NO_THREEWAY_CRC32C
+      return ExtendSSE42;
 #else
-    return ExtendImpl<Fast_CRC32>; // Fast_CRC32 will check HAVE_SSE42 itself
+      return crc32c_3way;
 #endif
+#endif
+#if defined(HAVE_POWER8) && defined(HAS_ALTIVEC)
+    case kPower8:
+      return ExtendPPCImpl;
+#endif
+    default:
+      return ExtendTable;
+  }
+}
+
+// The fastest kernel the host supports
+static Kernel BestKernel() {
+  static const Kernel best = []() {
+    const Kernel order[] = {kSSE42Pclmul, kSSE42, kPower8};
+    for (Kernel k : order) {
+      if (IsKernelSupported(k)) return k;
     }
-    else {  // no runtime PCLMULQDQ support but has SSE42 support
-      return ExtendImpl<Fast_CRC32>;
+    return kTable;
+  }();
+  return best;
+}
+
+// Zero initialized before any dynamic initializer runs, so Extend() works
+// from static constructors of other translation units too
+static std::atomic<Function> chosen_extend(nullptr);
+static std::atomic<int> chosen_kernel(kAuto);
+
+bool SetKernel(Kernel kernel) {
+  if (!IsKernelSupported(kernel)) return false;
+  if (kernel == kAuto) kernel = BestKernel();
+  // the kernel first: whoever sees the new function sees its kernel too
+  chosen_kernel.store(kernel, std::memory_order_release);
+  chosen_extend.store(KernelFunction(kernel), std::memory_order_release);
+  return true;
+}
+
+Kernel CurrentKernel() {
+  // chosen_kernel stays kAuto until SetKernel(): the lazy choice in
+  // Extend() only fills in chosen_extend
+  Kernel kernel =
+      static_cast<Kernel>(chosen_kernel.load(std::memory_order_acquire));
+  return kernel == kAuto ? BestKernel() : kernel;
+}
+
+uint32_t ExtendWith(Kernel kernel, uint32_t crc, const char* buf,
+                    size_t size) {
+  if (kernel == kAuto) kernel = BestKernel();
+  return KernelFunction(kernel)(crc, buf, size);
+}
+
+uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+  Function f = chosen_extend.load(std::memory_order_acquire);
+  if (f == nullptr) {
+    // the lazy choice never replaces a racing SetKernel()
+    Function expected = nullptr;
+    f = KernelFunction(BestKernel());
+    if (!chosen_extend.compare_exchange_strong(expected, f,
+                                               std::memory_order_acq_rel,
+                                               std::memory_order_acquire)) {
+      f = expected;
     }
-  } // end of isSSE42()
-  else {
-    return ExtendImpl<Slow_CRC32>;
   }
-#else  //HAVE_POWER8
-  return isAltiVec() ? ExtendPPCImpl : ExtendImpl<Slow_CRC32>;
+  return f(crc, buf, size);
+}
+
+uint32_t CopyAndExtend(uint32_t crc, char* dst, const char* src,
+                       size_t size) {
+  switch (CurrentKernel()) {
+#ifdef CRC32C_X86
+    case kSSE42:
+      return CopySSE42(crc, dst, src, size);
+    case kSSE42Pclmul:
+      return Copy3way(crc, dst, src, size);
 #endif
+    case kTable:
+      return CopyTable(crc, dst, src, size);
+    default:
+      // no fused kernel, still one pass over the source
+      memcpy(dst, src, size);
+      return Extend(crc, dst, size);
+  }
 }
 
-static Function ChosenExtend = Choose_Extend();
-uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
-  return ChosenExtend(crc, buf, size);
+uint32_t ExtendIovec(uint32_t crc, const struct iovec* iov, int iovcnt) {
+  for (int i = 0; i < iovcnt; i++) {
+    crc = Extend(crc, (const char*)iov[i].iov_base, iov[i].iov_len);
+  }
+  return crc;
+}
+
+uint32_t CopyAndExtendIovec(uint32_t crc, char* dst, const struct iovec* iov,
+                            int iovcnt) {
+  for (int i = 0; i < iovcnt; i++) {
+    crc = CopyAndExtend(crc, dst, (const char*)iov[i].iov_base,
+                        iov[i].iov_len);
+    dst += iov[i].iov_len;
+  }
+  return crc;
+}
+
+namespace {
+
+struct ArraySource {
+  const char* const* ptrs;
+  const size_t* lens;
+  const char* data(size_t i) const { return ptrs[i]; }
+  size_t size(size_t i) const { return lens[i]; }
+};
+
+struct SliceSource {
+  const Slice* slices;
+  const char* data(size_t i) const { return slices[i].data(); }
+  size_t size(size_t i) const { return slices[i].size(); }
+};
+
+template <typename Source>
+void ValueBatchImpl(const Source& src, size_t n, uint32_t* crcs, bool mask) {
+  Kernel kernel = CurrentKernel();
+#ifdef CRC32C_X86
+  if (kernel == kSSE42 || kernel == kSSE42Pclmul) {
+    BatchSSE42(src, n, crcs, mask, KernelFunction(kernel));
+    return;
+  }
+#endif
+  Function extend = KernelFunction(kernel);
+  for (size_t i = 0; i < n; i++) {
+    uint32_t crc = extend(0, src.data(i), src.size(i));
+    crcs[i] = mask ? Mask(crc) : crc;
+  }
+}
+
+}  // namespace
+
+void ValueBatch(const char* const* data, const size_t* lens, size_t n,
+                uint32_t* crcs, bool mask) {
+  ArraySource src = {data, lens};
+  ValueBatchImpl(src, n, crcs, mask);
+}
+
+void ValueBatch(const Slice* data, size_t n, uint32_t* crcs, bool mask) {
+  SliceSource src = {data};
+  ValueBatchImpl(src, n, crcs, mask);
 }
 
 }  // namespace crc32c
@@ -1154,33 +1462,98 @@ uint32_t gf2_multiply(uint32_t x, uint32_t y, uint32_t modulus) {
   }
   return product;
 }
-uint32_t crc32_generic_shift(uint32_t crc, size_t len, uint32_t polynomial) {
-  uint32_t power = polynomial; /* CRC of x^32 */
-
-  /* Shift up to 32 bits in the simple linear way */
-  for (int i = 0; i < 8 * (int)(len & 3); i++)
-    crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+#ifdef CRC32C_X86
+// a * b mod P with one carry-less multiply, the 64 bit product is reduced
+// by the crc32 instruction: crc32(0, lo) is lo * x^32 mod P.
+CRC32C_TARGET_PCLMUL
+static uint32_t crc32c_multiply_clmul(uint32_t a, uint32_t b) {
+  __m128i p = _mm_clmulepi64_si128(_mm_cvtsi32_si128(a), _mm_cvtsi32_si128(b),
+                                   0x00);
+  uint64_t v = static_cast<uint64_t>(_mm_cvtsi128_si64(p)) << 1;
+  return _mm_crc32_u32(0, static_cast<uint32_t>(v)) ^
+         static_cast<uint32_t>(v >> 32);
+}
+#endif
 
-  len >>= 2;
-  if (!len) return crc;
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b) {
+#ifdef CRC32C_X86
+  static const bool has_clmul =
+      crc32c::IsKernelSupported(crc32c::kSSE42Pclmul);
+  if (has_clmul) return crc32c_multiply_clmul(a, b);
+#endif
+  return gf2_multiply(a, b, CRC32C_POLY_LE);
+}
 
-  for (;;) {
-    /* "power" is x^(2^i), modulo the polynomial */
-    if (len & 1) crc = gf2_multiply(crc, power, polynomial);
+// kPow8[k] is x^(8 * 2^k) mod P, the operator that appends 2^k zero bytes,
+// in the same reflected form as the CRC (x^0 is 0x80000000).
+struct Crc32cPowers {
+  uint32_t pow8[64];
+  Crc32cPowers() {
+    pow8[0] = 0x80000000u >> 8;
+    for (int k = 1; k < 64; k++) {
+      pow8[k] = gf2_multiply(pow8[k - 1], pow8[k - 1], CRC32C_POLY_LE);
+    }
+  }
+};
 
-    len >>= 1;
-    if (!len) break;
+static const uint32_t* Crc32cPow8() {
+  static const Crc32cPowers powers;
+  return powers.pow8;
+}
 
-    /* Square power, advancing to x^(2^(i+1)) */
-    power = gf2_multiply(power, power, polynomial);
+uint32_t crc32_generic_shift(uint32_t crc, size_t len, uint32_t polynomial) {
+  if (polynomial != CRC32C_POLY_LE) {
+    // no tables for other polynomials, square as we go
+    uint32_t power = polynomial; /* CRC of x^32 */
+    for (int i = 0; i < 8 * (int)(len & 3); i++)
+      crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+    for (len >>= 2; len; len >>= 1) {
+      if (len & 1) crc = gf2_multiply(crc, power, polynomial);
+      power = gf2_multiply(power, power, polynomial);
+    }
+    return crc;
+  }
+  const uint32_t* pow8 = Crc32cPow8();
+  for (int k = 0; len != 0; k++, len >>= 1) {
+    if (len & 1) crc = crc32c_multiply(crc, pow8[k]);
   }
-
   return crc;
 }
+
 uint32_t Crc32cCombine(uint32_t a, uint32_t b, size_t blen) {
   return crc32_generic_shift(a, blen, CRC32C_POLY_LE) ^ b;
 }
 
+uint32_t ParallelCrc32c(const char* data, size_t n, AsyncWorkerPool* pool,
+                        uint32_t init) {
+  const size_t kMinChunk = 1 << 20;
+  int workers = pool ? pool->WorkerCount() : 1;
+  if (workers <= 1 || n < 2 * kMinChunk) {
+    return crc32c::Extend(init, data, n);
+  }
+  // a few chunks per worker to even out stragglers
+  size_t chunk = std::max(kMinChunk, n / (4 * workers));
+  chunk = (chunk + 4095) & ~static_cast<size_t>(4095);
+  int chunks = static_cast<int>((n + chunk - 1) / chunk);
+
+  std::vector<uint32_t> crcs(chunks);
+  pool->RunSeqTaskAndWait(
+      std::min(workers, chunks), chunks,
+      [&](int seq, std::atomic<int>&) {
+        size_t off = seq * chunk;
+        crcs[seq] = crc32c::Value(data + off, std::min(chunk, n - off));
+      });
+
+  // all chunks but the last have the same length, so one operator
+  // shifts each of them into place
+  uint32_t op = crc32_generic_shift(0x80000000u, chunk, CRC32C_POLY_LE);
+  uint32_t crc = init;
+  for (int i = 0; i + 1 < chunks; i++) {
+    crc = crc32c_multiply(crc, op) ^ crcs[i];
+  }
+  return Crc32cCombine(crc, crcs[chunks - 1], n - (chunks - 1) * chunk);
+}
+
 }  // namespace cutils 
 
 //gzrd_Lib_CPP_Version_ID--start
@@ -11,6 +11,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <string>
 
 #include "slice.h"
@@ -20,6 +21,35 @@ namespace crc32c {
 
 extern std::string IsFastCrc32Supported();
 
+// Implementations of Extend().  The hardware ones are compiled in with
+// function level target attributes and only run when CPUID reports the
+// instructions, so no -msse4.2 build flag is needed.
+enum Kernel {
+  kAuto = 0,     // the fastest one supported by this host
+  kTable,        // portable slicing-by-4 tables
+  kSSE42,        // crc32 instruction on a single stream
+  kSSE42Pclmul,  // crc32 on 3 streams, merged with pclmulqdq
+  kPower8,       // vpmsum on POWER8
+};
+
+// Whether "kernel" can run on this host.  kAuto and kTable always can.
+extern bool IsKernelSupported(Kernel kernel);
+
+extern const char* KernelName(Kernel kernel);
+
+// Make Extend() use "kernel" from now on, kAuto restores the default.
+// Return false and change nothing if the kernel is not supported.
+// Meant for tests and benchmarks.
+extern bool SetKernel(Kernel kernel);
+
+// The kernel Extend() currently uses, never kAuto
+extern Kernel CurrentKernel();
+
+// Extend() with the given kernel.
+// REQUIRES: IsKernelSupported(kernel)
+extern uint32_t ExtendWith(Kernel kernel, uint32_t init_crc, const char* data,
+                           size_t n);
+
 // Return the crc32c of concat(A, data[0,n-1]) where init_crc is the
 // crc32c of some string A.  Extend() is often used to maintain the
 // crc32c of a stream of data.
@@ -28,6 +58,20 @@ extern uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) { return Extend(0, data, n); }
 
+// memcpy(dst, src, n) and return Extend(init_crc, src, n), reading the
+// source only once.  The ranges must not overlap.
+extern uint32_t CopyAndExtend(uint32_t init_crc, char* dst, const char* src,
+                              size_t n);
+
+// Extend() over the concatenation of iov[0,iovcnt-1]
+extern uint32_t ExtendIovec(uint32_t init_crc, const struct iovec* iov,
+                            int iovcnt);
+
+// Gather iov[0,iovcnt-1] into dst and checksum it in the same pass.
+// dst must have room for the sum of the iov_len.
+extern uint32_t CopyAndExtendIovec(uint32_t init_crc, char* dst,
+                                   const struct iovec* iov, int iovcnt);
+
 static const uint32_t kMaskDelta = 0xa282ead8ul;
 
 // Return a masked representation of crc.
@@ -46,6 +90,15 @@ inline uint32_t Unmask(uint32_t masked_crc) {
   return ((rot >> 17) | (rot << 15));
 }
 
+// crcs[i] = Value(data[i], lens[i]) for n independent records, masked when
+// "mask".  With the crc32 instruction the records are checksummed four at
+// a time on interleaved chains, which is much faster than calling Value()
+// in a loop when they are short.
+extern void ValueBatch(const char* const* data, const size_t* lens, size_t n,
+                       uint32_t* crcs, bool mask = false);
+extern void ValueBatch(const Slice* data, size_t n, uint32_t* crcs,
+                       bool mask = false);
+
 }  // namespace crc32c
 
 inline uint32_t Crc32c(const char* data, size_t n, uint32_t init = 0) {
@@ -56,6 +109,44 @@ inline uint32_t Crc32c(cutils::Slice data) {
   return crc32c::Extend(0, data.data(), data.size());
 }
 
+inline void Crc32cBatch(const char* const* data, const size_t* lens, size_t n,
+                        uint32_t* crcs, bool mask = false) {
+  crc32c::ValueBatch(data, lens, n, crcs, mask);
+}
+
+inline void Crc32cBatch(const Slice* data, size_t n, uint32_t* crcs,
+                        bool mask = false) {
+  crc32c::ValueBatch(data, n, crcs, mask);
+}
+
+inline uint32_t CopyAndCrc32c(char* dst, const char* src, size_t n,
+                              uint32_t init = 0) {
+  return crc32c::CopyAndExtend(init, dst, src, n);
+}
+
+inline uint32_t Crc32cIovec(const struct iovec* iov, int iovcnt,
+                            uint32_t init = 0) {
+  return crc32c::ExtendIovec(init, iov, iovcnt);
+}
+
+inline uint32_t CopyAndCrc32cIovec(char* dst, const struct iovec* iov,
+                                   int iovcnt, uint32_t init = 0) {
+  return crc32c::CopyAndExtendIovec(init, dst, iov, iovcnt);
+}
+
+// Given a = crc32c(A) and b = crc32c(B), return crc32c(concat(A, B)).
+// Costs one GF(2) multiply per set bit of blen, from precomputed
+// x^(8*2^k) mod P.
 uint32_t Crc32cCombine(uint32_t a, uint32_t b, size_t blen);
 
+class AsyncWorkerPool;
+
+// crc32c::Extend(init, data, n), computed over chunks on the workers of
+// "pool" and merged with Crc32cCombine.  Small inputs or a null pool are
+// done inline.  Blocks until done, so it must not be called from one of
+// the pool's own workers: with every worker waiting there is nobody left
+// to run the chunks.
+uint32_t ParallelCrc32c(const char* data, size_t n, AsyncWorkerPool* pool,
+                        uint32_t init = 0);
+
 }  // namespace cutils
@@ -45,13 +45,16 @@ int GetPid();
 int GetTid();
 
 inline bool SleepWithStop(int sec, bool& stop) {
-    for (int i = 0; i < sec && !stop; ++i) sleep(1);
-    return stop;
+    for (int i = 0; i < sec && !IsStopped(stop); ++i) sleep(1);
+    return IsStopped(stop);
 }
 
 inline bool SleepWithStop(int sec, int& stop) {
-    for (int i = 0; i < sec && !stop; ++i) sleep(1);
-    return stop;
+    for (int i = 0; i < sec && !__atomic_load_n(&stop, __ATOMIC_ACQUIRE);
+         ++i) {
+        sleep(1);
+    }
+    return __atomic_load_n(&stop, __ATOMIC_ACQUIRE);
 }
 
 template <typename F>
@@ -0,0 +1,509 @@
+#include "dir_scan.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "async_worker.h"
+#include "freq_ctrl.h"
+
+namespace cutils {
+
+const size_t DirReader::kDefaultBufferSize;
+
+DirReader::DirReader(size_t buffer_size)
+    : fd_(-1), buf_size_(std::max<size_t>(buffer_size, 4096)),
+      pos_(0), end_(0) {
+    buf_ = (char*)malloc(buf_size_);
+    assert(buf_ != nullptr);
+}
+
+DirReader::~DirReader() {
+    Close();
+    free(buf_);
+}
+
+int DirReader::OpenAt(int dir_fd, const std::string& name, bool follow) {
+    Close();
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (follow ? 0 : O_NOFOLLOW);
+    fd_ = openat(dir_fd, name.c_str(), flags);
+    if (fd_ < 0) return -errno;
+    return 0;
+}
+
+void DirReader::Close() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+    pos_ = end_ = 0;
+}
+
+int DirReader::Next(DirEntry* entry) {
+    if (fd_ < 0) return -EBADF;
+    while (true) {
+        if (pos_ >= end_) {
+            // glibc's struct dirent64 has the kernel's linux_dirent64 layout
+            long n = syscall(SYS_getdents64, fd_, buf_, buf_size_);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return -errno;
+            }
+            if (n == 0) return 0;
+            pos_ = 0;
+            end_ = n;
+        }
+        const struct dirent64* d = (const struct dirent64*)(buf_ + pos_);
+        pos_ += d->d_reclen;
+        const char* name = d->d_name;
+        if (name[0] == '.' &&
+            (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        entry->name = Slice(name, strlen(name));
+        entry->path = entry->name;
+        entry->type = d->d_type;
+        entry->ino = d->d_ino;
+        entry->depth = 0;
+        entry->dir_fd = fd_;
+        return 1;
+    }
+}
+
+bool NameMatcher::Match(const Slice& name) const {
+    switch (kind_) {
+        case kPrefix:
+            return name.starts_with(pattern_);
+        case kSuffix:
+            return name.size() >= pattern_.size() &&
+                   memcmp(name.data() + name.size() - pattern_.size(),
+                          pattern_.data(), pattern_.size()) == 0;
+        case kSubstring:
+            return memmem(name.data(), name.size(),
+                          pattern_.data(), pattern_.size()) != nullptr;
+        case kGlob:
+            return fnmatch(pattern_.c_str(), name.data(), FNM_PERIOD) == 0;
+        case kAny:
+        default:
+            return true;
+    }
+}
+
+namespace {
+
+unsigned char ModeToType(mode_t mode) {
+    if (S_ISREG(mode)) return DT_REG;
+    if (S_ISDIR(mode)) return DT_DIR;
+    if (S_ISLNK(mode)) return DT_LNK;
+    if (S_ISFIFO(mode)) return DT_FIFO;
+    if (S_ISSOCK(mode)) return DT_SOCK;
+    if (S_ISCHR(mode)) return DT_CHR;
+    if (S_ISBLK(mode)) return DT_BLK;
+    return DT_UNKNOWN;
+}
+
+// fstatat() the entry if the file system did not give its type
+void ResolveType(DirEntry* entry) {
+    if (entry->type != DT_UNKNOWN) return;
+    struct stat st;
+    if (fstatat(entry->dir_fd, entry->name.data(), &st,
+                AT_SYMLINK_NOFOLLOW) == 0) {
+        entry->type = ModeToType(st.st_mode);
+    }
+}
+
+// Directories still to process, shared by the calling thread and the
+// helper tasks.  The work is over once the stack is empty and nobody is
+// busy with a directory, which could push more; or at the first failure.
+template <typename Item>
+class WorkStack {
+public:
+    std::atomic<bool> stop{false};
+
+    void Push(Item item) {
+        std::lock_guard<std::mutex> guard(mu_);
+        items_.push_back(std::move(item));
+    }
+
+    // Run work(item, &more) until the work is over, pushing "more"
+    // after each item.  Helpers that start after Finish() return at once.
+    template <typename Work>
+    void Drain(Work work) {
+        std::vector<Item> more;
+        std::unique_lock<std::mutex> lock(mu_);
+        while (true) {
+            while (!done_ && !stop && items_.empty() && busy_ > 0) {
+                cv_.wait(lock);
+            }
+            if (done_ || stop || items_.empty()) break;
+            Item item = std::move(items_.back());
+            items_.pop_back();
+            ++busy_;
+            lock.unlock();
+
+            more.clear();
+            int ret = work(item, &more);
+
+            lock.lock();
+            --busy_;
+            if (ret != 0 && !stop) {
+                result_ = ret;
+                stop = true;
+            }
+            for (auto& m : more) items_.push_back(std::move(m));
+            if (!more.empty() || busy_ == 0 || stop) cv_.notify_all();
+        }
+    }
+
+    // Whether Finish() was called: helpers check it before setting up,
+    // the caller's objects may be gone by then
+    bool Done() {
+        std::lock_guard<std::mutex> guard(mu_);
+        return done_;
+    }
+
+    // Wait for the busy ones and return the first failure, or 0.  Items
+    // left after a failure are dropped here, not with the last helper.
+    int Finish() {
+        std::unique_lock<std::mutex> lock(mu_);
+        while (busy_ > 0) cv_.wait(lock);
+        done_ = true;
+        items_.clear();
+        cv_.notify_all();
+        return result_;
+    }
+
+private:
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::vector<Item> items_;
+    int busy_ = 0;
+    bool done_ = false;
+    int result_ = 0;
+};
+
+// Run "drain" on the calling thread and on helper tasks of "pool", and
+// wait for the stack's work to be over
+template <typename Item, typename Drain>
+int RunOnPool(WorkStack<Item>* stack, AsyncWorkerPool* pool, int parallelism,
+              Drain drain) {
+    if (pool != nullptr) {
+        int helpers = parallelism > 0 ? parallelism : pool->WorkerCount();
+        for (int i = 0; i < helpers; ++i) pool->AddTask(drain);
+    }
+    drain();
+    return stack->Finish();
+}
+
+struct PendingDir {
+    std::string path;
+    int depth;
+};
+
+// Copies of the options and callback: helper tasks may outlive the call
+struct ScanState {
+    ScanState(const ScanOptions& o, const ScanCallback& cb)
+        : options(o), callback(cb) {}
+
+    const ScanOptions options;
+    const ScanCallback callback;
+    int root_fd = -1;
+    WorkStack<PendingDir> dirs;
+
+    std::mutex visited_mu;
+    std::set<std::pair<dev_t, ino_t>> visited;
+};
+
+// Scan one directory, calling back for its entries and collecting the
+// subdirectories to descend into
+int ScanOne(ScanState* s, DirReader* reader, const PendingDir& dir,
+            std::vector<PendingDir>* subdirs) {
+    const ScanOptions& options = s->options;
+    bool is_root = dir.path.empty();
+    int ret = reader->OpenAt(s->root_fd, is_root ? "." : dir.path,
+                             options.follow_symlinks);
+    if (ret != 0) {
+        if (!is_root && (ret == -ENOENT || options.skip_errors)) return 0;
+        return ret;
+    }
+    if (options.follow_symlinks) {
+        struct stat st;
+        if (fstat(reader->fd(), &st) != 0) return -errno;
+        std::lock_guard<std::mutex> guard(s->visited_mu);
+        if (!s->visited.insert(std::make_pair(st.st_dev, st.st_ino)).second) {
+            return 0;
+        }
+    }
+
+    bool descend = options.recursive &&
+                   (options.max_depth < 0 || dir.depth < options.max_depth);
+    std::string path = dir.path;
+    if (!is_root) path.push_back('/');
+    size_t base = path.size();
+    DirEntry entry;
+    while ((ret = reader->Next(&entry)) > 0) {
+        if (s->dirs.stop.load(std::memory_order_relaxed)) break;
+        if (!options.include_hidden && entry.name[0] == '.') continue;
+
+        if (options.resolve_unknown || descend) ResolveType(&entry);
+        bool is_dir = entry.type == DT_DIR;
+        if (entry.type == DT_LNK && options.follow_symlinks) {
+            struct stat st;
+            is_dir = fstatat(entry.dir_fd, entry.name.data(), &st, 0) == 0 &&
+                     S_ISDIR(st.st_mode);
+        }
+
+        path.resize(base);
+        path.append(entry.name.data(), entry.name.size());
+        entry.path = path;
+        entry.depth = dir.depth;
+        if ((!is_dir || options.include_dirs) &&
+            options.matcher.Match(entry.name) && !s->callback(entry)) {
+            return 1;
+        }
+        if (is_dir && descend) {
+            subdirs->push_back(PendingDir{path, dir.depth + 1});
+        }
+    }
+    return ret;
+}
+
+// A directory being removed.  "pending" counts its own pass over the
+// entries and its subdirectories not yet removed; whoever drops it to 0
+// removes the directory and goes on with the parent.
+//
+// Every directory is opened, and its entries removed, relative to the fd
+// of its parent, never by a path: a directory swapped for a symlink while
+// it waits cannot lead out of the tree.  The fd stays open from the pass
+// until the directory is removed, for its subdirectories to use.  Taking
+// work last in first out, that is the directories along the paths being
+// worked on, about depth x threads of them.
+struct RemoveNode {
+    ~RemoveNode() {
+        if (fd >= 0) close(fd);
+    }
+
+    std::string name;   // in the parent, empty for the root
+    std::shared_ptr<RemoveNode> parent;
+    int fd = -1;
+    std::atomic<int> pending{1};
+    int passes = 0;
+};
+
+typedef std::shared_ptr<RemoveNode> RemoveNodePtr;
+
+// Entries created while a directory is emptied make its rmdir fail; it is
+// emptied again a few times before giving up
+const int kMaxRemovePasses = 3;
+
+// Copies of the options: helper tasks may outlive the call
+struct RemoveState {
+    explicit RemoveState(const RemoveOptions& o) : options(o) {}
+
+    const RemoveOptions options;
+    WorkStack<RemoveNodePtr> dirs;
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> removed_dirs{0};
+    std::atomic<uint64_t> removed{0};
+
+    RemoveStats Stats() const {
+        RemoveStats stats;
+        stats.files = files.load(std::memory_order_relaxed);
+        stats.dirs = removed_dirs.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void Throttle() {
+        if (options.limiter == nullptr) return;
+        uint64_t wait_ns = options.limiter->Reserve(1);
+        if (wait_ns > 0) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(wait_ns));
+        }
+    }
+
+    void Count(bool dir) {
+        (dir ? removed_dirs : files).fetch_add(1, std::memory_order_relaxed);
+        uint64_t n = removed.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (options.progress && options.progress_every > 0 &&
+            n % options.progress_every == 0) {
+            options.progress(Stats());
+        }
+    }
+
+    // unlinkat() a non-directory, 0 or -errno
+    int Unlink(int dir_fd, const char* name) {
+        Throttle();
+        if (unlinkat(dir_fd, name, 0) == 0) {
+            Count(false);
+        } else if (errno != ENOENT) {
+            return -errno;
+        }
+        return 0;
+    }
+};
+
+// One pass of "node", or one of its subdirectories, is done: remove the
+// directories it completes, bottom up.  The root is left to the caller.
+int ReleaseNode(RemoveState* s, RemoveNodePtr node,
+                std::vector<RemoveNodePtr>* again) {
+    while (node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (node->parent == nullptr) return 0;
+        int parent_fd = node->parent->fd;
+        const char* name = node->name.c_str();
+        s->Throttle();
+        if (unlinkat(parent_fd, name, AT_REMOVEDIR) == 0) {
+            s->Count(true);
+        } else if (errno == ENOTEMPTY && ++node->passes < kMaxRemovePasses) {
+            node->pending.store(1, std::memory_order_relaxed);
+            again->push_back(std::move(node));
+            return 0;
+        } else if (errno == ENOTDIR) {
+            // the directory was moved away and something else put in its
+            // place: remove that, the directory (now empty) is elsewhere
+            int ret = s->Unlink(parent_fd, name);
+            if (ret != 0) return ret;
+        } else if (errno != ENOENT) {
+            return -errno;
+        }
+        close(node->fd);
+        node->fd = -1;
+        node = node->parent;
+    }
+    return 0;
+}
+
+// Unlink the entries of one directory and collect its subdirectories
+int RemoveEntries(RemoveState* s, DirReader* reader, RemoveNodePtr node,
+                  std::vector<RemoveNodePtr>* subdirs) {
+    if (node->fd < 0) {
+        int parent_fd = node->parent->fd;
+        const char* name = node->name.c_str();
+        node->fd = openat(parent_fd, name,
+                          O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (node->fd < 0) {
+            if (errno == ELOOP || errno == ENOTDIR) {
+                // no longer a directory: remove what is there instead
+                int ret = s->Unlink(parent_fd, name);
+                if (ret != 0) return ret;
+            } else if (errno != ENOENT) {
+                return -errno;
+            }
+            return ReleaseNode(s, node->parent, subdirs);
+        }
+    }
+    int ret = reader->OpenAt(node->fd, ".");
+    if (ret != 0) return ret;
+
+    DirEntry entry;
+    while ((ret = reader->Next(&entry)) > 0) {
+        if (s->dirs.stop.load(std::memory_order_relaxed)) return 0;
+        ResolveType(&entry);
+        if (entry.type == DT_DIR) {
+            RemoveNodePtr child = std::make_shared<RemoveNode>();
+            child->name.assign(entry.name.data(), entry.name.size());
+            child->parent = node;
+            node->pending.fetch_add(1, std::memory_order_relaxed);
+            subdirs->push_back(std::move(child));
+            continue;
+        }
+        ret = s->Unlink(entry.dir_fd, entry.name.data());
+        if (ret != 0) return ret;
+    }
+    reader->Close();
+    if (ret != 0) return ret;
+    return ReleaseNode(s, node, subdirs);
+}
+
+} // namespace
+
+int ScanDir(const std::string& dir, const ScanOptions& options,
+            const ScanCallback& callback) {
+    std::shared_ptr<ScanState> s =
+        std::make_shared<ScanState>(options, callback);
+    s->root_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (s->root_fd < 0) return -errno;
+    s->dirs.Push(PendingDir{std::string(), 0});
+
+    auto drain = [s]() {
+        if (s->dirs.Done()) return;
+        DirReader reader(s->options.buffer_size);
+        s->dirs.Drain([&](const PendingDir& dir,
+                          std::vector<PendingDir>* subdirs) {
+            int ret = ScanOne(s.get(), &reader, dir, subdirs);
+            reader.Close();
+            return ret;
+        });
+    };
+    int ret = RunOnPool(&s->dirs, options.recursive ? options.pool : nullptr,
+                        options.parallelism, drain);
+    close(s->root_fd);
+    return ret;
+}
+
+int RemoveTree(const std::string& path, const RemoveOptions& options,
+               RemoveStats* stats) {
+    std::shared_ptr<RemoveState> s = std::make_shared<RemoveState>(options);
+    int ret = 0;
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        // rm -rf of nothing is done, emptying a missing directory is not
+        ret = errno == ENOENT && !options.keep_root ? 0 : -errno;
+    } else if (!S_ISDIR(st.st_mode)) {
+        ret = options.keep_root ? -ENOTDIR : s->Unlink(AT_FDCWD, path.c_str());
+    } else {
+        RemoveNodePtr root = std::make_shared<RemoveNode>();
+        root->fd = open(path.c_str(),
+                        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (root->fd < 0) return -errno;
+        s->dirs.Push(root);
+
+        auto drain = [s]() {
+            if (s->dirs.Done()) return;
+            DirReader reader(s->options.buffer_size);
+            s->dirs.Drain([&](const RemoveNodePtr& node,
+                              std::vector<RemoveNodePtr>* subdirs) {
+                int ret = RemoveEntries(s.get(), &reader, node, subdirs);
+                reader.Close();
+                return ret;
+            });
+        };
+        ret = RunOnPool(&s->dirs, options.pool, options.parallelism, drain);
+        // the root is empty once its pass and all subdirectories are done
+        if (ret == 0 && root->pending.load() != 0) ret = -ENOTEMPTY;
+        root.reset();
+        if (ret == 0 && !options.keep_root) {
+            s->Throttle();
+            if (rmdir(path.c_str()) == 0) {
+                s->Count(true);
+            } else {
+                ret = -errno;
+            }
+        }
+    }
+    if (options.progress) options.progress(s->Stats());
+    if (stats != nullptr) *stats = s->Stats();
+    return ret;
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+
+#include "slice.h"
+
+namespace cutils {
+
+class AsyncWorkerPool;
+class TokenBucket;
+
+// One entry of a directory.  The Slices point into the reader's buffers and
+// are only valid until the next entry.
+struct DirEntry {
+    Slice name;           // base name, NUL terminated
+    Slice path;           // relative to the scan root, "sub/dir/name"
+    unsigned char type;   // DT_REG, DT_DIR, DT_LNK, ... or DT_UNKNOWN
+    uint64_t ino;
+    int depth;            // 0 for the entries of the root
+    int dir_fd;           // the parent directory, for fstatat / openat
+};
+
+// Stream the entries of one directory with getdents64(2), many entries per
+// system call, without "." and "..".  d_type comes from the file system
+// and is DT_UNKNOWN on some of them (the caller fstatat()s dir_fd then).
+//
+//   DirReader reader;
+//   DirEntry entry;
+//   if (reader.Open(dir) == 0) {
+//       while (reader.Next(&entry) > 0) Use(entry.name);
+//   }
+class DirReader {
+public:
+    static const size_t kDefaultBufferSize = 256 << 10;
+
+    explicit DirReader(size_t buffer_size = kDefaultBufferSize);
+    ~DirReader();
+
+    DirReader(const DirReader&) = delete;
+    DirReader& operator=(const DirReader&) = delete;
+
+    // Return 0 or -errno.  OpenAt() opens "name" relative to "dir_fd" (or
+    // the cwd with AT_FDCWD), with O_NOFOLLOW unless "follow".
+    int Open(const std::string& path) { return OpenAt(AT_FDCWD, path, true); }
+    int OpenAt(int dir_fd, const std::string& name, bool follow = false);
+    void Close();
+
+    // Return 1 and fill "name", "type", "ino" and "dir_fd" of *entry, 0 at
+    // the end of the directory, or -errno
+    int Next(DirEntry* entry);
+
+    int fd() const { return fd_; }
+
+private:
+    int fd_;
+    char* buf_;
+    size_t buf_size_;
+    size_t pos_;
+    size_t end_;
+};
+
+// Match entry names by prefix, suffix, substring or fnmatch(3) glob
+class NameMatcher {
+public:
+    enum Kind {
+        kAny = 0,
+        kPrefix = 1,
+        kSuffix = 2,
+        kSubstring = 3,
+        kGlob = 4,
+    };
+
+    NameMatcher() : kind_(kAny) {}
+    NameMatcher(Kind kind, const std::string& pattern)
+        : kind_(pattern.empty() ? kAny : kind), pattern_(pattern) {}
+
+    static NameMatcher Any() { return NameMatcher(); }
+    static NameMatcher Prefix(const std::string& s) {
+        return NameMatcher(kPrefix, s);
+    }
+    static NameMatcher Suffix(const std::string& s) {
+        return NameMatcher(kSuffix, s);
+    }
+    static NameMatcher Substring(const std::string& s) {
+        return NameMatcher(kSubstring, s);
+    }
+    // "*.seg", "log-[0-9]*"; a leading '.' is only matched explicitly
+    static NameMatcher Glob(const std::string& s) {
+        return NameMatcher(kGlob, s);
+    }
+
+    // "name" must be NUL terminated for globs, as DirEntry::name is
+    bool Match(const Slice& name) const;
+
+private:
+    Kind kind_;
+    std::string pattern_;
+};
+
+struct ScanOptions {
+    // descend into subdirectories, at most max_depth levels below the
+    // root when max_depth >= 0
+    bool recursive = false;
+    int max_depth = -1;
+
+    // which entries reach the callback: those whose name "matcher"
+    // accepts, directories only with include_dirs.  Directories are
+    // descended into whether they match or not.
+    NameMatcher matcher;
+    bool include_dirs = false;
+    bool include_hidden = true;
+
+    // descend into symlinks to directories, each directory once
+    bool follow_symlinks = false;
+
+    // fstatat() DT_UNKNOWN entries so that the callback always sees a
+    // type; otherwise only recursive scans do, to find the directories
+    bool resolve_unknown = true;
+
+    // skip subdirectories that cannot be read instead of failing the scan;
+    // ones deleted while scanning are always skipped
+    bool skip_errors = false;
+
+    // scan subdirectories in parallel on the workers of "pool" as well as
+    // on the calling thread, which must not be one of them
+    AsyncWorkerPool* pool = nullptr;
+    int parallelism = 0;  // helper tasks, 0 for one per worker
+
+    size_t buffer_size = DirReader::kDefaultBufferSize;
+};
+
+// Called for each entry, concurrently from several threads with a pool.
+// Return false to stop the scan.
+using ScanCallback = std::function<bool(const DirEntry&)>;
+
+// Stream the entries under "dir" to "callback" in no particular order.
+// Return 0, 1 if the callback stopped the scan, or -errno of the first
+// failure.
+int ScanDir(const std::string& dir, const ScanOptions& options,
+            const ScanCallback& callback);
+
+struct RemoveStats {
+    uint64_t files = 0;   // everything but directories
+    uint64_t dirs = 0;
+};
+
+struct RemoveOptions {
+    // empty the directory but leave it in place
+    bool keep_root = false;
+
+    // remove subtrees in parallel on the workers of "pool" as well as on
+    // the calling thread, which must not be one of them
+    AsyncWorkerPool* pool = nullptr;
+    int parallelism = 0;  // helper tasks, 0 for one per worker
+
+    // one token per entry removed, waited for when short, so that a
+    // background cleanup leaves the disk to foreground I/O
+    TokenBucket* limiter = nullptr;
+
+    // called every progress_every entries removed, from whichever thread
+    // removed the last of them, possibly concurrently
+    std::function<void(const RemoveStats&)> progress;
+    uint64_t progress_every = 100000;
+
+    size_t buffer_size = DirReader::kDefaultBufferSize;
+};
+
+// "rm -rf path": unlinkat() every entry below "path" relative to the fd of
+// its directory, using d_type instead of a stat per entry, then the
+// directories bottom up and "path" itself.  Subdirectories are opened
+// with openat(O_NOFOLLOW) from their parent's fd, so symlinks are removed,
+// never followed, even one swapped in for a directory during the removal.
+// A missing "path" is not an error, except with keep_root (-ENOENT).
+// Return 0 or -errno of the first failure, after which the rest is left in
+// place.
+int RemoveTree(const std::string& path, const RemoveOptions& options,
+               RemoveStats* stats = nullptr);
+
+} // namespace cutils
@@ -0,0 +1,47 @@
+#include "distribution.h"
+
+#include <cassert>
+
+namespace cutils {
+
+constexpr double ZipfianDistribution::kYcsbTheta;
+
+ZipfianDistribution::ZipfianDistribution(uint64_t items, double theta,
+                                         double zeta)
+    : items_(items), theta_(theta) {
+    assert(items > 0);
+    assert(theta > 0 && theta != 1);
+    zetan_ = zeta > 0 ? zeta : Zeta(items, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    // with 2 items or fewer Next() returns before using eta
+    eta_ = items > 2 ? (1 - std::pow(2.0 / items, 1 - theta)) /
+                       (1 - Zeta(2, theta) / zetan_)
+                     : 0;
+    threshold_ = 1 + std::pow(0.5, theta);
+}
+
+double ZipfianDistribution::Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; ++i) {
+        sum += 1 / std::pow((double)i, theta);
+    }
+    return sum;
+}
+
+void ExponentialDistribution::Fill(Xoshiro256ppX4& gen, double* out,
+                                   size_t n) const {
+    gen.FillDouble(out, n);
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = -mean_ * std::log(1.0 - out[i]);
+    }
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
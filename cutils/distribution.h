@@ -0,0 +1,225 @@
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+
+#include "random.h"
+
+namespace cutils {
+
+// Samplers for benchmark workloads.  Each takes its randomness from any
+// generator of random.h (Xoshiro256pp, WyRand, Pcg64, ThreadRand()), so
+// one generator can feed several distributions:
+//
+//   ZipfianDistribution zipf(1000000);
+//   uint64_t key = zipf.Next(ThreadRand());
+//
+// Fill(gen, out, n) fills an array.
+
+class UniformDistribution {
+public:
+    // [lo, hi]
+    UniformDistribution(uint64_t lo, uint64_t hi) : lo_(lo), n_(hi - lo + 1) {}
+
+    template <typename Gen>
+    uint64_t Next(Gen& gen) const { return lo_ + gen.Uniform(n_); }
+
+    template <typename Gen>
+    void Fill(Gen& gen, uint64_t* out, size_t n) const {
+        for (size_t i = 0; i < n; ++i) out[i] = Next(gen);
+    }
+
+private:
+    uint64_t lo_;
+    uint64_t n_;
+};
+
+// Zipfian over [0, items) as YCSB's ZipfianGenerator (Gray et al., "Quickly
+// generating billion-record synthetic databases"): item 0 is the most
+// popular, P(i) ~ 1 / (i + 1)^theta.  The constructor sums zeta(items,
+// theta) in O(items), about a second per 10^8 items; pass a precomputed
+// zeta to skip that.
+class ZipfianDistribution {
+public:
+    static constexpr double kYcsbTheta = 0.99;
+
+    explicit ZipfianDistribution(uint64_t items, double theta = kYcsbTheta,
+                                 double zeta = 0);
+
+    template <typename Gen>
+    uint64_t Next(Gen& gen) const {
+        double u = gen.NextDouble();
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < threshold_) return 1;
+        uint64_t v = items_ * std::pow(eta_ * u - eta_ + 1, alpha_);
+        return v < items_ ? v : items_ - 1;
+    }
+
+    template <typename Gen>
+    void Fill(Gen& gen, uint64_t* out, size_t n) const {
+        for (size_t i = 0; i < n; ++i) out[i] = Next(gen);
+    }
+
+    uint64_t items() const { return items_; }
+    double theta() const { return theta_; }
+    double zeta() const { return zetan_; }
+
+    // sum of 1 / i^theta for i in [1, n]
+    static double Zeta(uint64_t n, double theta);
+
+private:
+    uint64_t items_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+    double threshold_;
+};
+
+// Zipfian popularity with the popular items spread over [0, items) by a
+// hash, as YCSB's ScrambledZipfianGenerator, so hot keys are not
+// clustered at the start of the key space
+class ScrambledZipfianDistribution {
+public:
+    explicit ScrambledZipfianDistribution(
+            uint64_t items, double theta = ZipfianDistribution::kYcsbTheta,
+            double zeta = 0)
+        : zipf_(items, theta, zeta) {}
+
+    template <typename Gen>
+    uint64_t Next(Gen& gen) const {
+        return Fnv1a64(zipf_.Next(gen)) % zipf_.items();
+    }
+
+    template <typename Gen>
+    void Fill(Gen& gen, uint64_t* out, size_t n) const {
+        for (size_t i = 0; i < n; ++i) out[i] = Next(gen);
+    }
+
+    // FNV-1a over the 8 bytes of v, little endian
+    static uint64_t Fnv1a64(uint64_t v) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (int i = 0; i < 8; ++i) {
+            h ^= (v >> (i * 8)) & 0xff;
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+private:
+    ZipfianDistribution zipf_;
+};
+
+// Exponential with the given mean (1 / lambda), e.g. Poisson arrival gaps
+class ExponentialDistribution {
+public:
+    explicit ExponentialDistribution(double mean) : mean_(mean) {}
+
+    template <typename Gen>
+    double Next(Gen& gen) const {
+        return -mean_ * std::log(1.0 - gen.NextDouble());
+    }
+
+    template <typename Gen>
+    void Fill(Gen& gen, double* out, size_t n) const {
+        for (size_t i = 0; i < n; ++i) out[i] = Next(gen);
+    }
+
+    // From a block of uniforms, for large n
+    void Fill(Xoshiro256ppX4& gen, double* out, size_t n) const;
+
+private:
+    double mean_;
+};
+
+// Normal by the Marsaglia polar method.  Values come in pairs, the
+// second is kept for the next call, so Next() is not const.
+class NormalDistribution {
+public:
+    NormalDistribution(double mean, double stddev)
+        : mean_(mean), stddev_(stddev), has_spare_(false), spare_(0) {}
+
+    template <typename Gen>
+    double Next(Gen& gen) {
+        if (has_spare_) {
+            has_spare_ = false;
+            return mean_ + stddev_ * spare_;
+        }
+        double u, v, s;
+        do {
+            u = gen.NextDouble() * 2 - 1;
+            v = gen.NextDouble() * 2 - 1;
+            s = u * u + v * v;
+        } while (s >= 1 || s == 0);
+        double f = std::sqrt(-2 * std::log(s) / s);
+        spare_ = v * f;
+        has_spare_ = true;
+        return mean_ + stddev_ * u * f;
+    }
+
+    template <typename Gen>
+    void Fill(Gen& gen, double* out, size_t n) {
+        for (size_t i = 0; i < n; ++i) out[i] = Next(gen);
+    }
+
+private:
+    double mean_;
+    double stddev_;
+    bool has_spare_;
+    double spare_;
+};
+
+// Uniform sample of k items from a stream of unknown length, by Li's
+// Algorithm L: after the reservoir fills, the number of items to skip
+// before the next replacement is drawn directly, so Add() of a skipped
+// item is a compare and the generator is used O(k log(n/k)) times.
+template <typename T>
+class ReservoirSampler {
+public:
+    explicit ReservoirSampler(size_t k, uint64_t seed = 0)
+        : k_(k), seen_(0), next_(k > 0 ? k - 1 : ~0ULL), w_(1), rand_(seed) {
+        samples_.reserve(k);
+        if (k_ > 0) Advance();
+    }
+
+    void Add(const T& item) {
+        if (seen_ < k_) {
+            samples_.push_back(item);
+        } else if (seen_ == next_) {
+            samples_[rand_.Uniform(k_)] = item;
+            Advance();
+        }
+        ++seen_;
+    }
+
+    const std::vector<T>& samples() const { return samples_; }
+    uint64_t seen() const { return seen_; }
+
+private:
+    // Draw the index of the next item to go into the reservoir
+    void Advance() {
+        w_ *= std::exp(std::log(Open01()) / k_);
+        double skip = std::floor(std::log(Open01()) / std::log1p(-w_));
+        next_ += (skip < 1e18 ? (uint64_t)skip : (uint64_t)1e18) + 1;
+    }
+
+    // uniform in (0, 1)
+    double Open01() {
+        double u;
+        do {
+            u = rand_.NextDouble();
+        } while (u == 0);
+        return u;
+    }
+
+    size_t k_;
+    uint64_t seen_;
+    uint64_t next_; // index of the next item to replace one in the sample
+    double w_;
+    Xoshiro256pp rand_;
+    std::vector<T> samples_;
+};
+
+} // namespace cutils
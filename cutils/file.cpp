@@ -1,11 +1,12 @@
 #include "file.h"
 
-#include <cstring>
-#include <dirent.h>
+#include <cerrno>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "dir_scan.h"
+
 namespace cutils {
 
 std::string ConcatePath(const std::string& path, const std::string& tail) {
@@ -24,22 +25,15 @@ int ScanFiles(
         const std::string& dir, 
         const std::string& pattern, 
         std::vector<std::string>& files) {
-    DIR* pDir = NULL;
-    if (!(pDir = opendir(dir.c_str()))) {
-        return -1;
-    }
-
-    struct dirent* pDirEnt = nullptr;
-    while (pDirEnt = readdir(pDir)) {
-        const char* fn = pDirEnt->d_name;
-        if (strcmp(fn, ".") == 0 || strcmp(fn, "..") == 0) continue;
-        if (pattern.empty() || strstr(fn, pattern.c_str())) {
-            files.push_back(fn);
-        }
-    }
-
-    closedir(pDir);
-    return 0;
+    ScanOptions options;
+    options.matcher = NameMatcher::Substring(pattern);
+    options.include_dirs = true;
+    options.resolve_unknown = false;
+    int ret = ScanDir(dir, options, [&files](const DirEntry& entry) {
+        files.push_back(entry.name.ToString());
+        return true;
+    });
+    return ret == 0 ? 0 : -1;
 }
 
 int Access(const std::string& fn) {
@@ -70,70 +64,26 @@ size_t FileSize(const std::string& fn) {
 }
 
 int EmptyDirectory(const std::string& dir) {
-    DIR * handle = opendir(dir.c_str());
-    if (nullptr == handle) {
-        return -__LINE__;
-    }
-
-    char buffer[1024] = {0};
-    struct dirent * cursor = NULL;
-    while ((cursor = readdir(handle)) != NULL) {
-        if (cursor->d_name[0] == '.') {
-            continue;
-        }
-
-        snprintf(buffer, sizeof(buffer), "%s/%s", dir.c_str(), cursor->d_name);
-        struct stat fs;
-        if (stat(buffer, &fs) < 0) {
-            return -__LINE__;
-        }
-
-        if (S_ISREG(fs.st_mode)) {
-            unlink(buffer);
-        } else if (S_ISDIR(fs.st_mode)) {
-            int ret = EmptyDirectory(buffer);
-            if (0 != ret) {
-                return ret;
-            }
-            ret = rmdir(buffer);
-            if (0 != ret) {
-                return -__LINE__;
-            }
-        } else {
-            return -__LINE__;
-        }
-    }
-
-    closedir(handle);
-    return 0;
+    RemoveOptions options;
+    options.keep_root = true;
+    return RemoveTree(dir, options);
 }
 
 int DeleteFileOrDir(const std::string& fn, int recursive) {
-    if (0 != access(fn.c_str(), F_OK)) {
-        return 0;
-    }
-
-    struct stat info = {0};
-    int ret = stat(fn.c_str(), &info);
-    if (0 != ret) {
-        return ret;
+    struct stat info;
+    if (0 != lstat(fn.c_str(), &info)) {
+        return errno == ENOENT ? 0 : -1;
     }
 
     if (false == S_ISDIR(info.st_mode)) {
-        // file
+        // file or symlink
         return unlink(fn.c_str());
-    } else {
-        // dir
-        if (recursive == 0) {
-            return -1;
-        }
-        
-        ret = EmptyDirectory(fn.c_str());
-        if (ret != 0) {
-            return ret;
-        }
-        return rmdir(fn.c_str());
     }
+    // dir
+    if (recursive == 0) {
+        return -1;
+    }
+    return RemoveTree(fn, RemoveOptions());
 }
 
 } // namespace cutils
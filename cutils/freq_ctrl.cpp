@@ -1,78 +1,179 @@
 #include "freq_ctrl.h"
 
-#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+
 #include "timer.h"
 
 namespace cutils {
 
-void FreqCtrl::Init(const char* name, size_t max_sz) {
-    name_ = name;
-    tot_sz_ = 0;
-    max_sz_ = max_sz;
+namespace {
 
-    if (bg_ != nullptr) return;
-    bg_ = cutils::AsyncWorker::Make(&FreqCtrl::BgWorker, this);
+// ns values are capped far below overflow of "now + cost".  The burst
+// tolerance stays below the cost of a token at rate 0.
+const double kMaxNanos = 1e18;
+const double kMaxToleranceNanos = 1e17;
+
+void SleepNanos(uint64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
 }
 
-bool FreqCtrl::ShouldGo(size_t sz) {
-    if (tot_sz_ > max_sz_) return false;
+void SleepUntilNanos(uint64_t deadline_ns) {
+    struct timespec ts;
+    ts.tv_sec = deadline_ns / 1000000000;
+    ts.tv_nsec = deadline_ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr)
+           == EINTR) {
+    }
+}
 
-    if (sz == 1) {
-        size_t now_sz = (++tot_sz_);
-        if (now_sz > max_sz_) return false;
+double IntervalNanos(double rate_per_sec) {
+    return rate_per_sec > 0 ? std::min(1e9 / rate_per_sec, kMaxNanos)
+                            : kMaxNanos;
+}
 
-    } else {
-        for (int i = 0; i < 16; ++i) {
-            size_t now_sz = tot_sz_.load();
-            if (now_sz + sz > max_sz_) return false;
-            if (tot_sz_.compare_exchange_weak(now_sz, now_sz + sz)) {
-                return true;
-            }
-        }
-        return false;
-    }
+} // namespace
 
-    return true;
+GcraRate::GcraRate(double rate_per_sec, double burst)
+    : interval_ns_(IntervalNanos(rate_per_sec)), burst_(burst) {}
+
+void GcraRate::SetRate(double rate_per_sec) {
+    interval_ns_.store(IntervalNanos(rate_per_sec), std::memory_order_relaxed);
 }
 
-void FreqCtrl::SyncGo(size_t sz) {
-    for (int i = 0; i < 100; ++i) {
-        size_t now_sz = tot_sz_.load();
-        if (now_sz + sz <= max_sz_ && tot_sz_.compare_exchange_weak(
-                    now_sz, now_sz + sz)) {
-            return;
+void GcraRate::SetBurst(double burst) {
+    burst_.store(burst, std::memory_order_relaxed);
+}
+
+uint64_t GcraRate::Cost(uint64_t n) const {
+    if (n == 0) return 0;
+    return std::min(n * interval_ns_.load(std::memory_order_relaxed),
+                    kMaxNanos);
+}
+
+uint64_t GcraRate::Tolerance() const {
+    return std::min(burst_.load(std::memory_order_relaxed) *
+                    interval_ns_.load(std::memory_order_relaxed),
+                    kMaxToleranceNanos);
+}
+
+TokenBucket::TokenBucket(double rate_per_sec, double burst)
+    : tat_(0), rate_(rate_per_sec, burst) {}
+
+bool TokenBucket::TryAcquire(uint64_t n, uint64_t* wait_ns) {
+    uint64_t now = MonotonicNanos();
+    uint64_t cost = rate_.Cost(n);
+    uint64_t limit = now + rate_.Tolerance();
+    uint64_t tat = tat_.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        next = std::max(tat, now) + cost;
+        if (next > limit) {
+            if (wait_ns) *wait_ns = next - limit;
+            return false;
         }
+    } while (!tat_.compare_exchange_weak(tat, next,
+                                         std::memory_order_relaxed));
+    return true;
+}
+
+uint64_t TokenBucket::Reserve(uint64_t n) {
+    uint64_t now = MonotonicNanos();
+    uint64_t cost = rate_.Cost(n);
+    uint64_t limit = now + rate_.Tolerance();
+    uint64_t tat = tat_.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        next = std::max(tat, now) + cost;
+    } while (!tat_.compare_exchange_weak(tat, next,
+                                         std::memory_order_relaxed));
+    return next > limit ? next - limit : 0;
+}
 
-        int delay = rand() % (now_sz + sz > max_sz_ ? 20 : 5);
-        poll(nullptr, 0, delay);
+void TokenBucket::Refund(uint64_t n) {
+    uint64_t cost = rate_.Cost(n);
+    uint64_t tat = tat_.load(std::memory_order_relaxed);
+    // an arrival time in the past means a full bucket, whatever its value
+    while (!tat_.compare_exchange_weak(tat, tat > cost ? tat - cost : 0,
+                                       std::memory_order_relaxed)) {
     }
+}
 
-    tot_sz_ += sz;
+void FreqCtrl::Init(const char* name, size_t max_sz) {
+    name_ = name;
+    bucket_.SetRate(max_sz * 10.);
+    bucket_.SetBurst(max_sz);
+    inited_.store(true, std::memory_order_release);
 }
 
-void FreqCtrl::BgWorker(bool& stop) {
-    cutils::SetThreadTitle("fct_%s", name_.c_str());
-    while (!stop) {
-        poll(nullptr, 0, 100);
-        tot_sz_ = 0;
-    }
+bool FreqCtrl::ShouldGo(size_t sz) {
+    if (!inited_.load(std::memory_order_acquire)) return false;
+    return bucket_.TryAcquire(sz);
+}
+
+void FreqCtrl::SyncGo(size_t sz) {
+    uint64_t wait_ns = bucket_.Reserve(sz);
+    if (wait_ns > 0) SleepNanos(wait_ns);
 }
 
 
 
-FreqCtrlSingle::FreqCtrlSingle(size_t speed_per_sencod) : 
-    avaliable_time_(0), speed_per_sencod_(speed_per_sencod) {}
+FreqCtrlSingle::FreqCtrlSingle(size_t speed_per_sencod) :
+    avaliable_ns_(0), ns_per_unit_(IntervalNanos(speed_per_sencod)) {}
+
+uint64_t FreqCtrlSingle::Cost(size_t sz) const {
+    if (sz == 0) return 0;
+    return std::min(sz * ns_per_unit_.load(std::memory_order_relaxed),
+                    kMaxNanos);
+}
+
+uint64_t FreqCtrlSingle::Reserve(size_t sz) {
+    uint64_t now = MonotonicNanos();
+    uint64_t cost = Cost(sz);
+    uint64_t avail = avaliable_ns_.load(std::memory_order_relaxed);
+    uint64_t start;
+    do {
+        start = std::max(avail, now);
+    } while (!avaliable_ns_.compare_exchange_weak(
+                avail, start + cost, std::memory_order_relaxed));
+    return start;
+}
+
+bool FreqCtrlSingle::TryAcquire(size_t sz) {
+    uint64_t now = MonotonicNanos();
+    uint64_t cost = Cost(sz);
+    uint64_t avail = avaliable_ns_.load(std::memory_order_relaxed);
+    do {
+        if (avail > now) return false;
+    } while (!avaliable_ns_.compare_exchange_weak(
+                avail, now + cost, std::memory_order_relaxed));
+    return true;
+}
 
 void FreqCtrlSingle::Go(size_t sz) {
     if (sz == 0) return;
+    uint64_t deadline = Reserve(sz);
+    if (deadline > MonotonicNanos()) SleepUntilNanos(deadline);
+}
 
-    uint64_t cur_ts = GetTimeStampInMS();
-    if (cur_ts < avaliable_time_) {
-        poll(nullptr, 0, avaliable_time_ - cur_ts);
+void FreqCtrlSingle::GoAsync(size_t sz, AsyncWorkerPool* pool,
+                             AsyncTask task) {
+    uint64_t deadline = Reserve(sz);
+    if (deadline > MonotonicNanos()) {
+        pool->AddTaskAt(deadline, std::move(task));
+    } else {
+        pool->AddTask(std::move(task));
     }
+}
 
-    uint64_t cost_time_in_ms = sz * 1000. / speed_per_sencod_;
-    avaliable_time_ = GetTimeStampInMS() + cost_time_in_ms;
+void FreqCtrlSingle::SetSpeed(size_t speed_per_sencod) {
+    ns_per_unit_.store(IntervalNanos(speed_per_sencod),
+                       std::memory_order_relaxed);
 }
 
 } // namespace cutils
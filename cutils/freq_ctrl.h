@@ -4,31 +4,121 @@
 
 namespace cutils {
 
+// Rate and burst of a GCRA limiter, as ns per token and ns of tolerance.
+// Both can change at any time; readers racing with a change see either
+// setting.
+class GcraRate {
+public:
+    // A rate of 0 lets nothing through
+    GcraRate(double rate_per_sec, double burst);
+
+    void SetRate(double rate_per_sec);
+    void SetBurst(double burst);
+    double Rate() const {
+        return 1e9 / interval_ns_.load(std::memory_order_relaxed);
+    }
+    double Burst() const { return burst_.load(std::memory_order_relaxed); }
+
+    // ns that n tokens take to refill
+    uint64_t Cost(uint64_t n) const;
+    // ns the arrival time may run ahead of now: burst tokens' worth
+    uint64_t Tolerance() const;
+
+private:
+    std::atomic<double> interval_ns_;
+    std::atomic<double> burst_;
+};
+
+// Token bucket rate limiter in the GCRA form: the state is a single
+// "theoretical arrival time" in MonotonicNanos(), advanced by a CAS by
+// 1/rate seconds per token.  Tokens refill lazily from the clock on each
+// call, so there is no background thread, and a caller is admitted while
+// the arrival time is at most "burst" tokens ahead of now.
+//
+// Nothing ever sleeps: TryAcquire() and Reserve() report how long to
+// wait instead.  Rate and burst can change at any time; calls racing with
+// a change use either setting.
+class TokenBucket {
+public:
+    // rate_per_sec tokens per second, up to burst (>= 1) at once.  The
+    // bucket starts full.
+    TokenBucket(double rate_per_sec, double burst);
+
+    TokenBucket(const TokenBucket&) = delete;
+    TokenBucket& operator=(const TokenBucket&) = delete;
+
+    // Take n tokens if they are available now.  Otherwise take nothing,
+    // return false and set *wait_ns (if not null) to the time until they
+    // will be, all else being equal.  More than burst tokens are never
+    // available at once, see Reserve().
+    bool TryAcquire(uint64_t n = 1, uint64_t* wait_ns = nullptr);
+
+    // Take n tokens unconditionally, borrowing from the future, and return
+    // how many ns the caller has to wait before using them (0 for none)
+    uint64_t Reserve(uint64_t n = 1);
+
+    // Give back n tokens taken but not used
+    void Refund(uint64_t n = 1);
+
+    void SetRate(double rate_per_sec) { rate_.SetRate(rate_per_sec); }
+    void SetBurst(double burst) { rate_.SetBurst(burst); }
+    double Rate() const { return rate_.Rate(); }
+    double Burst() const { return rate_.Burst(); }
+
+private:
+    std::atomic<uint64_t> tat_; // theoretical arrival time, ns
+    GcraRate rate_;
+};
+
+// Process wide limiter of max_sz units per 100ms, on top of a TokenBucket
+// with a burst of max_sz
 class FreqCtrl : public cutils::Singleton<FreqCtrl> {
 public:
+    FreqCtrl() : bucket_(1, 1), inited_(false) {}
+
     void Init(const char* name, size_t max_sz);
 
+    // Take sz units if available now; always false before Init()
     bool ShouldGo(size_t sz = 1);
+    // Take sz units, sleeping until they are available
     void SyncGo(size_t sz = 1);
 
-private:
-    void BgWorker(bool& stop);
-
 private:
     std::string name_;
-    size_t max_sz_ = 0;
-    std::atomic<size_t> tot_sz_;
-    std::unique_ptr<cutils::AsyncWorker> bg_ = nullptr;
+    TokenBucket bucket_;
+    std::atomic<bool> inited_;
 };
 
+// Paces transfers to speed_per_sencod units per second, e.g. bytes of
+// disk I/O across many threads.  Each transfer of sz units books the next
+// sz/speed seconds after those already booked, at ns precision; there is
+// no burst, an idle limiter only lets the next transfer start at once.
+// Thread safe, one CAS per call.
 class FreqCtrlSingle {
 public:
     FreqCtrlSingle(size_t speed_per_sencod);
+
+    // Book sz units and return the MonotonicNanos() time at which the
+    // caller may start them
+    uint64_t Reserve(size_t sz);
+
+    // Book sz units only if they may start now
+    bool TryAcquire(size_t sz);
+
+    // Reserve() and sleep until the deadline
     void Go(size_t sz);
 
+    // Reserve() and hand the task to the pool at the deadline, so that no
+    // thread is parked while waiting
+    void GoAsync(size_t sz, AsyncWorkerPool* pool, AsyncTask task);
+
+    void SetSpeed(size_t speed_per_sencod);
+
 private:
-    uint64_t avaliable_time_;
-    size_t speed_per_sencod_;
+    uint64_t Cost(size_t sz) const;
+
+    std::atomic<uint64_t> avaliable_ns_;
+    std::atomic<double> ns_per_unit_;
 };
 
 } // namespace cutils
@@ -0,0 +1,183 @@
+#include "key_coding.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace cutils {
+
+namespace {
+
+const uint32_t kSign32 = 1u << 31;
+const uint64_t kSign64 = 1ull << 63;
+
+inline uint32_t FloatToOrdered(float v) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    return (u & kSign32) ? ~u : (u | kSign32);
+}
+
+inline float OrderedToFloat(uint32_t u) {
+    u = (u & kSign32) ? (u & ~kSign32) : ~u;
+    float v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+inline uint64_t DoubleToOrdered(double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    return (u & kSign64) ? ~u : (u | kSign64);
+}
+
+inline double OrderedToDouble(uint64_t u) {
+    u = (u & kSign64) ? (u & ~kSign64) : ~u;
+    double v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+// Escape 0x00 as 0x00 0xff, inverting every byte when "desc".  Runs
+// without a zero byte are copied in one go.
+void AppendEscaped(std::string* key, const Slice& v, bool desc) {
+    size_t beg = key->size();
+    const char* p = v.data();
+    const char* end = p + v.size();
+    while (p < end) {
+        const char* z = (const char*)memchr(p, 0, end - p);
+        if (z == nullptr) {
+            key->append(p, end - p);
+            break;
+        }
+        key->append(p, z - p);
+        key->push_back('\x00');
+        key->push_back('\xff');
+        p = z + 1;
+    }
+    if (desc) {
+        for (size_t i = beg; i < key->size(); ++i) {
+            (*key)[i] = ~(*key)[i];
+        }
+    }
+}
+
+} // namespace
+
+void AppendOrderedUint32(std::string* key, uint32_t v, bool desc) {
+    AppendFixed32(key, desc ? ~v : v);
+}
+
+void AppendOrderedUint64(std::string* key, uint64_t v, bool desc) {
+    AppendFixed64(key, desc ? ~v : v);
+}
+
+void AppendOrderedInt32(std::string* key, int32_t v, bool desc) {
+    AppendOrderedUint32(key, static_cast<uint32_t>(v) ^ kSign32, desc);
+}
+
+void AppendOrderedInt64(std::string* key, int64_t v, bool desc) {
+    AppendOrderedUint64(key, static_cast<uint64_t>(v) ^ kSign64, desc);
+}
+
+// A NaN keeps its sign bit, set for 0.0 / 0.0 on x86, and would sort
+// before -inf: every NaN is stored as the one quiet NaN instead.
+void AppendOrderedFloat(std::string* key, float v, bool desc) {
+    if (std::isnan(v)) v = std::numeric_limits<float>::quiet_NaN();
+    AppendOrderedUint32(key, FloatToOrdered(v), desc);
+}
+
+void AppendOrderedDouble(std::string* key, double v, bool desc) {
+    if (std::isnan(v)) v = std::numeric_limits<double>::quiet_NaN();
+    AppendOrderedUint64(key, DoubleToOrdered(v), desc);
+}
+
+void AppendOrderedString(std::string* key, const Slice& v, bool desc) {
+    AppendEscaped(key, v, desc);
+    key->push_back(desc ? '\xff' : '\x00');
+    key->push_back(desc ? '\xfe' : '\x01');
+}
+
+void AppendOrderedStringPrefix(std::string* key, const Slice& v, bool desc) {
+    AppendEscaped(key, v, desc);
+}
+
+bool RemoveOrderedUint32(Slice* key, uint32_t* v, bool desc) {
+    if (key->size() < 4) return false;
+    uint32_t u;
+    RemoveFixed32(key, &u);
+    *v = desc ? ~u : u;
+    return true;
+}
+
+bool RemoveOrderedUint64(Slice* key, uint64_t* v, bool desc) {
+    if (key->size() < 8) return false;
+    uint64_t u;
+    RemoveFixed64(key, &u);
+    *v = desc ? ~u : u;
+    return true;
+}
+
+bool RemoveOrderedInt32(Slice* key, int32_t* v, bool desc) {
+    uint32_t u;
+    if (!RemoveOrderedUint32(key, &u, desc)) return false;
+    *v = static_cast<int32_t>(u ^ kSign32);
+    return true;
+}
+
+bool RemoveOrderedInt64(Slice* key, int64_t* v, bool desc) {
+    uint64_t u;
+    if (!RemoveOrderedUint64(key, &u, desc)) return false;
+    *v = static_cast<int64_t>(u ^ kSign64);
+    return true;
+}
+
+bool RemoveOrderedFloat(Slice* key, float* v, bool desc) {
+    uint32_t u;
+    if (!RemoveOrderedUint32(key, &u, desc)) return false;
+    *v = OrderedToFloat(u);
+    return true;
+}
+
+bool RemoveOrderedDouble(Slice* key, double* v, bool desc) {
+    uint64_t u;
+    if (!RemoveOrderedUint64(key, &u, desc)) return false;
+    *v = OrderedToDouble(u);
+    return true;
+}
+
+bool RemoveOrderedString(Slice* key, std::string* v, bool desc) {
+    const char mark = desc ? '\xff' : '\x00';
+    const unsigned char flip = desc ? 0xff : 0;
+    const char* p = key->data();
+    const char* end = p + key->size();
+    std::string res;
+    while (p < end) {
+        const char* z = (const char*)memchr(p, mark, end - p);
+        if (z == nullptr || z + 1 == end) return false;
+        size_t beg = res.size();
+        res.append(p, z - p);
+        if (desc) {
+            for (size_t i = beg; i < res.size(); ++i) res[i] = ~res[i];
+        }
+        unsigned char next = static_cast<unsigned char>(z[1]) ^ flip;
+        if (next == 0x01) {
+            v->swap(res);
+            key->remove_prefix(z + 2 - key->data());
+            return true;
+        }
+        if (next != 0xff) return false;
+        res.push_back('\x00');
+        p = z + 2;
+    }
+    return false;
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "coding.h"
+#include "slice.h"
+
+namespace cutils {
+
+// Order-preserving ("memcomparable") key encoding.
+//
+// The encoded form of every field sorts with memcmp / Slice::compare in the
+// same order as the value itself, and every field is self-delimiting, so a
+// key made of several fields sorts like the tuple of their values.  Range
+// scans can then compare raw keys without decoding them.
+//
+//   unsigned   big endian, as AppendFixed8/16/32/64
+//   signed     big endian with the sign bit flipped
+//   float      IEEE bits, sign bit flipped for positives and all bits
+//              flipped for negatives; -0.0 sorts before +0.0, and every
+//              NaN is stored as the quiet NaN, after +inf
+//   string     0x00 escaped as 0x00 0xff, terminated by 0x00 0x01
+//
+// With "desc" all bytes of the field are inverted, which reverses the
+// order of that field only.
+//
+// Every Append... has a Remove... that parses the field from the front of
+// a Slice and advances it, or returns false on truncated or malformed input.
+
+void AppendOrderedUint32(std::string* key, uint32_t v, bool desc = false);
+void AppendOrderedUint64(std::string* key, uint64_t v, bool desc = false);
+void AppendOrderedInt32(std::string* key, int32_t v, bool desc = false);
+void AppendOrderedInt64(std::string* key, int64_t v, bool desc = false);
+void AppendOrderedFloat(std::string* key, float v, bool desc = false);
+void AppendOrderedDouble(std::string* key, double v, bool desc = false);
+void AppendOrderedString(std::string* key, const Slice& v, bool desc = false);
+
+// The escaped bytes of "v" without the terminator.  Every key whose string
+// field starts with "v" sorts at or after the result, so it is the start
+// key of a prefix scan.
+void AppendOrderedStringPrefix(std::string* key, const Slice& v,
+                               bool desc = false);
+
+bool RemoveOrderedUint32(Slice* key, uint32_t* v, bool desc = false);
+bool RemoveOrderedUint64(Slice* key, uint64_t* v, bool desc = false);
+bool RemoveOrderedInt32(Slice* key, int32_t* v, bool desc = false);
+bool RemoveOrderedInt64(Slice* key, int64_t* v, bool desc = false);
+bool RemoveOrderedFloat(Slice* key, float* v, bool desc = false);
+bool RemoveOrderedDouble(Slice* key, double* v, bool desc = false);
+bool RemoveOrderedString(Slice* key, std::string* v, bool desc = false);
+
+// Build a composite key field by field:
+//
+//   std::string key;
+//   OrderedKeyBuilder(&key).Uint32(table_id).String(user).Int64(ts, true);
+class OrderedKeyBuilder {
+public:
+    explicit OrderedKeyBuilder(std::string* key) : key_(key) {}
+
+    OrderedKeyBuilder& Uint32(uint32_t v, bool desc = false) {
+        AppendOrderedUint32(key_, v, desc);
+        return *this;
+    }
+    OrderedKeyBuilder& Uint64(uint64_t v, bool desc = false) {
+        AppendOrderedUint64(key_, v, desc);
+        return *this;
+    }
+    OrderedKeyBuilder& Int32(int32_t v, bool desc = false) {
+        AppendOrderedInt32(key_, v, desc);
+        return *this;
+    }
+    OrderedKeyBuilder& Int64(int64_t v, bool desc = false) {
+        AppendOrderedInt64(key_, v, desc);
+        return *this;
+    }
+    OrderedKeyBuilder& Float(float v, bool desc = false) {
+        AppendOrderedFloat(key_, v, desc);
+        return *this;
+    }
+    OrderedKeyBuilder& Double(double v, bool desc = false) {
+        AppendOrderedDouble(key_, v, desc);
+        return *this;
+    }
+    OrderedKeyBuilder& String(const Slice& v, bool desc = false) {
+        AppendOrderedString(key_, v, desc);
+        return *this;
+    }
+    OrderedKeyBuilder& StringPrefix(const Slice& v, bool desc = false) {
+        AppendOrderedStringPrefix(key_, v, desc);
+        return *this;
+    }
+
+private:
+    std::string* key_;
+};
+
+// Read back a composite key in the order it was built.  Errors are sticky
+// as in BufferReader: check ok() once after the last field.
+class OrderedKeyReader {
+public:
+    explicit OrderedKeyReader(const Slice& key) : key_(key), ok_(true) {}
+
+    bool ok() const { return ok_; }
+    bool empty() const { return key_.empty(); }
+    Slice rest() const { return key_; }
+
+    uint32_t Uint32(bool desc = false) {
+        uint32_t v = 0;
+        Check(ok_ && RemoveOrderedUint32(&key_, &v, desc));
+        return v;
+    }
+    uint64_t Uint64(bool desc = false) {
+        uint64_t v = 0;
+        Check(ok_ && RemoveOrderedUint64(&key_, &v, desc));
+        return v;
+    }
+    int32_t Int32(bool desc = false) {
+        int32_t v = 0;
+        Check(ok_ && RemoveOrderedInt32(&key_, &v, desc));
+        return v;
+    }
+    int64_t Int64(bool desc = false) {
+        int64_t v = 0;
+        Check(ok_ && RemoveOrderedInt64(&key_, &v, desc));
+        return v;
+    }
+    float Float(bool desc = false) {
+        float v = 0;
+        Check(ok_ && RemoveOrderedFloat(&key_, &v, desc));
+        return v;
+    }
+    double Double(bool desc = false) {
+        double v = 0;
+        Check(ok_ && RemoveOrderedDouble(&key_, &v, desc));
+        return v;
+    }
+    std::string String(bool desc = false) {
+        std::string v;
+        Check(ok_ && RemoveOrderedString(&key_, &v, desc));
+        return v;
+    }
+
+private:
+    void Check(bool ok) {
+        if (!ok) {
+            ok_ = false;
+            key_.clear();
+        }
+    }
+
+    Slice key_;
+    bool ok_;
+};
+
+} // namespace cutils
@@ -0,0 +1,134 @@
+#include "keyed_limiter.h"
+
+#include <sched.h>
+#include <algorithm>
+
+#include "chash.h"
+#include "timer.h"
+
+namespace cutils {
+
+const int KeyedLimiter::kWays;
+
+namespace {
+
+class SetLock {
+public:
+    explicit SetLock(std::atomic<bool>* locked) : locked_(locked) {
+        int spins = 0;
+        while (locked_->exchange(true, std::memory_order_acquire)) {
+            while (locked_->load(std::memory_order_relaxed)) {
+                if (++spins > 64) sched_yield();
+            }
+        }
+    }
+
+    ~SetLock() { locked_->store(false, std::memory_order_release); }
+
+private:
+    std::atomic<bool>* locked_;
+};
+
+} // namespace
+
+KeyedLimiter::KeyedLimiter(size_t capacity, double rate_per_sec,
+                           double burst)
+    : rate_(rate_per_sec, burst), evictions_(0) {
+    size_t sets = 1;
+    set_shift_ = 64;
+    while (sets * kWays < capacity) {
+        sets <<= 1;
+        --set_shift_;
+    }
+    std::vector<Set> table(sets);
+    sets_.swap(table);
+    for (Set& set : sets_) {
+        set.locked = false;
+        for (Slot& slot : set.slots) {
+            slot.key = 0;
+            slot.tat = 0;
+        }
+    }
+}
+
+uint64_t KeyedLimiter::HashKey(const Slice& key) {
+    return CHash2<uint64_t>(key.data(), key.size());
+}
+
+KeyedLimiter::Set& KeyedLimiter::SetOf(uint64_t key) {
+    // multiplicative hash as UinHash, top bits pick the set
+    if (set_shift_ == 64) return sets_[0];
+    return sets_[(key * 11400714819323198485ULL) >> set_shift_];
+}
+
+KeyedLimiter::Slot* KeyedLimiter::FindSlot(Set& set, uint64_t key,
+                                           uint64_t now, bool insert) {
+    Slot* victim = &set.slots[0];
+    for (Slot& slot : set.slots) {
+        if (slot.tat != 0 && slot.key == key) return &slot;
+        if (slot.tat < victim->tat) victim = &slot;
+    }
+    if (!insert) return nullptr;
+    if (victim->tat > now) {
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    victim->key = key;
+    victim->tat = now;
+    return victim;
+}
+
+bool KeyedLimiter::TryAcquire(uint64_t key, uint64_t n, uint64_t* wait_ns) {
+    uint64_t now = MonotonicNanos();
+    uint64_t cost = rate_.Cost(n);
+    uint64_t limit = now + rate_.Tolerance();
+    Set& set = SetOf(key);
+    SetLock lock(&set.locked);
+    Slot* slot = FindSlot(set, key, now, true);
+    uint64_t next = std::max(slot->tat, now) + cost;
+    if (next > limit) {
+        if (wait_ns) *wait_ns = next - limit;
+        return false;
+    }
+    slot->tat = next;
+    return true;
+}
+
+void KeyedLimiter::Refund(uint64_t key, uint64_t n) {
+    uint64_t cost = rate_.Cost(n);
+    Set& set = SetOf(key);
+    SetLock lock(&set.locked);
+    Slot* slot = FindSlot(set, key, 0, false);
+    // an evicted key has a full bucket already; keep tat non zero
+    if (slot) slot->tat = slot->tat > cost ? slot->tat - cost : 1;
+}
+
+bool HierarchicalLimiter::TryAcquire(uint64_t key, uint64_t group,
+                                     uint64_t n, uint64_t* wait_ns) {
+    if (keys_ && !keys_->TryAcquire(key, n, wait_ns)) return false;
+    if (groups_ && !groups_->TryAcquire(group, n, wait_ns)) {
+        if (keys_) keys_->Refund(key, n);
+        return false;
+    }
+    if (global_ && !global_->TryAcquire(n, wait_ns)) {
+        if (groups_) groups_->Refund(group, n);
+        if (keys_) keys_->Refund(key, n);
+        return false;
+    }
+    return true;
+}
+
+void HierarchicalLimiter::Refund(uint64_t key, uint64_t group, uint64_t n) {
+    if (keys_) keys_->Refund(key, n);
+    if (groups_) groups_->Refund(group, n);
+    if (global_) global_->Refund(n);
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "freq_ctrl.h"
+#include "slice.h"
+
+namespace cutils {
+
+// Token buckets for a large number of keys (uins, tenants, ...) sharing
+// one rate and burst, in a fixed amount of memory.
+//
+// Each key maps to a set of kWays slots (set associative, 120 bytes per
+// set with its own spin lock), and a slot holds the key and its GCRA
+// arrival time as in TokenBucket.  A key missing from its set takes a
+// free slot or evicts the one with the oldest arrival time: the key that
+// would have the most tokens, which loses nothing if its bucket has
+// refilled completely.  Only a set full of keys that are all being
+// limited forgets state, handing the evicted key a fresh bucket.
+class KeyedLimiter {
+public:
+    static const int kWays = 7;
+
+    // Room for at least "capacity" keys
+    KeyedLimiter(size_t capacity, double rate_per_sec, double burst);
+
+    KeyedLimiter(const KeyedLimiter&) = delete;
+    KeyedLimiter& operator=(const KeyedLimiter&) = delete;
+
+    // As TokenBucket::TryAcquire for the bucket of "key"
+    bool TryAcquire(uint64_t key, uint64_t n = 1, uint64_t* wait_ns = nullptr);
+    // Give back n tokens taken from the bucket of "key"
+    void Refund(uint64_t key, uint64_t n = 1);
+
+    // String keys are hashed to 64 bits; colliding keys share a bucket
+    static uint64_t HashKey(const Slice& key);
+    bool TryAcquire(const Slice& key, uint64_t n = 1,
+                    uint64_t* wait_ns = nullptr) {
+        return TryAcquire(HashKey(key), n, wait_ns);
+    }
+    void Refund(const Slice& key, uint64_t n = 1) {
+        Refund(HashKey(key), n);
+    }
+
+    void SetRate(double rate_per_sec) { rate_.SetRate(rate_per_sec); }
+    void SetBurst(double burst) { rate_.SetBurst(burst); }
+
+    size_t Capacity() const { return sets_.size() * kWays; }
+    // Keys evicted while their bucket was not yet full
+    uint64_t Evictions() const {
+        return evictions_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        uint64_t key;
+        uint64_t tat; // 0 for a free slot
+    };
+
+    struct Set {
+        std::atomic<bool> locked;
+        Slot slots[kWays];
+    };
+
+    Set& SetOf(uint64_t key);
+    // REQUIRES: set locked.  Find or make the slot of "key".
+    Slot* FindSlot(Set& set, uint64_t key, uint64_t now, bool insert);
+
+    std::vector<Set> sets_;
+    int set_shift_;
+    GcraRate rate_;
+    std::atomic<uint64_t> evictions_;
+};
+
+// Per key, per group and global limits checked in one call.  Tokens are
+// taken from the key, then the group, then the global bucket; if a level
+// refuses, the levels already charged are refunded and nothing is taken.
+// Any level may be null.
+//
+//   KeyedLimiter users(1 << 20, 10, 20);      // 10/s per uin
+//   KeyedLimiter tenants(1 << 16, 1000, 2000);
+//   TokenBucket global(50000, 50000);
+//   HierarchicalLimiter limiter(&users, &tenants, &global);
+//   if (!limiter.TryAcquire(uin, tenant_id)) reject();
+class HierarchicalLimiter {
+public:
+    HierarchicalLimiter(KeyedLimiter* keys, KeyedLimiter* groups,
+                        TokenBucket* global)
+        : keys_(keys), groups_(groups), global_(global) {}
+
+    // *wait_ns (if not null) is set to the wait reported by the level
+    // that refused
+    bool TryAcquire(uint64_t key, uint64_t group, uint64_t n = 1,
+                    uint64_t* wait_ns = nullptr);
+
+    // Give back n tokens to every level, for work admitted but not done
+    void Refund(uint64_t key, uint64_t group, uint64_t n = 1);
+
+private:
+    KeyedLimiter* keys_;
+    KeyedLimiter* groups_;
+    TokenBucket* global_;
+};
+
+} // namespace cutils
@@ -0,0 +1,40 @@
+#pragma once
+
+// Log format, as in LevelDB:
+//
+// The file is a sequence of 32KB blocks.  A block holds physical records
+// and, when fewer than kHeaderSize bytes are left at its end, a zeroed
+// trailer.  A physical record is
+//
+//   checksum: uint32  // masked crc32c of type and data, little endian
+//   length:   uint16  // little endian
+//   type:     uint8   // one of RecordType
+//   data:     uint8[length]
+//
+// A user record that does not fit in the rest of a block is split into a
+// kFirstType, zero or more kMiddleType and a kLastType fragment, one per
+// block; a record that fits is a single kFullType.
+
+namespace cutils {
+namespace log {
+
+enum RecordType {
+    // reserved for preallocated, not yet written space
+    kZeroType = 0,
+
+    kFullType = 1,
+
+    // fragments
+    kFirstType = 2,
+    kMiddleType = 3,
+    kLastType = 4
+};
+static const int kMaxRecordType = kLastType;
+
+static const int kBlockSize = 32768;
+
+// checksum (4 bytes), length (2 bytes), type (1 byte)
+static const int kHeaderSize = 4 + 2 + 1;
+
+} // namespace log
+} // namespace cutils
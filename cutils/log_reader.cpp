@@ -0,0 +1,240 @@
+#include "log_reader.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "coding.h"
+#include "crc32c.h"
+
+namespace cutils {
+namespace log {
+
+static uint64_t FirstBlockOffset(uint64_t initial_offset) {
+    uint64_t offset_in_block = initial_offset % kBlockSize;
+    uint64_t block_start = initial_offset - offset_in_block;
+    // don't search a block if we'd be in the trailer
+    if (offset_in_block > kBlockSize - kHeaderSize) {
+        block_start += kBlockSize;
+    }
+    return block_start;
+}
+
+Reader::Reader(int fd, CorruptionReporter reporter, bool checksum,
+               uint64_t initial_offset)
+    : fd_(fd), reporter_(reporter), checksum_(checksum),
+      initial_offset_(initial_offset), status_(0),
+      pos_(FirstBlockOffset(initial_offset)),
+      block_(kBlockSize, '\0'), block_start_(~0ULL), block_len_(0),
+      in_fragmented_record_(false), prospective_record_offset_(0),
+      last_record_offset_(0), resyncing_(initial_offset > 0) {
+}
+
+Reader::Reader(const Slice& data, CorruptionReporter reporter, bool checksum,
+               uint64_t initial_offset)
+    : fd_(-1), data_(data), reporter_(reporter), checksum_(checksum),
+      initial_offset_(initial_offset), status_(0),
+      pos_(FirstBlockOffset(initial_offset)),
+      block_start_(~0ULL), block_len_(0),
+      in_fragmented_record_(false), prospective_record_offset_(0),
+      last_record_offset_(0), resyncing_(initial_offset > 0) {
+}
+
+bool Reader::Fetch(uint64_t offset, size_t n, Slice* result) {
+    if (fd_ < 0) {
+        if (offset + n > data_.size()) return false;
+        *result = Slice(data_.data() + offset, n);
+        return true;
+    }
+
+    uint64_t block_start = offset - offset % kBlockSize;
+    uint64_t end = offset - block_start + n;
+    if (block_start != block_start_ || end > block_len_) {
+        if (block_start != block_start_) {
+            block_start_ = block_start;
+            block_len_ = 0;
+        }
+        // read what is missing of the block, it may still be growing
+        while (block_len_ < kBlockSize) {
+            ssize_t ret = pread(fd_, &block_[block_len_],
+                                kBlockSize - block_len_,
+                                block_start_ + block_len_);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                status_ = -errno;
+                break;
+            }
+            if (ret == 0) break;
+            block_len_ += ret;
+        }
+        if (end > block_len_) return false;
+    }
+    *result = Slice(block_.data() + (offset - block_start), n);
+    return true;
+}
+
+void Reader::ReportCorruption(size_t bytes, const char* reason) {
+    if (reporter_) {
+        reporter_(bytes, reason);
+    }
+}
+
+unsigned int Reader::ReadPhysicalRecord(Slice* result, uint64_t* offset) {
+    while (true) {
+        const size_t block_left = kBlockSize - pos_ % kBlockSize;
+        if (block_left < kHeaderSize) {
+            // skip the trailer
+            pos_ += block_left;
+            continue;
+        }
+
+        Slice header;
+        if (!Fetch(pos_, kHeaderSize, &header)) {
+            // not written yet, or a writer died in the middle of it
+            return kEof;
+        }
+        const char* h = header.data();
+        const uint32_t a = static_cast<uint32_t>(h[4]) & 0xff;
+        const uint32_t b = static_cast<uint32_t>(h[5]) & 0xff;
+        const unsigned int type = static_cast<unsigned char>(h[6]);
+        const uint32_t length = a | (b << 8);
+        if (kHeaderSize + length > block_left) {
+            pos_ += block_left;
+            ReportCorruption(block_left, "bad record length");
+            return kBadRecord;
+        }
+
+        if (type == kZeroType && length == 0) {
+            // zeroes from preallocation: nothing written here yet
+            return kEof;
+        }
+
+        Slice data;
+        if (!Fetch(pos_ + kHeaderSize, length, &data)) {
+            return kEof;
+        }
+
+        if (checksum_) {
+            uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(h));
+            uint32_t actual_crc = crc32c::Value(h + 6, 1);
+            actual_crc = crc32c::Extend(actual_crc, data.data(), length);
+            if (actual_crc != expected_crc) {
+                // Drop the rest of the block: the length itself may be
+                // corrupted, and if we trusted it we could find some
+                // fragment of a real log record that just happens to
+                // look like a valid one
+                pos_ += block_left;
+                ReportCorruption(block_left, "checksum mismatch");
+                return kBadRecord;
+            }
+        }
+
+        *offset = pos_;
+        pos_ += kHeaderSize + length;
+
+        // skip physical records that started before initial_offset_
+        if (*offset < initial_offset_) {
+            return kBadRecord;
+        }
+
+        *result = data;
+        return type;
+    }
+}
+
+bool Reader::ReadRecord(Slice* record) {
+    Slice fragment;
+    uint64_t offset = 0;
+    while (true) {
+        const unsigned int record_type = ReadPhysicalRecord(&fragment, &offset);
+
+        if (resyncing_) {
+            if (record_type == kMiddleType) {
+                continue;
+            } else if (record_type == kLastType) {
+                resyncing_ = false;
+                continue;
+            } else if (record_type != kEof) {
+                resyncing_ = false;
+            }
+        }
+
+        switch (record_type) {
+            case kFullType:
+                if (in_fragmented_record_ && !scratch_.empty()) {
+                    ReportCorruption(scratch_.size(),
+                                     "partial record without end(1)");
+                }
+                in_fragmented_record_ = false;
+                scratch_.clear();
+                last_record_offset_ = offset;
+                *record = fragment;
+                return true;
+
+            case kFirstType:
+                if (in_fragmented_record_ && !scratch_.empty()) {
+                    ReportCorruption(scratch_.size(),
+                                     "partial record without end(2)");
+                }
+                prospective_record_offset_ = offset;
+                scratch_.assign(fragment.data(), fragment.size());
+                in_fragmented_record_ = true;
+                break;
+
+            case kMiddleType:
+                if (!in_fragmented_record_) {
+                    ReportCorruption(fragment.size(),
+                                     "missing start of fragmented record(1)");
+                } else {
+                    scratch_.append(fragment.data(), fragment.size());
+                }
+                break;
+
+            case kLastType:
+                if (!in_fragmented_record_) {
+                    ReportCorruption(fragment.size(),
+                                     "missing start of fragmented record(2)");
+                } else {
+                    scratch_.append(fragment.data(), fragment.size());
+                    in_fragmented_record_ = false;
+                    last_record_offset_ = prospective_record_offset_;
+                    *record = Slice(scratch_);
+                    return true;
+                }
+                break;
+
+            case kEof:
+                // keep a fragmented record pending, the rest may come
+                return false;
+
+            case kBadRecord:
+                if (in_fragmented_record_) {
+                    ReportCorruption(scratch_.size(),
+                                     "error in middle of record");
+                    in_fragmented_record_ = false;
+                    scratch_.clear();
+                }
+                break;
+
+            default:
+                ReportCorruption(
+                    fragment.size() +
+                        (in_fragmented_record_ ? scratch_.size() : 0),
+                    "unknown record type");
+                in_fragmented_record_ = false;
+                scratch_.clear();
+                break;
+        }
+    }
+    return false;
+}
+
+} // namespace log
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
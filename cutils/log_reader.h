@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+#include "log_format.h"
+#include "slice.h"
+
+namespace cutils {
+namespace log {
+
+// Called with the approximate number of bytes dropped and the reason
+using CorruptionReporter = std::function<void(size_t bytes, const char* reason)>;
+
+// Reads the records written by log::Writer, either from a file descriptor
+// with pread() or straight from memory (e.g. a mapped file).
+//
+// ReadRecord() returning false only means no complete record is
+// available yet: a record whose tail has not been written is kept
+// pending, so a reader can follow a file that is still being appended by
+// calling ReadRecord() again later (after UpdateSource() for memory).
+//
+// A bad length or checksum drops the rest of the block, reports it, and
+// reading resyncs at the next record that starts a user record.
+// Not thread safe.
+class Reader {
+public:
+    // Read "fd" from "initial_offset" on: records that start before it
+    // are skipped.
+    Reader(int fd, CorruptionReporter reporter = nullptr,
+           bool checksum = true, uint64_t initial_offset = 0);
+
+    // Read from "data".  Records that fit in a block are returned as
+    // Slices into it without copying.
+    Reader(const Slice& data, CorruptionReporter reporter = nullptr,
+           bool checksum = true, uint64_t initial_offset = 0);
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // Read the next record into *record.  Return false if there is none
+    // yet, see status() for read errors.  *record stays valid until the
+    // next call or, in memory mode, as long as the data.
+    bool ReadRecord(Slice* record);
+
+    // Offset in the file of the record last returned by ReadRecord()
+    uint64_t LastRecordOffset() const { return last_record_offset_; }
+
+    // Memory mode: the data has grown, "data" has the old data as prefix
+    void UpdateSource(const Slice& data) { data_ = data; }
+
+    // 0 or -errno of the last failed pread()
+    int status() const { return status_; }
+
+private:
+    // Extend record types with the following special values
+    enum {
+        kEof = kMaxRecordType + 1,
+        // A corrupted record, or one that starts before initial_offset_
+        kBadRecord = kMaxRecordType + 2
+    };
+
+    unsigned int ReadPhysicalRecord(Slice* result, uint64_t* offset);
+
+    // Point *result at n bytes of the file from "offset", false if they
+    // have not all been written yet.  A request never crosses a block.
+    bool Fetch(uint64_t offset, size_t n, Slice* result);
+
+    void ReportCorruption(size_t bytes, const char* reason);
+
+    int fd_;
+    Slice data_;
+    CorruptionReporter reporter_;
+    bool checksum_;
+    uint64_t initial_offset_;
+    int status_;
+
+    // offset of the next physical record
+    uint64_t pos_;
+
+    // fd mode: the block last read and how much of it was there
+    std::string block_;
+    uint64_t block_start_;
+    size_t block_len_;
+
+    // fragments of the record being assembled
+    std::string scratch_;
+    bool in_fragmented_record_;
+    uint64_t prospective_record_offset_;
+    uint64_t last_record_offset_;
+
+    // true until a record that starts a user record has been seen after
+    // seeking to initial_offset_
+    bool resyncing_;
+};
+
+} // namespace log
+} // namespace cutils
@@ -0,0 +1,105 @@
+#include "log_writer.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "coding.h"
+#include "crc32c.h"
+
+namespace cutils {
+namespace log {
+
+// Fragments shorter than this are copied into the header buffer, longer
+// ones are written from the caller's memory
+static const size_t kMinRefFragment = 256;
+
+Writer::Writer(int fd, uint64_t dest_length)
+    : fd_(fd), block_offset_(dest_length % kBlockSize), status_(0),
+      buf_(kBlockSize / 8) {
+    for (int i = 0; i <= kMaxRecordType; i++) {
+        char t = static_cast<char>(i);
+        type_crc_[i] = crc32c::Value(&t, 1);
+    }
+}
+
+int Writer::AddRecord(const Slice& slice) {
+    if (status_ != 0) return status_;
+
+    const char* ptr = slice.data();
+    size_t left = slice.size();
+
+    // Fragment the record if necessary and emit it.  Note that if slice
+    // is empty, we still want to iterate once to emit a single
+    // zero-length record
+    buf_.Clear();
+    bool begin = true;
+    do {
+        const int leftover = kBlockSize - block_offset_;
+        if (leftover < kHeaderSize) {
+            // switch to a new block, filling the trailer with zeroes
+            if (leftover > 0) {
+                buf_.Append("\x00\x00\x00\x00\x00\x00", leftover);
+            }
+            block_offset_ = 0;
+        }
+
+        const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+        const size_t fragment_length = (left < avail) ? left : avail;
+        const bool end = (left == fragment_length);
+        RecordType type;
+        if (begin && end) {
+            type = kFullType;
+        } else if (begin) {
+            type = kFirstType;
+        } else if (end) {
+            type = kLastType;
+        } else {
+            type = kMiddleType;
+        }
+
+        EmitPhysicalRecord(type, ptr, fragment_length);
+        ptr += fragment_length;
+        left -= fragment_length;
+        begin = false;
+    } while (left > 0);
+
+    status_ = buf_.WriteTo(fd_);
+    buf_.Clear();
+    return status_;
+}
+
+void Writer::EmitPhysicalRecord(RecordType t, const char* ptr,
+                                size_t length) {
+    char* header = buf_.Reserve(kHeaderSize);
+    header[4] = static_cast<char>(length & 0xff);
+    header[5] = static_cast<char>(length >> 8);
+    header[6] = static_cast<char>(t);
+
+    // the crc covers the type and the payload
+    uint32_t crc = crc32c::Extend(type_crc_[t], ptr, length);
+    EncodeFixed32(header, crc32c::Mask(crc));
+
+    if (length >= kMinRefFragment) {
+        buf_.AppendRef(Slice(ptr, length));
+    } else {
+        buf_.Append(ptr, length);
+    }
+    block_offset_ += kHeaderSize + length;
+}
+
+int Writer::Sync() {
+    if (status_ != 0) return status_;
+    if (fdatasync(fd_) != 0) return -errno;
+    return 0;
+}
+
+} // namespace log
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "buffer.h"
+#include "log_format.h"
+#include "slice.h"
+
+namespace cutils {
+namespace log {
+
+// Appends records to a file in the format of log_format.h.  All fragments
+// of a record go out with a single writev(), record data is not copied
+// unless the fragment is small.  Not thread safe.
+class Writer {
+public:
+    // Append to "fd", which has to be positioned at its end (e.g. opened
+    // with O_APPEND).  "dest_length" is the current size of the file, so
+    // that a reopened log continues at the right block offset.
+    explicit Writer(int fd, uint64_t dest_length = 0);
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Return 0 or -errno.  After a failed write the end of the file is
+    // unknown and every later call returns the same error.
+    int AddRecord(const Slice& slice);
+
+    // fdatasync() the file, return 0 or -errno
+    int Sync();
+
+private:
+    void EmitPhysicalRecord(RecordType type, const char* ptr, size_t length);
+
+    int fd_;
+    int block_offset_; // current offset in block
+    int status_;
+    BufferWriter buf_;
+
+    // crc32c of each type byte, to save a crc32c call per record
+    uint32_t type_crc_[kMaxRecordType + 1];
+};
+
+} // namespace log
+} // namespace cutils
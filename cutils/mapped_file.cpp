@@ -0,0 +1,262 @@
+#include "mapped_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cutils {
+
+namespace {
+
+size_t PageSize() {
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    return page;
+}
+
+size_t RoundUpToPage(size_t n) {
+    return (n + PageSize() - 1) & ~(PageSize() - 1);
+}
+
+// -1 for advice the platform does not have
+int ToMadvise(MappedFile::Advice advice) {
+    switch (advice) {
+        case MappedFile::kSequential: return MADV_SEQUENTIAL;
+        case MappedFile::kRandom: return MADV_RANDOM;
+        case MappedFile::kWillNeed: return MADV_WILLNEED;
+        case MappedFile::kDontNeed: return MADV_DONTNEED;
+        case MappedFile::kHugePage:
+#ifdef MADV_HUGEPAGE
+            return MADV_HUGEPAGE;
+#else
+            return -1;
+#endif
+        default: return MADV_NORMAL;
+    }
+}
+
+// Address space to map the file into later, touching nothing
+void* Reserve(void* addr, size_t length) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    if (addr != nullptr) flags |= MAP_FIXED;
+    return mmap(addr, length, PROT_NONE, flags, -1, 0);
+}
+
+} // namespace
+
+MappedFile::MappedFile()
+    : fd_(-1), writable_(false), file_size_(0), addr_(nullptr), skew_(0),
+      size_(0), offset_(0), mapped_(0), region_(0), windowed_(false),
+      window_(0) {}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+int MappedFile::Open(const std::string& path, const Options& options) {
+    Close();
+    int flags = O_CLOEXEC;
+    if (options.writable) {
+        flags |= O_RDWR | (options.create ? O_CREAT : 0);
+    } else {
+        flags |= O_RDONLY;
+    }
+    fd_ = open(path.c_str(), flags, 0644);
+    if (fd_ < 0) return -errno;
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        int ret = -errno;
+        Close();
+        return ret;
+    }
+    options_ = options;
+    writable_ = options.writable;
+    file_size_ = st.st_size;
+    windowed_ = file_size_ > options.max_map;
+    window_ = windowed_ ? options.max_map : 0;
+    int ret = Map(0, windowed_ ? window_ : file_size_);
+    if (ret == 0 && options.advice != kNormal) ret = Advise(options.advice);
+    if (ret != 0) Close();
+    return ret;
+}
+
+void MappedFile::Close() {
+    Unmap();
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+    writable_ = false;
+    file_size_ = 0;
+    offset_ = 0;
+    windowed_ = false;
+    window_ = 0;
+}
+
+// Map the new range first, so that a failure leaves the old one in place
+int MappedFile::Map(uint64_t offset, size_t length) {
+    if (offset > file_size_) offset = file_size_;
+    if (length > file_size_ - offset) length = file_size_ - offset;
+    uint64_t aligned = offset & ~(uint64_t)(PageSize() - 1);
+    size_t skew = offset - aligned;
+    size_t mapped = length == 0 ? 0 : RoundUpToPage(skew + length);
+    size_t region = mapped;
+    if (writable_ && !windowed_ && options_.reserve > region) {
+        region = RoundUpToPage(options_.reserve);
+    }
+
+    char* addr = nullptr;
+    if (region > 0) {
+        int prot = PROT_READ | (writable_ ? PROT_WRITE : 0);
+        int flags = MAP_SHARED | (options_.populate ? MAP_POPULATE : 0);
+        void* p;
+        if (region > mapped) {
+            p = Reserve(nullptr, region);
+            if (p != MAP_FAILED && mapped > 0 &&
+                mmap(p, mapped, prot, flags | MAP_FIXED, fd_, aligned) ==
+                    MAP_FAILED) {
+                int err = errno;
+                munmap(p, region);
+                errno = err;
+                p = MAP_FAILED;
+            }
+        } else {
+            p = mmap(nullptr, mapped, prot, flags, fd_, aligned);
+        }
+        if (p == MAP_FAILED) return -errno;
+        addr = (char*)p;
+    }
+
+    Unmap();
+    addr_ = addr;
+    skew_ = skew;
+    size_ = length;
+    offset_ = offset;
+    mapped_ = mapped;
+    region_ = region;
+    return 0;
+}
+
+void MappedFile::Unmap() {
+    if (addr_ != nullptr) munmap(addr_, region_);
+    addr_ = nullptr;
+    skew_ = size_ = mapped_ = region_ = 0;
+}
+
+int MappedFile::MapWindow(uint64_t offset, size_t length) {
+    if (fd_ < 0) return -EBADF;
+    windowed_ = true;
+    window_ = length;
+    return Map(offset, length);
+}
+
+int MappedFile::Advise(Advice advice, size_t offset, size_t length) {
+    int madv = ToMadvise(advice);
+    if (madv < 0) return -EINVAL;
+    if (offset >= size_) return 0;
+    if (length == 0 || length > size_ - offset) length = size_ - offset;
+    // madvise() wants a page aligned start
+    size_t beg = (skew_ + offset) & ~(PageSize() - 1);
+    size_t end = skew_ + offset + length;
+    if (madvise(addr_ + beg, end - beg, madv) != 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+// The file is now "file_size" bytes long: follow it with the mapping.
+// The new size, and the switch to windows past max_map, only take effect
+// once the mapping is done.
+int MappedFile::Remap(uint64_t file_size) {
+    uint64_t old_size = file_size_;
+    bool old_windowed = windowed_;
+    size_t old_window = window_;
+    file_size_ = file_size;
+    if (!windowed_ && file_size > options_.max_map) {
+        windowed_ = true;
+        window_ = options_.max_map;
+    }
+    int ret = windowed_ ? Map(offset_, window_) : ResizeMapping(file_size);
+    if (ret != 0) {
+        file_size_ = old_size;
+        windowed_ = old_windowed;
+        window_ = old_window;
+    }
+    return ret;
+}
+
+// Grow or shrink the whole-file mapping in place if the region allows,
+// else map the file again
+int MappedFile::ResizeMapping(uint64_t file_size) {
+    size_t mapped = RoundUpToPage(file_size);
+    if (addr_ == nullptr || mapped > region_) return Map(0, file_size);
+    if (mapped > mapped_) {
+        int prot = PROT_READ | (writable_ ? PROT_WRITE : 0);
+        int flags = MAP_SHARED | MAP_FIXED |
+                    (options_.populate ? MAP_POPULATE : 0);
+        if (mmap(addr_ + mapped_, mapped - mapped_, prot, flags, fd_,
+                 mapped_) == MAP_FAILED) {
+            return -errno;
+        }
+    } else if (mapped < mapped_) {
+        // give the pages past the end back to the reserve
+        if (Reserve(addr_ + mapped, mapped_ - mapped) == MAP_FAILED) {
+            return -errno;
+        }
+    }
+    mapped_ = mapped;
+    size_ = file_size;
+    return 0;
+}
+
+// Never leave pages mapped past the end of the file, where a touch is a
+// SIGBUS: shrink the mapping before the file, grow the file before the
+// mapping, and undo the first step if the second one fails.
+int MappedFile::Resize(uint64_t size) {
+    if (fd_ < 0) return -EBADF;
+    if (!writable_) return -EPERM;
+    uint64_t old_size = file_size_;
+    if (size < old_size) {
+        uint64_t old_offset = offset_;
+        int ret = Remap(size);
+        if (ret != 0) return ret;
+        if (ftruncate(fd_, size) != 0) {
+            ret = -errno;
+            offset_ = old_offset;
+            Remap(old_size);
+            return ret;
+        }
+        return 0;
+    }
+    if (ftruncate(fd_, size) != 0) return -errno;
+    int ret = Remap(size);
+    if (ret != 0 && ftruncate(fd_, old_size) != 0) {
+        // still safe: the file only outgrows the mapping
+    }
+    return ret;
+}
+
+int MappedFile::Refresh() {
+    if (fd_ < 0) return -EBADF;
+    struct stat st;
+    if (fstat(fd_, &st) != 0) return -errno;
+    if ((uint64_t)st.st_size == file_size_) return 0;
+    return Remap(st.st_size);
+}
+
+int MappedFile::Sync(bool async) {
+    if (size_ == 0) return 0;
+    if (msync(addr_, skew_ + size_, async ? MS_ASYNC : MS_SYNC) != 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "slice.h"
+
+namespace cutils {
+
+// A file mapped into memory, its content seen as a Slice so that parsers
+// run over it without a copy:
+//
+//   MappedFile file;
+//   if (file.Open(path) == 0) {
+//       log::Reader reader(file.data());
+//       ...
+//   }
+//
+// Read-write mappings are MAP_SHARED, stores go to the file.  Files larger
+// than Options::max_map are mapped a window at a time, see MapWindow().
+// Not thread safe; Slices of the content are valid until the mapping
+// moves, which Resize() within Options::reserve never does.
+class MappedFile {
+public:
+    enum Advice {
+        kNormal = 0,
+        kSequential = 1,  // aggressive read ahead, pages dropped behind
+        kRandom = 2,      // no read ahead
+        kWillNeed = 3,    // start reading now
+        kDontNeed = 4,    // drop the pages, clean ones are reread later
+        kHugePage = 5,    // transparent huge pages where the fs has them
+    };
+
+    struct Options {
+        bool writable = false;
+        bool create = false;       // with writable, O_CREAT
+        bool populate = false;     // MAP_POPULATE: fault everything in now
+        Advice advice = kNormal;
+
+        // address space budget; larger files are mapped in windows of
+        // this size
+        size_t max_map = ~(size_t)0;
+
+        // writable only: address space reserved (PROT_NONE) after the
+        // mapping, so that growing the file up to this size maps the new
+        // pages in place instead of moving the mapping
+        size_t reserve = 0;
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Return 0 or -errno
+    int Open(const std::string& path) { return Open(path, Options()); }
+    int Open(const std::string& path, const Options& options);
+    void Close();
+
+    bool is_open() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    uint64_t file_size() const { return file_size_; }
+
+    // The mapped bytes: the whole file, or the current window of it
+    Slice data() const { return Slice(addr_ + skew_, size_); }
+    char* mutable_data() const {
+        return writable_ ? addr_ + skew_ : nullptr;
+    }
+    size_t size() const { return size_; }
+    // offset in the file of data()
+    uint64_t offset() const { return offset_; }
+
+    // Map [offset, offset + length) of the file, clipped to its end,
+    // instead of what was mapped.  Slices of the old window become
+    // invalid.  Return 0 or -errno.
+    int MapWindow(uint64_t offset, size_t length);
+
+    // madvise() [offset, offset + length) of data(), to its end if
+    // length is 0.  Return 0 or -errno, -EINVAL for advice the platform
+    // lacks.
+    int Advise(Advice advice, size_t offset = 0, size_t length = 0);
+
+    // Writable only: truncate or extend the file to "size" and remap.
+    // The mapping stays in place while size fits the reserve; a file
+    // grown past Options::max_map is mapped a window at a time from then
+    // on, starting with the window at offset().  The mapping never
+    // reaches past the end of the file, and on failure the file, the
+    // mapping and file_size() are put back as they were.  Return 0 or
+    // -errno.
+    int Resize(uint64_t size);
+
+    // Pick up growth of the file by another writer, as Resize() does
+    // after truncating.  Return 0 or -errno.
+    int Refresh();
+
+    // msync() data(), waiting for the write back unless "async".  Return
+    // 0 or -errno.
+    int Sync(bool async = false);
+
+private:
+    int Map(uint64_t offset, size_t length);
+    int Remap(uint64_t file_size);
+    int ResizeMapping(uint64_t file_size);
+    void Unmap();
+
+    int fd_;
+    bool writable_;
+    Options options_;
+    uint64_t file_size_;
+
+    // The mapping starts at the page boundary at or before offset_;
+    // skew_ is the distance to offset_.  region_ is the address space
+    // owned, the mapped pages and the PROT_NONE reserve after them.
+    char* addr_;
+    size_t skew_;
+    size_t size_;
+    uint64_t offset_;
+    size_t mapped_;
+    size_t region_;
+    bool windowed_;
+    size_t window_;   // length asked for by MapWindow()
+};
+
+} // namespace cutils
@@ -0,0 +1,139 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+
+#include "async_worker.h"
+
+namespace cutils {
+
+uint64_t HistogramSnapshot::Percentile(double p) const {
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)std::ceil(p / 100 * count);
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(Histogram::BucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+void Histogram::Snapshot(HistogramSnapshot* snap) const {
+    snap->count = snap->sum = snap->max = 0;
+    snap->buckets.assign(kBuckets, 0);
+    for (const Shard& s : shards_) {
+        for (int i = 0; i < kBuckets; ++i) {
+            uint64_t n = s.buckets[i].load(std::memory_order_relaxed);
+            snap->buckets[i] += n;
+            snap->count += n;
+        }
+        snap->sum += s.sum.load(std::memory_order_relaxed);
+        snap->max = std::max(snap->max, s.max.load(std::memory_order_relaxed));
+    }
+}
+
+void Histogram::Reset() {
+    for (Shard& s : shards_) {
+        for (auto& b : s.buckets) b.store(0, std::memory_order_relaxed);
+        s.sum.store(0, std::memory_order_relaxed);
+        s.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+int64_t Counter::Value() const {
+    int64_t sum = 0;
+    for (const Cell& c : cells_) sum += c.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+void Counter::Reset() {
+    for (Cell& c : cells_) c.value.store(0, std::memory_order_relaxed);
+}
+
+namespace {
+
+template <typename T>
+T* GetOrCreate(std::map<std::string, std::unique_ptr<T>>* metrics,
+               const std::string& name) {
+    std::unique_ptr<T>& metric = (*metrics)[name];
+    if (!metric) metric.reset(new T);
+    return metric.get();
+}
+
+} // namespace
+
+Histogram* MetricsRegistry::GetHistogram(const std::string& name) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return GetOrCreate(&histograms_, name);
+}
+
+Counter* MetricsRegistry::GetCounter(const std::string& name) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return GetOrCreate(&counters_, name);
+}
+
+Gauge* MetricsRegistry::GetGauge(const std::string& name) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return GetOrCreate(&gauges_, name);
+}
+
+void MetricsRegistry::Dump(std::string* out) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    char line[512];
+    for (auto& it : counters_) {
+        snprintf(line, sizeof(line), "counter %s %ld\n",
+                 it.first.c_str(), (long)it.second->Value());
+        out->append(line);
+    }
+    for (auto& it : gauges_) {
+        snprintf(line, sizeof(line), "gauge %s %ld\n",
+                 it.first.c_str(), (long)it.second->Value());
+        out->append(line);
+    }
+    HistogramSnapshot snap;
+    for (auto& it : histograms_) {
+        it.second->Snapshot(&snap);
+        snprintf(line, sizeof(line),
+                 "histogram %s count %lu mean %.1f p50 %lu p90 %lu p99 %lu "
+                 "p999 %lu max %lu\n",
+                 it.first.c_str(), (unsigned long)snap.count, snap.Mean(),
+                 (unsigned long)snap.Percentile(50),
+                 (unsigned long)snap.Percentile(90),
+                 (unsigned long)snap.Percentile(99),
+                 (unsigned long)snap.Percentile(99.9),
+                 (unsigned long)snap.max);
+        out->append(line);
+    }
+}
+
+bool MetricsRegistry::DumpPeriodically(int period_s, MetricsSink sink) {
+    if (!sink) {
+        sink = [](const std::string& text) { fputs(text.c_str(), stderr); };
+    }
+    CEvent event = [this, sink] {
+        std::string text;
+        Dump(&text);
+        sink(text);
+    };
+    CEventTick* tick = CEventTick::GetInstance();
+    switch (period_s) {
+        case 1: return tick->AddEventPer1s(event);
+        case 10: return tick->AddEventPer10s(event);
+        case 60: return tick->AddEventPer60s(event);
+        default: return false;
+    }
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
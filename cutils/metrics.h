@@ -0,0 +1,197 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "clock.h"
+#include "singleton.h"
+
+namespace cutils {
+
+// Latency histograms, counters and gauges whose hot path is a couple of
+// relaxed atomic adds: no locks, no allocation, no clock reads.  Writers
+// spread over kMetricShards cache-line separated shards picked per thread,
+// readers merge the shards.
+
+const int kMetricShards = 8;
+
+// Shard of the calling thread, assigned round robin on first use
+inline int MetricShard() {
+    static std::atomic<int> next(0);
+    static thread_local int shard = -1;
+    if (shard < 0) shard = next.fetch_add(1) % kMetricShards;
+    return shard;
+}
+
+struct HistogramSnapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::vector<uint64_t> buckets;
+
+    double Mean() const { return count == 0 ? 0 : (double)sum / count; }
+
+    // Value at percentile p in [0, 100], e.g. 99.9: the upper bound of the
+    // bucket holding that rank, capped by max.  0 if empty.
+    uint64_t Percentile(double p) const;
+};
+
+// HDR style log-linear histogram of uint64 values (typically ns): 16
+// linear sub-buckets per power of two, so a reported value is within
+// 1/16 (6.25%) of the recorded one over the whole uint64 range.  Each of
+// the kMetricShards shards is about 8KB.
+class Histogram {
+public:
+    static const int kSubBits = 4;
+    static const int kSubBuckets = 1 << kSubBits;
+    static const int kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    Histogram() { Reset(); }
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void Record(uint64_t v, uint64_t count = 1) {
+        Shard& s = shards_[MetricShard()];
+        s.buckets[BucketIndex(v)].fetch_add(count, std::memory_order_relaxed);
+        s.sum.fetch_add(v * count, std::memory_order_relaxed);
+        uint64_t max = s.max.load(std::memory_order_relaxed);
+        while (v > max && !s.max.compare_exchange_weak(
+                    max, v, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Merge all shards into *snap
+    void Snapshot(HistogramSnapshot* snap) const;
+
+    // Not atomic with respect to concurrent Record()s
+    void Reset();
+
+    // Values below kSubBuckets get a bucket each, then every power of two
+    // [2^k, 2^(k+1)) is split into kSubBuckets equal parts
+    static int BucketIndex(uint64_t v) {
+        if (v < (uint64_t)kSubBuckets) return v;
+        int shift = 63 - __builtin_clzll(v) - kSubBits;
+        return ((shift + 1) << kSubBits) + ((v >> shift) & (kSubBuckets - 1));
+    }
+
+    static uint64_t BucketLowerBound(int index) {
+        int group = index >> kSubBits;
+        uint64_t sub = index & (kSubBuckets - 1);
+        if (group == 0) return sub;
+        return (kSubBuckets + sub) << (group - 1);
+    }
+
+    static uint64_t BucketUpperBound(int index) {
+        int group = index >> kSubBits;
+        if (group == 0) return index;
+        return BucketLowerBound(index) + (1ULL << (group - 1)) - 1;
+    }
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> buckets[kBuckets];
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+        char pad[64];
+    };
+
+    Shard shards_[kMetricShards];
+};
+
+class Counter {
+public:
+    Counter() { Reset(); }
+
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    void Add(int64_t n = 1) {
+        cells_[MetricShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    int64_t Value() const;
+    void Reset();
+
+private:
+    struct Cell {
+        std::atomic<int64_t> value;
+        char pad[64 - sizeof(std::atomic<int64_t>)];
+    };
+
+    Cell cells_[kMetricShards];
+};
+
+class Gauge {
+public:
+    Gauge() : value_(0) {}
+
+    Gauge(const Gauge&) = delete;
+    Gauge& operator=(const Gauge&) = delete;
+
+    void Set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void Add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_;
+};
+
+// Record the lifetime of the object, in ns, into a histogram
+class ScopedLatency {
+public:
+    explicit ScopedLatency(Histogram* hist)
+        : hist_(hist), begin_(MonotonicNanos()) {}
+
+    ~ScopedLatency() { hist_->Record(MonotonicNanos() - begin_); }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    Histogram* hist_;
+    uint64_t begin_;
+};
+
+using MetricsSink = std::function<void(const std::string&)>;
+
+// Process wide metrics by name.  The Get... calls take a lock and create
+// the metric on first use; keep the returned pointer, it stays valid for
+// the life of the process.
+//
+//   static Histogram* latency =
+//       MetricsRegistry::GetInstance()->GetHistogram("rpc.latency_ns");
+//   ScopedLatency sl(latency);
+class MetricsRegistry : public Singleton<MetricsRegistry> {
+public:
+    Histogram* GetHistogram(const std::string& name);
+    Counter* GetCounter(const std::string& name);
+    Gauge* GetGauge(const std::string& name);
+
+    // Append one line per metric, sorted by name within each kind:
+    //   counter <name> <value>
+    //   gauge <name> <value>
+    //   histogram <name> count <n> mean <v> p50 <v> p90 <v> p99 <v>
+    //       p999 <v> max <v>
+    void Dump(std::string* out);
+
+    // Dump every period_s (1, 10 or 60) seconds from CEventTick, to stderr
+    // if sink is null.  Like the CEventTick events it must be called
+    // before CEventTick::Start(); return false otherwise or for another
+    // period.
+    bool DumpPeriodically(int period_s, MetricsSink sink = nullptr);
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms_;
+    std::map<std::string, std::unique_ptr<Counter>> counters_;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges_;
+};
+
+} // namespace cutils
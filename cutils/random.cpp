@@ -1,14 +1,200 @@
 #include "random.h"
 
+#include <cassert>
+#include <mutex>
 #include <random>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CUTILS_RANDOM_AVX2 1
+#endif
+
 namespace cutils {
 
+void Xoshiro256pp::JumpWith(const uint64_t* poly) {
+    uint64_t s[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; ++i) {
+        for (int b = 0; b < 64; ++b) {
+            if (poly[i] & (1ULL << b)) {
+                for (int j = 0; j < 4; ++j) s[j] ^= s_[j];
+            }
+            Next();
+        }
+    }
+    memcpy(s_, s, sizeof(s_));
+}
+
+void Xoshiro256pp::Jump() {
+    static const uint64_t kJump[4] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL,
+    };
+    JumpWith(kJump);
+}
+
+void Xoshiro256pp::LongJump() {
+    static const uint64_t kLongJump[4] = {
+        0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+        0x77710069854ee241ULL, 0x39109bb02acbe635ULL,
+    };
+    JumpWith(kLongJump);
+}
+
+void Pcg64::Advance(unsigned __int128 delta) {
+    // fold delta steps of x -> m x + c into one (m', c') by squaring
+    unsigned __int128 mult = Multiplier();
+    unsigned __int128 plus = inc_;
+    unsigned __int128 acc_mult = 1;
+    unsigned __int128 acc_plus = 0;
+    while (delta > 0) {
+        if (delta & 1) {
+            acc_mult *= mult;
+            acc_plus = acc_plus * mult + plus;
+        }
+        plus = (mult + 1) * plus;
+        mult *= mult;
+        delta >>= 1;
+    }
+    state_ = acc_mult * state_ + acc_plus;
+}
+
+namespace {
+
+bool HasAVX2() {
+#ifdef CUTILS_RANDOM_AVX2
+    static const bool ok = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return ok;
+#else
+    return false;
+#endif
+}
+
+// One step of the four streams, as Xoshiro256pp::Next() lane by lane
+inline void StepX4(uint64_t s[4][4], uint64_t out[4]) {
+    for (int i = 0; i < 4; ++i) {
+        uint64_t x = s[0][i] + s[3][i];
+        out[i] = ((x << 23) | (x >> 41)) + s[0][i];
+        uint64_t t = s[1][i] << 17;
+        s[2][i] ^= s[0][i];
+        s[3][i] ^= s[1][i];
+        s[1][i] ^= s[2][i];
+        s[0][i] ^= s[3][i];
+        s[2][i] ^= t;
+        s[3][i] = (s[3][i] << 45) | (s[3][i] >> 19);
+    }
+}
+
+// Write "steps" steps, 32 bytes each, to out
+void FillX4Generic(uint64_t s[4][4], char* out, size_t steps) {
+    uint64_t v[4];
+    for (size_t i = 0; i < steps; ++i, out += 32) {
+        StepX4(s, v);
+        memcpy(out, v, 32);
+    }
+}
+
+#ifdef CUTILS_RANDOM_AVX2
+__attribute__((target("avx2")))
+inline __m256i Rotl64x4(__m256i x, int k) {
+    return _mm256_or_si256(_mm256_slli_epi64(x, k),
+                           _mm256_srli_epi64(x, 64 - k));
+}
+
+__attribute__((target("avx2")))
+void FillX4AVX2(uint64_t s[4][4], char* out, size_t steps) {
+    __m256i s0 = _mm256_loadu_si256((const __m256i*)s[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i*)s[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i*)s[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i*)s[3]);
+    for (size_t i = 0; i < steps; ++i, out += 32) {
+        __m256i res = _mm256_add_epi64(
+                Rotl64x4(_mm256_add_epi64(s0, s3), 23), s0);
+        _mm256_storeu_si256((__m256i*)out, res);
+        __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = Rotl64x4(s3, 45);
+    }
+    _mm256_storeu_si256((__m256i*)s[0], s0);
+    _mm256_storeu_si256((__m256i*)s[1], s1);
+    _mm256_storeu_si256((__m256i*)s[2], s2);
+    _mm256_storeu_si256((__m256i*)s[3], s3);
+}
+#endif
+
+Xoshiro256pp NewThreadRand() {
+    static std::mutex mutex;
+    static Xoshiro256pp* process_rand = nullptr;
+    std::lock_guard<std::mutex> guard(mutex);
+    if (process_rand == nullptr) {
+        std::random_device rd;
+        uint64_t seed = ((uint64_t)rd() << 32) | rd();
+        process_rand = new Xoshiro256pp(seed);
+    }
+    return process_rand->Split();
+}
+
+} // namespace
+
+Xoshiro256ppX4::Xoshiro256ppX4(uint64_t seed) {
+    Xoshiro256pp source(seed);
+    for (int i = 0; i < 4; ++i) {
+        Xoshiro256pp stream = source.Split();
+        for (int w = 0; w < 4; ++w) {
+            s_[w][i] = stream.s_[w];
+        }
+    }
+}
+
+void Xoshiro256ppX4::Fill(void* buf, size_t n) {
+    char* out = (char*)buf;
+    size_t steps = n / 32;
+#ifdef CUTILS_RANDOM_AVX2
+    if (HasAVX2()) {
+        FillX4AVX2(s_, out, steps);
+    } else {
+        FillX4Generic(s_, out, steps);
+    }
+#else
+    FillX4Generic(s_, out, steps);
+#endif
+    size_t rest = n % 32;
+    if (rest > 0) {
+        uint64_t v[4];
+        StepX4(s_, v);
+        memcpy(out + steps * 32, v, rest);
+    }
+}
+
+void Xoshiro256ppX4::FillDouble(double* out, size_t n) {
+    Fill((void*)out, n * 8);
+    // 52 random bits as the mantissa of a double in [1, 2)
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t v;
+        memcpy(&v, &out[i], 8);
+        v = (v >> 12) | 0x3ff0000000000000ULL;
+        memcpy(&out[i], &v, 8);
+        out[i] -= 1.0;
+    }
+}
+
+bool IsRandomSimdSupported() {
+    return HasAVX2();
+}
+
+Xoshiro256pp& ThreadRand() {
+    static thread_local Xoshiro256pp rand = NewThreadRand();
+    return rand;
+}
+
 int DeviceRand() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> dis(0);
-    return dis(gen);
+    return ThreadRand().Next() >> 33;
 }
 
 int GenFastRandSeed() {
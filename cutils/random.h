@@ -1,15 +1,225 @@
 #pragma once
 
+#include <stdint.h>
+#include <string.h>
 #include <string>
 #include "slice.h"
 
 namespace cutils {
 
-// return in [0, 2^31)
+// return in [0, 2^31), from the calling thread's ThreadRand()
 int DeviceRand();
 int GenFastRandSeed();
 int FastRand(int seed);
 
+// 64-bit generators.  Each is a UniformRandomBitGenerator, so it also
+// works with the <random> distributions and std::shuffle, and gets from
+// RandomBase:
+//
+//   Uniform(n)       unbiased in [0, n) by Lemire's multiply-shift method,
+//                    at most one division and usually none
+//   Range(lo, hi)    unbiased in [lo, hi]
+//   NextDouble()     in [0, 1) with 53 random bits
+//   Fill(buf, n)     n random bytes
+//
+// None of them is cryptographic.
+
+// Step of the SplitMix64 generator, used to seed the others: every
+// call returns a well mixed value even from a poor seed
+inline uint64_t SplitMix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+template <typename Gen>
+class RandomBase {
+public:
+    using result_type = uint64_t;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~0ULL; }
+
+    result_type operator()() { return self().Next(); }
+
+    // [0, n); a full 64-bit value when n is 0
+    uint64_t Uniform(uint64_t n) {
+        uint64_t x = self().Next();
+        if (n == 0) return x;
+        unsigned __int128 m = (unsigned __int128)x * n;
+        uint64_t low = (uint64_t)m;
+        if (low < n) {
+            // reject the 2^64 mod n values that would favour some results
+            uint64_t threshold = -n % n;
+            while (low < threshold) {
+                x = self().Next();
+                m = (unsigned __int128)x * n;
+                low = (uint64_t)m;
+            }
+        }
+        return m >> 64;
+    }
+
+    // [lo, hi]
+    int64_t Range(int64_t lo, int64_t hi) {
+        return lo + Uniform((uint64_t)hi - (uint64_t)lo + 1);
+    }
+
+    double NextDouble() {
+        return (self().Next() >> 11) * (1.0 / 9007199254740992.0); // 2^-53
+    }
+
+    void Fill(void* buf, size_t n) {
+        char* p = (char*)buf;
+        for (; n >= 8; p += 8, n -= 8) {
+            uint64_t x = self().Next();
+            memcpy(p, &x, 8);
+        }
+        if (n > 0) {
+            uint64_t x = self().Next();
+            memcpy(p, &x, n);
+        }
+    }
+
+private:
+    Gen& self() { return static_cast<Gen&>(*this); }
+};
+
+// xoshiro256++ (Blackman and Vigna): 256 bits of state, period 2^256 - 1.
+// Jump() advances by 2^128 steps, so repeatedly jumped copies give up to
+// 2^128 non overlapping streams.
+class Xoshiro256pp : public RandomBase<Xoshiro256pp> {
+public:
+    explicit Xoshiro256pp(uint64_t seed = 0) { Seed(seed); }
+
+    void Seed(uint64_t seed) {
+        for (auto& s : s_) s = SplitMix64(&seed);
+    }
+
+    uint64_t Next() {
+        uint64_t result = Rotl(s_[0] + s_[3], 23) + s_[0];
+        uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = Rotl(s_[3], 45);
+        return result;
+    }
+
+    // Advance by 2^128 / 2^192 steps
+    void Jump();
+    void LongJump();
+
+    // Return a generator for the next 2^128 values and jump past them
+    Xoshiro256pp Split() {
+        Xoshiro256pp res = *this;
+        Jump();
+        return res;
+    }
+
+private:
+    static uint64_t Rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    void JumpWith(const uint64_t* poly);
+
+    friend class Xoshiro256ppX4;
+    uint64_t s_[4];
+};
+
+// Four xoshiro256++ streams stepped together for bulk output, with an
+// AVX2 kernel when the CPU has one.  The output does not depend on the
+// kernel: each step yields one value of every stream, stream 0 first.
+// A fill whose size is not a multiple of 32 bytes throws away the rest of
+// its last step.
+class Xoshiro256ppX4 {
+public:
+    // Stream i continues the i-th Split() of Xoshiro256pp(seed)
+    explicit Xoshiro256ppX4(uint64_t seed = 0);
+
+    void Fill(void* buf, size_t n);
+    void Fill(uint64_t* out, size_t n) { Fill((void*)out, n * 8); }
+    void Fill(uint32_t* out, size_t n) { Fill((void*)out, n * 4); }
+    // in [0, 1) with 52 random bits
+    void FillDouble(double* out, size_t n);
+
+private:
+    uint64_t s_[4][4]; // s_[word][stream]
+};
+
+// Whether Xoshiro256ppX4 runs its AVX2 kernel
+bool IsRandomSimdSupported();
+
+// wyrand (Wang Yi): 64 bits of state, one multiply per value; the fastest
+// here but with period only 2^64 and no jump.  Split() seeds a new
+// generator from this one.
+class WyRand : public RandomBase<WyRand> {
+public:
+    explicit WyRand(uint64_t seed = 0) : state_(seed) {}
+
+    uint64_t Next() {
+        state_ += 0xa0761d6478bd642fULL;
+        unsigned __int128 m =
+            (unsigned __int128)state_ * (state_ ^ 0xe7037ed1a0b428dbULL);
+        return (uint64_t)(m >> 64) ^ (uint64_t)m;
+    }
+
+    WyRand Split() { return WyRand(Next()); }
+
+private:
+    uint64_t state_;
+};
+
+// PCG64 (O'Neill), XSL RR output on a 128-bit LCG.  Generators with
+// different streams give different sequences from the same seed, and
+// Advance() skips ahead in O(log delta).
+class Pcg64 : public RandomBase<Pcg64> {
+public:
+    explicit Pcg64(uint64_t seed = 0, uint64_t stream = 0) {
+        Seed(seed, stream);
+    }
+
+    void Seed(uint64_t seed, uint64_t stream = 0) {
+        inc_ = ((unsigned __int128)stream << 1) | 1;
+        state_ = 0;
+        Next();
+        state_ += seed;
+        Next();
+    }
+
+    uint64_t Next() {
+        state_ = state_ * Multiplier() + inc_;
+        uint64_t xsl = (uint64_t)(state_ >> 64) ^ (uint64_t)state_;
+        int rot = state_ >> 122;
+        return (xsl >> rot) | (xsl << ((-rot) & 63));
+    }
+
+    void Advance(unsigned __int128 delta);
+
+    // A generator on another stream, seeded from this one
+    Pcg64 Split() {
+        uint64_t seed = Next();
+        return Pcg64(seed, Next());
+    }
+
+private:
+    static unsigned __int128 Multiplier() {
+        return ((unsigned __int128)0x2360ed051fc65da4ULL << 64) |
+               0x4385df649fccf645ULL;
+    }
+
+    unsigned __int128 state_;
+    unsigned __int128 inc_;
+};
+
+// The calling thread's generator.  Threads take consecutive Split()s of
+// a process generator seeded from std::random_device, so their streams
+// never overlap.
+Xoshiro256pp& ThreadRand();
+
 class StrRand {
 private:
     int max_len_;
@@ -3,6 +3,7 @@
 #include <ctype.h>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -101,8 +102,26 @@ inline bool operator!=(const Slice& x, const Slice& y) {
     return !(x == y);
 }
 
+inline bool operator<(const Slice& x, const Slice& y) {
+    return x.compare(y) < 0;
+}
+
 inline int Slice::compare(const Slice& b) const {
     const size_t min_len = (size_ < b.size_) ? size_ : b.size_;
+    // Encoded keys mostly differ in their first 8 bytes, settle those with
+    // one big endian word compare before calling memcmp
+    if (min_len >= 8) {
+        uint64_t x, y;
+        memcpy(&x, data_, sizeof(x));
+        memcpy(&y, b.data_, sizeof(y));
+        if (x != y) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            x = __builtin_bswap64(x);
+            y = __builtin_bswap64(y);
+#endif
+            return x < y ? -1 : +1;
+        }
+    }
     int r = memcmp(data_, b.data_, min_len);
     if (r == 0) {
         if (size_ < b.size_) r = -1;
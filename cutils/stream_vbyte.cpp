@@ -0,0 +1,372 @@
+#include "stream_vbyte.h"
+
+#include <cassert>
+
+#include "coding.h"
+
+#if defined(__x86_64__)
+#include <tmmintrin.h>
+#define CUTILS_STREAM_VBYTE_SIMD 1
+#endif
+
+namespace cutils {
+
+namespace {
+
+struct StreamVByteTables {
+    // uint32: data length of the 4 values described by a control byte,
+    // and the pshufb mask moving them into 4 x 32 bit lanes
+    uint8_t len32[256];
+    uint8_t shuf32[256][16];
+    // uint64: same for 2 values and 2 x 64 bit lanes, len64 is 0 when
+    // the control byte holds a length above 8
+    uint8_t len64[256];
+    uint8_t shuf64[256][16];
+
+    StreamVByteTables() {
+        for (int c = 0; c < 256; ++c) {
+            int off = 0;
+            for (int k = 0; k < 4; ++k) {
+                int len = ((c >> (k * 2)) & 3) + 1;
+                for (int j = 0; j < 4; ++j) {
+                    shuf32[c][k * 4 + j] = j < len ? off + j : 0xff;
+                }
+                off += len;
+            }
+            len32[c] = off;
+
+            off = 0;
+            bool valid = true;
+            for (int k = 0; k < 2; ++k) {
+                int code = (c >> (k * 4)) & 15;
+                valid = valid && code < 8;
+                int len = (code & 7) + 1;
+                for (int j = 0; j < 8; ++j) {
+                    shuf64[c][k * 8 + j] = j < len ? off + j : 0xff;
+                }
+                off += len;
+            }
+            len64[c] = valid ? off : 0;
+        }
+    }
+};
+
+const StreamVByteTables& GetTables() {
+    static const StreamVByteTables tables;
+    return tables;
+}
+
+bool HasSSSE3() {
+#ifdef CUTILS_STREAM_VBYTE_SIMD
+    static const bool ok = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") != 0;
+    }();
+    return ok;
+#else
+    return false;
+#endif
+}
+
+inline int Code32(uint32_t v) { return (31 - __builtin_clz(v | 1)) >> 3; }
+inline int Code64(uint64_t v) { return (63 - __builtin_clzll(v | 1)) >> 3; }
+
+template <typename T>
+inline T LoadBytes(const uint8_t* p, int len) {
+    T v = 0;
+    for (int j = len - 1; j >= 0; --j) {
+        v = (v << 8) | p[j];
+    }
+    return v;
+}
+
+template <bool kDelta>
+size_t Encode32(const uint32_t* in, size_t n, char* out, uint32_t prev) {
+    size_t ctrl_len = (n + 3) / 4;
+    uint8_t* ctrl = reinterpret_cast<uint8_t*>(out);
+    char* data = out + ctrl_len;
+    memset(ctrl, 0, ctrl_len);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t v = in[i];
+        if (kDelta) {
+            v = in[i] - prev;
+            prev = in[i];
+        }
+        int code = Code32(v);
+        ctrl[i >> 2] |= code << ((i & 3) * 2);
+        // always 4 bytes, the cursor only moves by the real length
+        EncodeFixed32(data, v);
+        data += code + 1;
+    }
+    return data - out;
+}
+
+template <bool kDelta>
+size_t Encode64(const uint64_t* in, size_t n, char* out, uint64_t prev) {
+    size_t ctrl_len = (n + 1) / 2;
+    uint8_t* ctrl = reinterpret_cast<uint8_t*>(out);
+    char* data = out + ctrl_len;
+    memset(ctrl, 0, ctrl_len);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t v = in[i];
+        if (kDelta) {
+            v = in[i] - prev;
+            prev = in[i];
+        }
+        int code = Code64(v);
+        ctrl[i >> 1] |= code << ((i & 1) * 4);
+        EncodeFixed64(data, v);
+        data += code + 1;
+    }
+    return data - out;
+}
+
+#ifdef CUTILS_STREAM_VBYTE_SIMD
+// Decode whole control bytes while 16 bytes can be loaded from "data".
+// Return the new data cursor, *done is the number of control bytes used.
+template <bool kDelta>
+__attribute__((target("ssse3")))
+const uint8_t* DecodeSimd32(const StreamVByteTables& t, const uint8_t* ctrl,
+                            const uint8_t* data, const uint8_t* limit,
+                            uint32_t* out, size_t full, size_t* done,
+                            uint32_t* prev) {
+    __m128i last = _mm_set1_epi32(*prev);
+    size_t i = 0;
+    for (; i < full && limit - data >= 16; ++i) {
+        uint8_t c = ctrl[i];
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        __m128i m = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(t.shuf32[c]));
+        __m128i v = _mm_shuffle_epi8(d, m);
+        if (kDelta) {
+            // prefix sum of the 4 lanes plus the previous value
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi32(v, last);
+            last = _mm_shuffle_epi32(v, 0xff);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), v);
+        data += t.len32[c];
+    }
+    *done = i;
+    *prev = _mm_cvtsi128_si32(last);
+    return data;
+}
+
+template <bool kDelta>
+__attribute__((target("ssse3")))
+const uint8_t* DecodeSimd64(const StreamVByteTables& t, const uint8_t* ctrl,
+                            const uint8_t* data, const uint8_t* limit,
+                            uint64_t* out, size_t full, size_t* done,
+                            uint64_t* prev) {
+    __m128i last = _mm_set1_epi64x(*prev);
+    size_t i = 0;
+    for (; i < full && limit - data >= 16; ++i) {
+        uint8_t c = ctrl[i];
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        __m128i m = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(t.shuf64[c]));
+        __m128i v = _mm_shuffle_epi8(d, m);
+        if (kDelta) {
+            v = _mm_add_epi64(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi64(v, last);
+            last = _mm_unpackhi_epi64(v, v);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2), v);
+        data += t.len64[c];
+    }
+    *done = i;
+    *prev = _mm_cvtsi128_si64(last);
+    return data;
+}
+#endif
+
+template <bool kDelta>
+const char* Decode32(const char* p, const char* limit, uint32_t* out,
+                     size_t n, uint32_t prev) {
+    const StreamVByteTables& t = GetTables();
+    size_t ctrl_len = (n + 3) / 4;
+    if (static_cast<size_t>(limit - p) < ctrl_len) return nullptr;
+
+    const uint8_t* ctrl = reinterpret_cast<const uint8_t*>(p);
+    const uint8_t* data = ctrl + ctrl_len;
+    size_t full = n / 4;
+    size_t data_len = 0;
+    for (size_t i = 0; i < full; ++i) {
+        data_len += t.len32[ctrl[i]];
+    }
+    for (size_t k = full * 4; k < n; ++k) {
+        data_len += ((ctrl[k >> 2] >> ((k & 3) * 2)) & 3) + 1;
+    }
+    if (static_cast<size_t>(limit - p) - ctrl_len < data_len) return nullptr;
+    const uint8_t* end = data + data_len;
+
+    size_t done = 0;
+#ifdef CUTILS_STREAM_VBYTE_SIMD
+    if (HasSSSE3()) {
+        data = DecodeSimd32<kDelta>(t, ctrl, data,
+                reinterpret_cast<const uint8_t*>(limit),
+                out, full, &done, &prev);
+    }
+#endif
+    for (size_t k = done * 4; k < n; ++k) {
+        int len = ((ctrl[k >> 2] >> ((k & 3) * 2)) & 3) + 1;
+        uint32_t v = LoadBytes<uint32_t>(data, len);
+        data += len;
+        if (kDelta) {
+            v += prev;
+            prev = v;
+        }
+        out[k] = v;
+    }
+    assert(data == end);
+    return reinterpret_cast<const char*>(end);
+}
+
+template <bool kDelta>
+const char* Decode64(const char* p, const char* limit, uint64_t* out,
+                     size_t n, uint64_t prev) {
+    const StreamVByteTables& t = GetTables();
+    size_t ctrl_len = (n + 1) / 2;
+    if (static_cast<size_t>(limit - p) < ctrl_len) return nullptr;
+
+    const uint8_t* ctrl = reinterpret_cast<const uint8_t*>(p);
+    const uint8_t* data = ctrl + ctrl_len;
+    size_t full = n / 2;
+    size_t data_len = 0;
+    for (size_t i = 0; i < full; ++i) {
+        if (t.len64[ctrl[i]] == 0) return nullptr;
+        data_len += t.len64[ctrl[i]];
+    }
+    if (n & 1) {
+        int code = ctrl[full] & 15;
+        if (code >= 8) return nullptr;
+        data_len += code + 1;
+    }
+    if (static_cast<size_t>(limit - p) - ctrl_len < data_len) return nullptr;
+    const uint8_t* end = data + data_len;
+
+    size_t done = 0;
+#ifdef CUTILS_STREAM_VBYTE_SIMD
+    if (HasSSSE3()) {
+        data = DecodeSimd64<kDelta>(t, ctrl, data,
+                reinterpret_cast<const uint8_t*>(limit),
+                out, full, &done, &prev);
+    }
+#endif
+    for (size_t k = done * 2; k < n; ++k) {
+        int len = ((ctrl[k >> 1] >> ((k & 1) * 4)) & 7) + 1;
+        uint64_t v = LoadBytes<uint64_t>(data, len);
+        data += len;
+        if (kDelta) {
+            v += prev;
+            prev = v;
+        }
+        out[k] = v;
+    }
+    assert(data == end);
+    return reinterpret_cast<const char*>(end);
+}
+
+} // namespace
+
+size_t StreamVByteEncode32(const uint32_t* in, size_t n, char* out) {
+    return Encode32<false>(in, n, out, 0);
+}
+
+size_t StreamVByteEncode64(const uint64_t* in, size_t n, char* out) {
+    return Encode64<false>(in, n, out, 0);
+}
+
+size_t StreamVByteEncodeDelta32(const uint32_t* in, size_t n, char* out,
+                                uint32_t prev) {
+    return Encode32<true>(in, n, out, prev);
+}
+
+size_t StreamVByteEncodeDelta64(const uint64_t* in, size_t n, char* out,
+                                uint64_t prev) {
+    return Encode64<true>(in, n, out, prev);
+}
+
+const char* StreamVByteDecode32(const char* p, const char* limit,
+                                uint32_t* out, size_t n) {
+    return Decode32<false>(p, limit, out, n, 0);
+}
+
+const char* StreamVByteDecode64(const char* p, const char* limit,
+                                uint64_t* out, size_t n) {
+    return Decode64<false>(p, limit, out, n, 0);
+}
+
+const char* StreamVByteDecodeDelta32(const char* p, const char* limit,
+                                     uint32_t* out, size_t n, uint32_t prev) {
+    return Decode32<true>(p, limit, out, n, prev);
+}
+
+const char* StreamVByteDecodeDelta64(const char* p, const char* limit,
+                                     uint64_t* out, size_t n, uint64_t prev) {
+    return Decode64<true>(p, limit, out, n, prev);
+}
+
+void PutStreamVByte32(std::string* dst, const uint32_t* in, size_t n,
+                      bool delta) {
+    PutVarint32(dst, n);
+    size_t old_size = dst->size();
+    dst->resize(old_size + StreamVByteMaxLength32(n));
+    char* out = &(*dst)[old_size];
+    size_t len = delta ? Encode32<true>(in, n, out, 0)
+                       : Encode32<false>(in, n, out, 0);
+    dst->resize(old_size + len);
+}
+
+void PutStreamVByte64(std::string* dst, const uint64_t* in, size_t n,
+                      bool delta) {
+    PutVarint32(dst, n);
+    size_t old_size = dst->size();
+    dst->resize(old_size + StreamVByteMaxLength64(n));
+    char* out = &(*dst)[old_size];
+    size_t len = delta ? Encode64<true>(in, n, out, 0)
+                       : Encode64<false>(in, n, out, 0);
+    dst->resize(old_size + len);
+}
+
+bool GetStreamVByte32(Slice* input, std::vector<uint32_t>* out, bool delta) {
+    Slice in = *input;
+    uint32_t n = 0;
+    // every value takes at least one byte
+    if (!GetVarint32(&in, &n) || n > in.size()) return false;
+    out->resize(n);
+    const char* limit = in.data() + in.size();
+    const char* q = delta ? Decode32<true>(in.data(), limit, out->data(), n, 0)
+                          : Decode32<false>(in.data(), limit, out->data(), n, 0);
+    if (q == nullptr) return false;
+    *input = Slice(q, limit - q);
+    return true;
+}
+
+bool GetStreamVByte64(Slice* input, std::vector<uint64_t>* out, bool delta) {
+    Slice in = *input;
+    uint32_t n = 0;
+    if (!GetVarint32(&in, &n) || n > in.size()) return false;
+    out->resize(n);
+    const char* limit = in.data() + in.size();
+    const char* q = delta ? Decode64<true>(in.data(), limit, out->data(), n, 0)
+                          : Decode64<false>(in.data(), limit, out->data(), n, 0);
+    if (q == nullptr) return false;
+    *input = Slice(q, limit - q);
+    return true;
+}
+
+bool IsStreamVByteSimdSupported() {
+    return HasSSSE3();
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
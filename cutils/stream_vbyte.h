@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "slice.h"
+
+namespace cutils {
+
+// Stream VByte integer coding (Lemire, Kurz, Rupp).
+//
+// Unlike the LevelDB varint format in coding.h, the lengths are kept apart
+// from the data so that four (or two) values can be decoded with a single
+// shuffle:
+//
+//   uint32: (n + 3) / 4 control bytes, 2 bits per value (byte length - 1),
+//           followed by 1-4 little endian data bytes per value.
+//   uint64: (n + 1) / 2 control bytes, 4 bits per value (byte length - 1),
+//           followed by 1-8 little endian data bytes per value.
+//
+// The count "n" is not part of the encoding; the caller has to keep it,
+// or use the PutStreamVByte... / GetStreamVByte... helpers which prefix it
+// as a varint32.
+//
+// The Delta variants store in[i] - in[i - 1] (with in[-1] = "prev") and are
+// meant for sorted input such as posting lists and offset arrays.
+//
+// Decoding uses SSSE3 when the host supports it, the encoded format does
+// not depend on it.
+
+// Max number of bytes needed to encode "n" values
+inline size_t StreamVByteMaxLength32(size_t n) { return (n + 3) / 4 + n * 4; }
+inline size_t StreamVByteMaxLength64(size_t n) { return (n + 1) / 2 + n * 8; }
+
+// Encode in[0,n-1] into "out" and return the number of bytes written.
+// REQUIRES: out has StreamVByteMaxLength32/64(n) bytes of space
+size_t StreamVByteEncode32(const uint32_t* in, size_t n, char* out);
+size_t StreamVByteEncode64(const uint64_t* in, size_t n, char* out);
+size_t StreamVByteEncodeDelta32(const uint32_t* in, size_t n, char* out,
+                                uint32_t prev = 0);
+size_t StreamVByteEncodeDelta64(const uint64_t* in, size_t n, char* out,
+                                uint64_t prev = 0);
+
+// Decode "n" values from [p..limit-1] into out[0,n-1].  Return a pointer
+// just past the encoded data, or nullptr if the input is truncated or
+// malformed.
+const char* StreamVByteDecode32(const char* p, const char* limit,
+                                uint32_t* out, size_t n);
+const char* StreamVByteDecode64(const char* p, const char* limit,
+                                uint64_t* out, size_t n);
+const char* StreamVByteDecodeDelta32(const char* p, const char* limit,
+                                     uint32_t* out, size_t n,
+                                     uint32_t prev = 0);
+const char* StreamVByteDecodeDelta64(const char* p, const char* limit,
+                                     uint64_t* out, size_t n,
+                                     uint64_t prev = 0);
+
+// Append varint32(n) + the encoding of in[0,n-1] to *dst
+void PutStreamVByte32(std::string* dst, const uint32_t* in, size_t n,
+                      bool delta = false);
+void PutStreamVByte64(std::string* dst, const uint64_t* in, size_t n,
+                      bool delta = false);
+
+// Parse what PutStreamVByte... wrote and advance *input past it
+bool GetStreamVByte32(Slice* input, std::vector<uint32_t>* out,
+                      bool delta = false);
+bool GetStreamVByte64(Slice* input, std::vector<uint64_t>* out,
+                      bool delta = false);
+
+// Whether the decoders run the SIMD kernel on this host
+bool IsStreamVByteSimdSupported();
+
+} // namespace cutils
@@ -12,14 +12,16 @@ int main() {
     AsyncSeqTaskProfiler profiler;
     profiler.concur = 4;
     profiler.max_seq = 1200;
-    profiler.beg_ts = time(0);
-    profiler.end_ts = time(0) + 1000;
+    profiler.beg_ts = MonotonicMillis();
+    profiler.end_ts = profiler.beg_ts + 1000;
     profiler.worker_beg_ts.resize(4);
     profiler.worker_end_ts.resize(4);
+    profiler.worker_handle.resize(4);
     profiler.task_runtime.resize(1200);
     for (int i = 0; i < 4; ++i) {
         profiler.worker_beg_ts[i] = 100000 * i + 3;
         profiler.worker_end_ts[i] = 100000 * i + 100;
+        profiler.worker_handle[i] = 300;
     }
     for (int i = 0; i < 1200; ++i) {
         profiler.task_runtime[i] = i + 1;
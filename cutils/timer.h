@@ -1,18 +1,23 @@
 #pragma once
 
 #include <poll.h>
+#include <stdint.h>
 #include <sys/time.h>
 #include <string>
 #include <sstream>
 #include <time.h>
 #include <vector>
 
+#include "clock.h"
+
 namespace cutils {
 
+// Interval timers below run on CLOCK_MONOTONIC (see clock.h), so they
+// are not thrown off when the wall clock is stepped.
 class StopWatch {
 private:
-	struct timeval m_startTime;
-	struct timeval m_lastTime;
+    uint64_t m_startTime;
+    uint64_t m_lastTime;
     std::vector<uint32_t> m_vec;
 
 public:
@@ -22,23 +27,19 @@ public:
     }
 
     inline void Clear() {
-        gettimeofday(&m_startTime, nullptr);
+        m_startTime = MonotonicNanos();
         m_lastTime = m_startTime;
         m_vec.clear();
     }
 
 	inline void Stop() {
-        struct timeval t;
-        gettimeofday(&t, nullptr);
-        int diff = (t.tv_sec - m_lastTime.tv_sec) * 1000 + 
-            (t.tv_usec - m_lastTime.tv_usec) / 1000;
-        m_vec.push_back(diff);
+        uint64_t t = MonotonicNanos();
+        m_vec.push_back((t - m_lastTime) / 1000000);
         m_lastTime = t;
     }
 
     inline int Cost() {
-        return (m_lastTime.tv_sec - m_startTime.tv_sec) * 1000 +
-            (m_lastTime.tv_usec - m_startTime.tv_usec) / 1000;
+        return (m_lastTime - m_startTime) / 1000000;
     }
 
     inline std::string Format() {
@@ -53,25 +54,26 @@ public:
 
 class TimeDiff {
 private:
-	struct timeval m_startTime;
-	struct timeval m_endTime;
+    uint64_t m_startTime;
+    uint64_t m_endTime;
 public:
-	TimeDiff() {gettimeofday(&m_startTime, NULL);}
-	inline void Reset() {gettimeofday(&m_startTime, NULL);}
-	inline void Stop() {gettimeofday(&m_endTime, NULL);}
+	TimeDiff() : m_startTime(MonotonicNanos()), m_endTime(m_startTime) {}
+	inline void Reset() {m_startTime = MonotonicNanos();}
+	inline void Stop() {m_endTime = MonotonicNanos();}
     inline int ElapsedInSecond() {
-        return (m_endTime.tv_sec - m_startTime.tv_sec);
+        return (m_endTime - m_startTime) / 1000000000;
     }
 	inline int ElapsedInMillisecond() {
-		return (m_endTime.tv_sec - m_startTime.tv_sec) * 1000 + 
-			(m_endTime.tv_usec - m_startTime.tv_usec) / 1000;
+		return (m_endTime - m_startTime) / 1000000;
     }
 	inline int ElapsedInMicrosecond() {
-		return (m_endTime.tv_sec - m_startTime.tv_sec) * 1000000 + 
-			(m_endTime.tv_usec - m_startTime.tv_usec);
+		return (m_endTime - m_startTime) / 1000;
+    }
+    inline uint64_t ElapsedInNanosecond() {
+        return m_endTime - m_startTime;
     }
     inline void StopAndWait(int interval_in_ms) {
-        gettimeofday(&m_endTime, NULL);
+        Stop();
         int rt_in_ms = ElapsedInMillisecond();
         if (rt_in_ms < interval_in_ms) {
             poll(nullptr, 0, interval_in_ms - rt_in_ms);
@@ -79,10 +81,9 @@ public:
     }
 };
 
+// Wall clock, for timestamps.  Use MonotonicMillis() for intervals.
 inline uint64_t GetTimeStampInMS() {
-	struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    return (tv.tv_sec) * 1000 + (tv.tv_usec) / 1000;
+    return WallNanos() / 1000000;
 }
 
 inline int GetLocalHour() {
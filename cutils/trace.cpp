@@ -0,0 +1,421 @@
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/prctl.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
+#include <vector>
+
+#include "buffer.h"
+#include "cutils.h"
+
+namespace cutils {
+namespace trace {
+
+std::atomic<bool> g_enabled(false);
+std::atomic<bool> g_use_tsc(false);
+
+namespace {
+
+// File layout: fixed32 magic, fixed32 pid, then records of a type byte
+// followed by varints
+const uint32_t kMagic = 0x31525443; // "CTR1"
+
+enum FileRecordType {
+    kNameRecord = 1,   // id, length prefixed name
+    kThreadRecord = 2, // tid, length prefixed thread name
+    kSpanRecord = 3,   // tid, name id, begin ns, duration ns
+    kDropRecord = 4,   // tid, spans dropped, ns
+};
+
+const int kMaxNames = 4096;
+
+struct Event {
+    uint64_t begin;
+    uint64_t end;
+    uint16_t name_id;
+};
+
+// Single producer (the owning thread), single consumer (the flusher)
+struct Ring {
+    static const uint64_t kSize = 8192; // power of 2
+
+    std::atomic<uint64_t> head; // next slot to fill, owner only
+    char pad1[64];
+    std::atomic<uint64_t> tail; // next slot to drain, flusher only
+    char pad2[64];
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> dead;     // the owning thread has exited
+
+    // flusher only
+    uint64_t dropped_reported;
+    bool announced;
+
+    int tid;
+    char thread_name[17];
+    Event events[kSize];
+};
+
+struct Tracer {
+    std::mutex mu; // names, num_names and rings
+    const char* names[kMaxNames];
+    int num_names = 0;
+    std::vector<Ring*> rings;
+
+    std::mutex flush_mu; // everything below
+    int fd = -1;
+    int names_written = 0;
+    bool use_tsc = false;
+    uint64_t anchor_tick = 0;
+    uint64_t anchor_ns = 0;
+    double ticks_per_ns = 1.0;
+    int interval_ms = 100;
+    AsyncWorkerPtr bg = nullptr;
+};
+
+// Never destroyed: threads may still record or exit (releasing their
+// ring) during static destruction
+Tracer& GetTracer() {
+    static Tracer* tracer = new Tracer;
+    return *tracer;
+}
+
+struct RingHolder {
+    Ring* ring = nullptr;
+    ~RingHolder();
+};
+
+thread_local RingHolder t_ring;
+
+// Set once t_ring is destroyed.  Spans from thread_local destructors that
+// run after it are dropped: the flusher may have freed the ring already.
+thread_local bool t_ring_gone = false;
+
+RingHolder::~RingHolder() {
+    if (ring) ring->dead.store(true, std::memory_order_release);
+    ring = nullptr;
+    t_ring_gone = true;
+}
+
+Ring* NewRing() {
+    Ring* ring = new Ring();
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->dead = false;
+    ring->dropped_reported = 0;
+    ring->announced = false;
+    ring->tid = GetTid();
+    prctl(PR_GET_NAME, ring->thread_name);
+    Tracer& t = GetTracer();
+    std::lock_guard<std::mutex> guard(t.mu);
+    t.rings.push_back(ring);
+    return ring;
+}
+
+uint64_t ToNanos(const Tracer& t, uint64_t ts) {
+    if (!t.use_tsc) return ts;
+    int64_t ticks = static_cast<int64_t>(ts - t.anchor_tick);
+    return t.anchor_ns + static_cast<int64_t>(ticks / t.ticks_per_ns);
+}
+
+// Drain every ring into the file, or drop the spans if there is no file.
+// REQUIRES: t.flush_mu held
+void Flush(Tracer& t) {
+    std::vector<Ring*> rings;
+    int num_names;
+    {
+        std::lock_guard<std::mutex> guard(t.mu);
+        rings = t.rings;
+        num_names = t.num_names;
+    }
+
+    BufferWriter buf(64 << 10, 64 << 10);
+    for (; t.names_written < num_names; ++t.names_written) {
+        buf.AppendFixed8(kNameRecord);
+        buf.PutVarint32(t.names_written);
+        buf.PutLengthPrefixedSlice(t.names[t.names_written]);
+    }
+
+    std::vector<Ring*> dead;
+    for (Ring* ring : rings) {
+        // everything a dead thread recorded is visible after this load
+        bool is_dead = ring->dead.load(std::memory_order_acquire);
+        if (!ring->announced) {
+            buf.AppendFixed8(kThreadRecord);
+            buf.PutVarint32(ring->tid);
+            buf.PutLengthPrefixedSlice(ring->thread_name);
+            ring->announced = true;
+        }
+
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (uint64_t i = tail; i < head; ++i) {
+            const Event& e = ring->events[i & (Ring::kSize - 1)];
+            uint64_t begin = ToNanos(t, e.begin);
+            uint64_t end = ToNanos(t, e.end);
+            buf.AppendFixed8(kSpanRecord);
+            buf.PutVarint32(ring->tid);
+            buf.PutVarint32(e.name_id);
+            buf.PutVarint64(begin);
+            buf.PutVarint64(end > begin ? end - begin : 0);
+        }
+        ring->tail.store(head, std::memory_order_release);
+
+        uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+        if (dropped != ring->dropped_reported) {
+            buf.AppendFixed8(kDropRecord);
+            buf.PutVarint32(ring->tid);
+            buf.PutVarint64(dropped - ring->dropped_reported);
+            buf.PutVarint64(MonotonicNanos());
+            ring->dropped_reported = dropped;
+        }
+        if (is_dead) dead.push_back(ring);
+    }
+
+    if (!dead.empty()) {
+        std::lock_guard<std::mutex> guard(t.mu);
+        for (Ring* ring : dead) {
+            for (size_t i = 0; i < t.rings.size(); ++i) {
+                if (t.rings[i] == ring) {
+                    t.rings[i] = t.rings.back();
+                    t.rings.pop_back();
+                    break;
+                }
+            }
+            delete ring;
+        }
+    }
+
+    if (t.fd >= 0) buf.WriteTo(t.fd);
+}
+
+void FlusherRun(Tracer* t, bool& stop) {
+    SetThreadTitle("trace_flush");
+    while (!IsStopped(stop)) {
+        poll(nullptr, 0, t->interval_ms);
+        std::lock_guard<std::mutex> guard(t->flush_mu);
+        Flush(*t);
+    }
+}
+
+void AppendJsonString(std::string* out, const Slice& s) {
+    out->push_back('"');
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(c);
+        } else if (c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out->append(esc);
+        } else {
+            out->push_back(c);
+        }
+    }
+    out->push_back('"');
+}
+
+} // namespace
+
+uint16_t RegisterName(const char* name) {
+    Tracer& t = GetTracer();
+    std::lock_guard<std::mutex> guard(t.mu);
+    for (int i = 0; i < t.num_names; ++i) {
+        if (strcmp(t.names[i], name) == 0) return i;
+    }
+    if (t.num_names == kMaxNames) {
+        // out of ids, share the last one
+        return kMaxNames - 1;
+    }
+    t.names[t.num_names] = name;
+    return t.num_names++;
+}
+
+void Record(uint16_t name_id, uint64_t begin, uint64_t end) {
+    if (t_ring_gone) return;
+    Ring* ring = t_ring.ring;
+    if (ring == nullptr) {
+        ring = t_ring.ring = NewRing();
+    }
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= Ring::kSize) {
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+        return;
+    }
+    Event& e = ring->events[head & (Ring::kSize - 1)];
+    e.begin = begin;
+    e.end = end;
+    e.name_id = name_id;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+int StartTracing(const std::string& path, int flush_interval_ms) {
+    Tracer& t = GetTracer();
+    std::lock_guard<std::mutex> guard(t.flush_mu);
+    if (t.fd >= 0) return -EBUSY;
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -errno;
+
+    // drop leftovers of an earlier session, they may be in other units
+    Flush(t);
+    {
+        std::lock_guard<std::mutex> guard(t.mu);
+        for (Ring* ring : t.rings) ring->announced = false;
+    }
+
+    t.use_tsc = TscIsInvariant();
+    if (t.use_tsc) {
+        t.ticks_per_ns = TscTicksPerNano();
+        t.anchor_ns = MonotonicNanos();
+        t.anchor_tick = ReadTsc();
+    }
+    g_use_tsc.store(t.use_tsc, std::memory_order_relaxed);
+
+    BufferWriter header(64);
+    header.PutFixed32(kMagic);
+    header.PutFixed32(GetPid());
+    int ret = header.WriteTo(fd);
+    if (ret != 0) {
+        close(fd);
+        return ret;
+    }
+
+    t.fd = fd;
+    t.names_written = 0;
+    t.interval_ms = flush_interval_ms;
+    g_enabled.store(true, std::memory_order_relaxed);
+    t.bg = AsyncWorker::Make(&FlusherRun, &t);
+    return 0;
+}
+
+void StopTracing() {
+    Tracer& t = GetTracer();
+    g_enabled.store(false, std::memory_order_relaxed);
+    AsyncWorkerPtr bg;
+    {
+        std::lock_guard<std::mutex> guard(t.flush_mu);
+        bg = std::move(t.bg);
+    }
+    // join outside flush_mu, the flusher takes it
+    bg = nullptr;
+
+    std::lock_guard<std::mutex> guard(t.flush_mu);
+    if (t.fd < 0) return;
+    Flush(t);
+    close(t.fd);
+    t.fd = -1;
+}
+
+int ConvertToChromeJson(const std::string& trace_path,
+                        const std::string& json_path) {
+    int fd = open(trace_path.c_str(), O_RDONLY);
+    if (fd < 0) return -errno;
+    std::string data;
+    char block[64 << 10];
+    while (true) {
+        ssize_t n = read(fd, block, sizeof(block));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int err = -errno;
+            close(fd);
+            return err;
+        }
+        if (n == 0) break;
+        data.append(block, n);
+    }
+    close(fd);
+
+    BufferReader in(data);
+    if (in.GetFixed32() != kMagic) return -__LINE__;
+    uint32_t pid = in.GetFixed32();
+
+    std::vector<std::string> names(kMaxNames);
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    char num[128];
+    while (in.ok() && !in.empty()) {
+        uint8_t type = in.RemoveFixed8();
+        // every record but a name starts with the thread id
+        uint32_t tid = 0;
+        if (type != kNameRecord) tid = in.GetVarint32();
+        switch (type) {
+            case kNameRecord: {
+                uint32_t id = in.GetVarint32();
+                Slice name = in.GetLengthPrefixedSlice();
+                if (id >= (uint32_t)kMaxNames) return -__LINE__;
+                names[id] = name.ToString();
+                continue;
+            }
+            case kThreadRecord: {
+                Slice name = in.GetLengthPrefixedSlice();
+                out.append(first ? "\n" : ",\n");
+                snprintf(num, sizeof(num),
+                         "{\"ph\":\"M\",\"name\":\"thread_name\","
+                         "\"pid\":%u,\"tid\":%u,\"args\":{\"name\":",
+                         pid, tid);
+                out.append(num);
+                AppendJsonString(&out, name);
+                out.append("}}");
+                break;
+            }
+            case kSpanRecord: {
+                uint32_t id = in.GetVarint32();
+                uint64_t begin = in.GetVarint64();
+                uint64_t dur = in.GetVarint64();
+                if (id >= (uint32_t)kMaxNames) return -__LINE__;
+                out.append(first ? "\n" : ",\n");
+                out.append("{\"ph\":\"X\",\"name\":");
+                AppendJsonString(&out, names[id]);
+                snprintf(num, sizeof(num),
+                         ",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         pid, tid, begin / 1e3, dur / 1e3);
+                out.append(num);
+                break;
+            }
+            case kDropRecord: {
+                uint64_t count = in.GetVarint64();
+                uint64_t ts = in.GetVarint64();
+                out.append(first ? "\n" : ",\n");
+                snprintf(num, sizeof(num),
+                         "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"trace_dropped\","
+                         "\"pid\":%u,\"tid\":%u,\"ts\":%.3f,"
+                         "\"args\":{\"count\":%lu}}",
+                         pid, tid, ts / 1e3, (unsigned long)count);
+                out.append(num);
+                break;
+            }
+            default:
+                return -__LINE__;
+        }
+        first = false;
+    }
+    if (!in.ok()) return -__LINE__;
+    out.append("\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    fd = open(json_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -errno;
+    BufferWriter writer(64);
+    writer.AppendRef(out);
+    int ret = writer.WriteTo(fd);
+    close(fd);
+    return ret;
+}
+
+} // namespace trace
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
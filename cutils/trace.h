@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#include "clock.h"
+
+namespace cutils {
+namespace trace {
+
+// Scoped trace spans for timeline views of hot paths.
+//
+//   void Handle() {
+//       CUTILS_TRACE_SPAN("Handle");
+//       ...
+//   }
+//
+// A span records (name, begin, end) into a lock-free ring owned by the
+// calling thread, with no allocation after the thread's first span.  A
+// background flusher started by StartTracing() drains the rings into a
+// binary file that ConvertToChromeJson() turns into trace-event JSON for
+// chrome://tracing or Perfetto.  A full ring drops spans rather than
+// block.  When tracing is off a span costs one relaxed load.
+
+extern std::atomic<bool> g_enabled;
+extern std::atomic<bool> g_use_tsc;
+
+inline bool Enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+// Timestamp in the unit of the rings: TSC ticks when the TSC is
+// invariant, MonotonicNanos() otherwise
+inline uint64_t Now() {
+    return g_use_tsc.load(std::memory_order_relaxed) ? ReadTsc()
+                                                      : MonotonicNanos();
+}
+
+// Id of a span name, registering it on first use.  "name" must outlive
+// tracing, a string literal in practice.  Takes a lock, call it once per
+// call site as CUTILS_TRACE_SPAN does.
+uint16_t RegisterName(const char* name);
+
+// Record a span of this thread, timestamps from Now()
+void Record(uint16_t name_id, uint64_t begin, uint64_t end);
+
+class Span {
+public:
+    explicit Span(uint16_t name_id)
+        : name_id_(name_id), begin_(Enabled() ? Now() : 0) {}
+
+    ~Span() {
+        if (begin_ != 0) Record(name_id_, begin_, Now());
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    uint16_t name_id_;
+    uint64_t begin_;
+};
+
+// Start writing spans to "path" every flush_interval_ms.
+// Return 0 or -errno, -EBUSY if already tracing.
+int StartTracing(const std::string& path, int flush_interval_ms = 100);
+
+// Stop recording, flush what is left and close the file
+void StopTracing();
+
+// Convert a file written by the flusher to Chrome trace-event JSON.
+// Return 0, -errno, or -__LINE__ for a malformed file.
+int ConvertToChromeJson(const std::string& trace_path,
+                        const std::string& json_path);
+
+} // namespace trace
+} // namespace cutils
+
+#define CUTILS_TRACE_CONCAT_(a, b) a##b
+#define CUTILS_TRACE_CONCAT(a, b) CUTILS_TRACE_CONCAT_(a, b)
+
+#define CUTILS_TRACE_SPAN(name)                                            \
+    static const uint16_t CUTILS_TRACE_CONCAT(cutils_trace_id_, __LINE__) = \
+        ::cutils::trace::RegisterName(name);                               \
+    ::cutils::trace::Span CUTILS_TRACE_CONCAT(cutils_trace_span_, __LINE__)( \
+        CUTILS_TRACE_CONCAT(cutils_trace_id_, __LINE__))
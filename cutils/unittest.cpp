@@ -0,0 +1,1376 @@
+#include "buffer.h"
+#include "circle_queue.h"
+#include "coding.h"
+#include "concurrency_limiter.h"
+#include "crc32c.h"
+#include "cutils.h"
+#include "dir_scan.h"
+#include "file.h"
+#include "freq_ctrl.h"
+#include "key_coding.h"
+#include "log_reader.h"
+#include "log_writer.h"
+#include "mapped_file.h"
+#include "random.h"
+#include "stream_vbyte.h"
+#include "trace.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cutils;
+
+// A minimal test harness: TEST(name) { ... } registers a test, EXPECT()
+// and EXPECT_EQ() report a failure and go on.
+//
+//   unittest [--stress=N] [name substring...]
+//
+// --stress multiplies the iterations of the stress and fuzz tests.
+
+namespace {
+
+struct TestCase {
+    const char* name;
+    void (*func)();
+};
+
+std::vector<TestCase>& Tests() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+struct TestRegistrar {
+    TestRegistrar(const char* name, void (*func)()) {
+        Tests().push_back({name, func});
+    }
+};
+
+std::atomic<int> g_failures(0);
+int g_stress = 1;
+
+template <typename A, typename B>
+void ExpectEq(const A& a, const B& b, const char* expr, const char* file,
+              int line) {
+    if (a == b) return;
+    std::ostringstream ss;
+    ss << a << " vs " << b;
+    fprintf(stderr, "%s:%d: EXPECT_EQ(%s) failed: %s\n", file, line, expr,
+            ss.str().c_str());
+    ++g_failures;
+}
+
+} // namespace
+
+#define TEST(name)                                                   \
+    static void Test_##name();                                       \
+    static TestRegistrar test_registrar_##name(#name, Test_##name);  \
+    static void Test_##name()
+
+#define EXPECT(cond)                                                      \
+    do {                                                                  \
+        if (!(cond)) {                                                    \
+            fprintf(stderr, "%s:%d: EXPECT(%s) failed\n", __FILE__,       \
+                    __LINE__, #cond);                                     \
+            ++g_failures;                                                 \
+        }                                                                 \
+    } while (0)
+
+#define EXPECT_EQ(a, b) ExpectEq((a), (b), #a ", " #b, __FILE__, __LINE__)
+
+namespace {
+
+std::string RandomBytes(Xoshiro256pp* rand, size_t n) {
+    std::string s(n, 0);
+    rand->Fill(&s[0], n);
+    return s;
+}
+
+// Values spread over every varint length
+uint64_t RandomVarint(Xoshiro256pp* rand) {
+    int bits = rand->Uniform(65);
+    return bits == 0 ? 0 : rand->Next() >> (64 - bits);
+}
+
+} // namespace
+
+// clsCircleQueue
+
+TEST(CircleQueueSingleThread) {
+    clsCircleQueue<uintptr_t> q(4);
+    uintptr_t v = 0;
+    EXPECT_EQ(q.Take(&v), -1);
+    for (uintptr_t i = 1; i <= 4; ++i) EXPECT_EQ(q.Push(i), 0);
+    EXPECT(q.IsFull());
+    EXPECT_EQ(q.Push(5), -1);
+    EXPECT_EQ(q.Size(), 4u);
+    for (uintptr_t i = 1; i <= 4; ++i) {
+        EXPECT_EQ(q.Take(&v), 0);
+        EXPECT_EQ(v, i);
+    }
+    EXPECT_EQ(q.Take(&v), -1);
+
+    q.Resize(3);
+    for (uintptr_t i = 1; i <= 3; ++i) EXPECT_EQ(q.PushByMultiThread(i), 0);
+    EXPECT_EQ(q.PushByMultiThread(4), -1);
+    EXPECT_EQ(q.Back(&v), 0);
+    EXPECT_EQ(v, 1u);
+    uintptr_t batch[8];
+    EXPECT_EQ(q.MultiTakeByOneThread(batch, 8), 3);
+    EXPECT_EQ(batch[2], 3u);
+    EXPECT_EQ(q.TakeByOneThread(&v), -1);
+}
+
+// Producers push (id, seq) pairs through PushByMultiThread against one
+// consumer: every element must come out once, and each producer's in the
+// order it pushed them.
+TEST(CircleQueueMultiProducer) {
+    const int producers = 4;
+    const uint32_t per_producer = 20000 * g_stress;
+    clsCircleQueue<uintptr_t> q(64);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < per_producer; ++i) {
+                uintptr_t v = ((uintptr_t)p << 32 | i) + 1;
+                while (q.PushByMultiThread(v) != 0) sched_yield();
+            }
+        });
+    }
+    std::vector<uint32_t> next(producers, 0);
+    uint64_t got = 0;
+    uintptr_t batch[16];
+    while (got < (uint64_t)producers * per_producer) {
+        int n;
+        if (got & 1) {
+            n = q.MultiTakeByOneThread(batch, 16);
+        } else {
+            n = q.TakeByOneThread(batch) == 0 ? 1 : 0;
+        }
+        if (n <= 0) {
+            sched_yield();
+            continue;
+        }
+        for (int i = 0; i < n; ++i) {
+            uintptr_t v = batch[i] - 1;
+            int p = v >> 32;
+            uint32_t seq = v & 0xffffffff;
+            EXPECT(p < producers);
+            if (p >= producers) continue;
+            EXPECT_EQ(seq, next[p]);
+            next[p] = seq + 1;
+        }
+        got += n;
+    }
+    for (auto& t : threads) t.join();
+    for (int p = 0; p < producers; ++p) EXPECT_EQ(next[p], per_producer);
+    EXPECT_EQ(q.Size(), 0u);
+}
+
+// CQueue and BlockingCQueue
+
+namespace {
+
+// Checks of a multi-producer multi-consumer run: each consumer sees each
+// producer's items in order, and together they see every item once.
+struct MpmcChecker {
+    MpmcChecker(int producers, uint32_t per_producer)
+        : per_producer(per_producer), seen(producers * per_producer) {
+        for (auto& s : seen) s = 0;
+    }
+
+    void Check(std::vector<int64_t>* last, uint64_t v) {
+        int p = v >> 32;
+        uint32_t seq = v & 0xffffffff;
+        if (p >= (int)last->size() || seq >= per_producer) {
+            EXPECT(false);
+            return;
+        }
+        EXPECT((int64_t)seq > (*last)[p]);
+        (*last)[p] = seq;
+        seen[p * per_producer + seq]++;
+    }
+
+    void Verify() {
+        int bad = 0;
+        for (auto& s : seen) bad += s != 1;
+        EXPECT_EQ(bad, 0);
+    }
+
+    uint32_t per_producer;
+    std::vector<std::atomic<uint8_t>> seen;
+};
+
+} // namespace
+
+TEST(CQueueMpmc) {
+    const int producers = 4, consumers = 3;
+    const uint32_t per_producer = 20000 * g_stress;
+    const uint64_t total = (uint64_t)producers * per_producer;
+    CQueue<uint64_t> q;
+    MpmcChecker checker(producers, per_producer);
+    std::atomic<uint64_t> consumed(0);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < per_producer;) {
+                if (i % 3 == 0) {
+                    q.Push(std::unique_ptr<uint64_t>(
+                            new uint64_t((uint64_t)p << 32 | i)));
+                    ++i;
+                    continue;
+                }
+                std::vector<std::unique_ptr<uint64_t>> batch;
+                for (int k = 0; k < 8 && i < per_producer; ++k, ++i) {
+                    batch.emplace_back(new uint64_t((uint64_t)p << 32 | i));
+                }
+                q.BatchPush(batch, 4, consumers);
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c]() {
+            std::vector<int64_t> last(producers, -1);
+            while (consumed.load() < total) {
+                if (c == 0) {
+                    auto item = q.Pop(std::chrono::microseconds(1000));
+                    if (item == nullptr) continue;
+                    checker.Check(&last, *item);
+                    consumed++;
+                } else {
+                    auto items = q.BatchPop(5, std::chrono::microseconds(1000));
+                    for (auto& item : items) checker.Check(&last, *item);
+                    consumed += items.size();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(consumed.load(), total);
+    EXPECT_EQ(q.Size(), 0u);
+    checker.Verify();
+}
+
+TEST(BlockingCQueueMpmc) {
+    const int producers = 4, consumers = 3;
+    const uint32_t per_producer = 20000 * g_stress;
+    const uint64_t total = (uint64_t)producers * per_producer;
+    // small enough that producers block on a full queue
+    BlockingCQueue<uint64_t> q(8);
+    MpmcChecker checker(producers, per_producer);
+    std::atomic<uint64_t> consumed(0);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < per_producer; ++i) {
+                uint64_t v = (uint64_t)p << 32 | i;
+                if (i & 1) {
+                    q.Push(v);
+                } else {
+                    while (!q.TryPush(v, 1)) {}
+                }
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c]() {
+            std::vector<int64_t> last(producers, -1);
+            uint64_t batch[4];
+            while (consumed.load() < total) {
+                int n = 0;
+                if (c == 0) {
+                    n = q.TryPop(batch, 1) ? 1 : 0;
+                } else {
+                    q.TryPop(batch, 4, n, 1);
+                }
+                for (int i = 0; i < n; ++i) checker.Check(&last, batch[i]);
+                consumed += n;
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(consumed.load(), total);
+    EXPECT(q.Empty());
+    checker.Verify();
+}
+
+// AsyncWorkerPool
+
+TEST(AsyncWorkerPoolAddTask) {
+    const int submitters = 3;
+    const int per_submitter = 5000 * g_stress;
+    std::vector<std::atomic<uint8_t>> ran(submitters * per_submitter);
+    for (auto& r : ran) r = 0;
+    std::atomic<int> done(0);
+    {
+        AsyncWorkerPool pool(4, 16);
+        std::vector<std::thread> threads;
+        for (int s = 0; s < submitters; ++s) {
+            threads.emplace_back([&, s]() {
+                for (int i = 0; i < per_submitter; ++i) {
+                    int id = s * per_submitter + i;
+                    pool.AddTask([&, id]() {
+                        ran[id]++;
+                        done++;
+                    });
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        while (done.load() < submitters * per_submitter) usleep(100);
+    }
+    int bad = 0;
+    for (auto& r : ran) bad += r != 1;
+    EXPECT_EQ(bad, 0);
+}
+
+TEST(AsyncWorkerPoolTimers) {
+    AsyncWorkerPool pool(1, 64);
+    std::mutex mu;
+    std::vector<int> order;
+    std::atomic<int> done(0);
+    uint64_t now = MonotonicNanos();
+    // added out of order, two with the same deadline
+    const int delays_ms[] = {30, 10, 20, 10, 0};
+    for (int i = 0; i < 5; ++i) {
+        pool.AddTaskAt(now + delays_ms[i] * 1000000ULL, [&, i]() {
+            std::lock_guard<std::mutex> guard(mu);
+            order.push_back(i);
+            done++;
+        });
+    }
+    while (done.load() < 5) usleep(1000);
+    EXPECT(MonotonicNanos() - now >= 30000000);
+    std::vector<int> expected = {4, 1, 3, 2, 0};
+    std::lock_guard<std::mutex> guard(mu);
+    EXPECT(order == expected);
+}
+
+TEST(AsyncWorkerPoolRunSeqTask) {
+    AsyncWorkerPool pool(4, 16);
+    const int max_seq = 10000;
+    std::vector<std::atomic<uint8_t>> ran(max_seq);
+    for (auto& r : ran) r = 0;
+    AsyncSeqTaskProfiler profiler;
+    int ret = pool.RunSeqTaskAndWait(4, max_seq,
+                                     [&](int seq, std::atomic<int>&) {
+        ran[seq]++;
+    }, &profiler);
+    EXPECT_EQ(ret, 0);
+    int bad = 0;
+    for (auto& r : ran) bad += r != 1;
+    EXPECT_EQ(bad, 0);
+    uint32_t handled = 0;
+    for (auto h : profiler.worker_handle) handled += h;
+    EXPECT_EQ(handled, (uint32_t)max_seq);
+    EXPECT(!profiler.Format().empty());
+
+    // an error code stops the remaining tasks
+    std::atomic<int> calls(0);
+    ret = pool.RunSeqTaskAndWait(1, max_seq,
+                                 [&](int seq, std::atomic<int>& code) {
+        calls++;
+        if (seq == 10) code = -7;
+    });
+    EXPECT_EQ(ret, -7);
+    EXPECT_EQ(calls.load(), 11);
+
+    // Format() on a profiler not filled by RunSeqTaskAndWait
+    AsyncSeqTaskProfiler partial;
+    partial.concur = 2;
+    partial.max_seq = 0;
+    partial.beg_ts = partial.end_ts = 0;
+    partial.worker_beg_ts.resize(2);
+    partial.worker_end_ts.resize(2);
+    EXPECT(!partial.Format().empty());
+}
+
+// Decoders: round trips, truncation, and random input
+
+TEST(VarintRoundTrip) {
+    Xoshiro256pp rand(1);
+    for (int round = 0; round < 200 * g_stress; ++round) {
+        size_t n = rand.Uniform(64);
+        std::vector<uint32_t> v32(n);
+        std::vector<uint64_t> v64(n);
+        std::string buf32, buf64;
+        for (size_t i = 0; i < n; ++i) {
+            v64[i] = RandomVarint(&rand);
+            v32[i] = (uint32_t)v64[i];
+            size_t before = buf64.size();
+            PutVarint32(&buf32, v32[i]);
+            PutVarint64(&buf64, v64[i]);
+            EXPECT_EQ((size_t)VarintLength(v64[i]), buf64.size() - before);
+        }
+        std::string batch32, batch64;
+        PutVarint32Batch(&batch32, v32.data(), n);
+        PutVarint64Batch(&batch64, v64.data(), n);
+        EXPECT(batch32 == buf32);
+        EXPECT(batch64 == buf64);
+
+        Slice in32(buf32), in64(buf64);
+        std::vector<uint32_t> out32(n);
+        std::vector<uint64_t> out64(n);
+        for (size_t i = 0; i < n; ++i) {
+            EXPECT(GetVarint32(&in32, &out32[i]));
+            EXPECT(GetVarint64(&in64, &out64[i]));
+        }
+        EXPECT(in32.empty() && in64.empty());
+        EXPECT(out32 == v32);
+        EXPECT(out64 == v64);
+
+        // every strict prefix is truncated
+        if (n > 0) {
+            Slice cut32(buf32.data(), buf32.size() - 1);
+            Slice cut64(buf64.data(), buf64.size() - 1);
+            EXPECT(!GetVarint32Batch(&cut32, out32.data(), n));
+            EXPECT(!GetVarint64Batch(&cut64, out64.data(), n));
+        }
+
+        int64_t z = (int64_t)rand.Next();
+        std::string zz;
+        PutZigZagVarint64(&zz, z);
+        PutZigZagVarint32(&zz, (int32_t)z);
+        Slice zin(zz);
+        int64_t z64 = 0;
+        int32_t z32 = 0;
+        EXPECT(GetZigZagVarint64(&zin, &z64) && z64 == z);
+        EXPECT(GetZigZagVarint32(&zin, &z32) && z32 == (int32_t)z);
+    }
+}
+
+// One by one and batch decoding must agree on any input, and never read
+// past it (checked by ASan)
+TEST(VarintFuzz) {
+    Xoshiro256pp rand(2);
+    for (int round = 0; round < 20000 * g_stress; ++round) {
+        size_t len = rand.Uniform(40);
+        std::string bytes = RandomBytes(&rand, len);
+        // bias towards continuation bytes
+        for (auto& c : bytes) {
+            if (rand.Uniform(2)) c |= 0x80;
+        }
+        std::vector<char> heap(bytes.begin(), bytes.end());
+        Slice in(heap.data(), heap.size());
+        size_t n = 1 + rand.Uniform(8);
+
+        std::vector<uint32_t> a32(n), b32(n);
+        Slice one = in;
+        bool ok_one = true;
+        for (size_t i = 0; i < n && ok_one; ++i) {
+            ok_one = GetVarint32(&one, &a32[i]);
+        }
+        Slice batch = in;
+        bool ok_batch = GetVarint32Batch(&batch, b32.data(), n);
+        EXPECT_EQ(ok_one, ok_batch);
+        if (ok_one && ok_batch) {
+            EXPECT(a32 == b32);
+            EXPECT_EQ(one.size(), batch.size());
+        }
+
+        std::vector<uint64_t> a64(n), b64(n);
+        one = in;
+        ok_one = true;
+        for (size_t i = 0; i < n && ok_one; ++i) {
+            ok_one = GetVarint64(&one, &a64[i]);
+        }
+        batch = in;
+        ok_batch = GetVarint64Batch(&batch, b64.data(), n);
+        EXPECT_EQ(ok_one, ok_batch);
+        if (ok_one && ok_batch) {
+            EXPECT(a64 == b64);
+            EXPECT_EQ(one.size(), batch.size());
+        }
+
+        Slice lp = in, result;
+        if (GetLengthPrefixedSlice(&lp, &result)) {
+            EXPECT(result.data() >= in.data());
+            EXPECT(result.data() + result.size() <= in.data() + in.size());
+            EXPECT(lp.data() == result.data() + result.size());
+        }
+
+        int64_t dod[8];
+        Slice dod_in = in;
+        GetDeltaOfDelta64(&dod_in, dod, n);
+    }
+}
+
+TEST(LengthPrefixedSlice) {
+    Xoshiro256pp rand(3);
+    std::string buf;
+    std::vector<std::string> values;
+    std::vector<size_t> offsets;
+    for (int i = 0; i < 100; ++i) {
+        values.push_back(RandomBytes(&rand, rand.Uniform(300)));
+        offsets.push_back(buf.size());
+        PutLengthPrefixedSlice(&buf, values.back());
+    }
+    Slice in(buf);
+    for (auto& v : values) {
+        Slice s;
+        EXPECT(GetLengthPrefixedSlice(&in, &s));
+        EXPECT(s == Slice(v));
+    }
+    EXPECT(in.empty());
+    // any record cut short fails
+    for (size_t i = 0; i < values.size(); ++i) {
+        size_t len = (i + 1 < values.size() ? offsets[i + 1] : buf.size()) -
+                     offsets[i];
+        std::vector<char> cut(buf.begin() + offsets[i],
+                              buf.begin() + offsets[i] + len - 1);
+        Slice cut_in(cut.data(), cut.size());
+        Slice s;
+        EXPECT(!GetLengthPrefixedSlice(&cut_in, &s));
+    }
+}
+
+TEST(StreamVByteFuzz) {
+    Xoshiro256pp rand(4);
+    for (int round = 0; round < 2000 * g_stress; ++round) {
+        size_t n = rand.Uniform(100);
+        bool delta = rand.Uniform(2);
+        std::vector<uint32_t> v32(n);
+        std::vector<uint64_t> v64(n);
+        for (size_t i = 0; i < n; ++i) {
+            v64[i] = RandomVarint(&rand);
+            v32[i] = (uint32_t)v64[i];
+        }
+        if (delta) {
+            std::sort(v32.begin(), v32.end());
+            std::sort(v64.begin(), v64.end());
+        }
+        std::string buf32, buf64;
+        PutStreamVByte32(&buf32, v32.data(), n, delta);
+        PutStreamVByte64(&buf64, v64.data(), n, delta);
+        std::vector<uint32_t> out32;
+        std::vector<uint64_t> out64;
+        Slice in32(buf32), in64(buf64);
+        EXPECT(GetStreamVByte32(&in32, &out32, delta) && in32.empty());
+        EXPECT(GetStreamVByte64(&in64, &out64, delta) && in64.empty());
+        EXPECT(out32 == v32);
+        EXPECT(out64 == v64);
+
+        // truncated, then corrupted copies on the heap so ASan sees
+        // any overread
+        std::vector<char> cut(buf32.begin(), buf32.end() - 1);
+        Slice cut_in(cut.data(), cut.size());
+        if (n > 0) EXPECT(!GetStreamVByte32(&cut_in, &out32, delta));
+        std::vector<char> bad(buf64.begin(), buf64.end());
+        for (int k = 0; k < 3 && !bad.empty(); ++k) {
+            bad[rand.Uniform(bad.size())] = (char)rand.Next();
+        }
+        Slice bad_in(bad.data(), bad.size());
+        GetStreamVByte64(&bad_in, &out64, delta);
+
+        std::string noise = RandomBytes(&rand, rand.Uniform(64));
+        std::vector<char> heap(noise.begin(), noise.end());
+        Slice noise_in(heap.data(), heap.size());
+        GetStreamVByte32(&noise_in, &out32, delta);
+        std::vector<uint32_t> raw(16);
+        StreamVByteDecode32(heap.data(), heap.data() + heap.size(),
+                            raw.data(), rand.Uniform(17));
+    }
+}
+
+TEST(BufferReaderFuzz) {
+    Xoshiro256pp rand(5);
+    for (int round = 0; round < 5000 * g_stress; ++round) {
+        BufferWriter w(64, 64);
+        std::vector<uint64_t> values;
+        int ops = rand.Uniform(20);
+        for (int i = 0; i < ops; ++i) {
+            uint64_t v = RandomVarint(&rand);
+            values.push_back(v);
+            switch (i % 5) {
+                case 0: w.PutVarint64(v); break;
+                case 1: w.PutFixed32((uint32_t)v); break;
+                case 2: w.PutZigZagVarint64((int64_t)v); break;
+                case 3: w.AppendFixed64(v); break;
+                case 4: w.PutVarint32((uint32_t)v); break;
+            }
+        }
+        std::string buf = w.ToString();
+        EXPECT_EQ(buf.size(), w.size());
+        BufferReader r(buf);
+        for (int i = 0; i < ops; ++i) {
+            uint64_t v = values[i], got = 0;
+            switch (i % 5) {
+                case 0: got = r.GetVarint64(); break;
+                case 1: got = r.GetFixed32(); v = (uint32_t)v; break;
+                case 2: got = r.GetZigZagVarint64(); break;
+                case 3: got = r.RemoveFixed64(); break;
+                case 4: got = r.GetVarint32(); v = (uint32_t)v; break;
+            }
+            EXPECT_EQ(got, v);
+        }
+        EXPECT(r.ok() && r.empty());
+
+        // random reads over random bytes must fail cleanly
+        std::string noise = RandomBytes(&rand, rand.Uniform(32));
+        std::vector<char> heap(noise.begin(), noise.end());
+        BufferReader nr(Slice(heap.data(), heap.size()));
+        for (int i = 0; i < 10; ++i) {
+            switch (rand.Uniform(6)) {
+                case 0: nr.GetVarint64(); break;
+                case 1: nr.GetFixed64(); break;
+                case 2: nr.GetLengthPrefixedSlice(); break;
+                case 3: nr.RemoveFixed16(); break;
+                case 4: nr.GetBytes(rand.Uniform(8)); break;
+                case 5: nr.GetVarint32(); break;
+            }
+        }
+        if (!nr.ok()) EXPECT(nr.empty());
+    }
+}
+
+TEST(OrderedKeyFuzz) {
+    Xoshiro256pp rand(6);
+    for (int round = 0; round < 5000 * g_stress; ++round) {
+        std::string a = RandomBytes(&rand, rand.Uniform(8));
+        std::string b = RandomBytes(&rand, rand.Uniform(8));
+        for (auto& c : a) c &= rand.Uniform(2) ? 0xff : 0x01;
+        bool desc = rand.Uniform(2);
+        std::string ka, kb;
+        OrderedKeyBuilder(&ka).String(a, desc).Uint64(round);
+        OrderedKeyBuilder(&kb).String(b, desc).Uint64(round);
+        int cmp = Slice(a).compare(b);
+        int kcmp = Slice(ka).compare(kb);
+        if (desc) cmp = -cmp;
+        EXPECT((cmp < 0) == (kcmp < 0) && (cmp == 0) == (kcmp == 0));
+        OrderedKeyReader r(ka);
+        EXPECT(r.String(desc) == a);
+        EXPECT_EQ(r.Uint64(), (uint64_t)round);
+        EXPECT(r.ok() && r.empty());
+
+        std::string noise = RandomBytes(&rand, rand.Uniform(16));
+        std::vector<char> heap(noise.begin(), noise.end());
+        Slice in(heap.data(), heap.size());
+        std::string out;
+        if (RemoveOrderedString(&in, &out, desc)) {
+            EXPECT(out.size() <= heap.size());
+        }
+    }
+}
+
+TEST(OrderedKeyNan) {
+    volatile double zero = 0.0;
+    double nans[] = {
+        std::numeric_limits<double>::quiet_NaN(),
+        -std::numeric_limits<double>::quiet_NaN(),
+        zero / zero,
+    };
+    for (double nan : nans) {
+        for (int desc = 0; desc < 2; ++desc) {
+            std::string inf, key;
+            AppendOrderedDouble(&inf, HUGE_VAL, desc);
+            AppendOrderedDouble(&key, nan, desc);
+            EXPECT(desc ? key < inf : inf < key);
+
+            std::string finf, fkey;
+            AppendOrderedFloat(&finf, HUGE_VALF, desc);
+            AppendOrderedFloat(&fkey, (float)nan, desc);
+            EXPECT(desc ? fkey < finf : finf < fkey);
+
+            Slice in(key);
+            double out;
+            EXPECT(RemoveOrderedDouble(&in, &out, desc) && std::isnan(out));
+        }
+    }
+}
+
+TEST(BitPackedFuzz) {
+    Xoshiro256pp rand(7);
+    for (int round = 0; round < 500 * g_stress; ++round) {
+        size_t n = rand.Uniform(600);
+        bool delta = rand.Uniform(2);
+        int bits = rand.Uniform(33);
+        std::vector<uint32_t> v(n);
+        for (auto& x : v) {
+            x = bits == 0 ? 0 : (uint32_t)(rand.Next() >> (64 - bits));
+        }
+        if (delta) std::sort(v.begin(), v.end());
+        std::string buf;
+        PutBitPacked32(&buf, v.data(), n, delta);
+        Slice in(buf);
+        BitPackedReader32 reader;
+        EXPECT(reader.Init(&in) && in.empty());
+        EXPECT_EQ(reader.size(), n);
+        for (size_t i = 0; i < n; i += 1 + rand.Uniform(50)) {
+            EXPECT_EQ(reader.Get(i), v[i]);
+        }
+
+        std::vector<char> bad(buf.begin(), buf.end());
+        if (rand.Uniform(2) && !bad.empty()) bad.resize(rand.Uniform(bad.size()));
+        for (int k = 0; k < 2 && !bad.empty(); ++k) {
+            bad[rand.Uniform(bad.size())] = (char)rand.Next();
+        }
+        Slice bad_in(bad.data(), bad.size());
+        BitPackedReader32 bad_reader;
+        if (bad_reader.Init(&bad_in)) {
+            std::vector<uint32_t> block(kBitPackBlockSize);
+            for (size_t b = 0; b < bad_reader.num_blocks(); ++b) {
+                bad_reader.DecodeBlock(b, block.data());
+            }
+        }
+    }
+}
+
+TEST(LogReaderFuzz) {
+    Xoshiro256pp rand(8);
+    char path[] = "/tmp/cutils_unittest_log.XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT(fd >= 0);
+    if (fd < 0) return;
+    unlink(path);
+    std::vector<std::string> records;
+    {
+        log::Writer writer(fd);
+        for (int i = 0; i < 200; ++i) {
+            // some records span several blocks
+            size_t len = rand.Uniform(8) == 0 ? rand.Uniform(100000)
+                                              : rand.Uniform(200);
+            records.push_back(RandomBytes(&rand, len));
+            EXPECT_EQ(writer.AddRecord(records.back()), 0);
+        }
+    }
+    std::string data(lseek(fd, 0, SEEK_END), 0);
+    EXPECT_EQ(pread(fd, &data[0], data.size(), 0), (ssize_t)data.size());
+    close(fd);
+
+    {
+        log::Reader reader(data);
+        Slice rec;
+        size_t i = 0;
+        while (reader.ReadRecord(&rec)) {
+            EXPECT(i < records.size() && rec == Slice(records[i]));
+            ++i;
+        }
+        EXPECT_EQ(i, records.size());
+    }
+
+    // corrupted and truncated copies: records that come out are whole
+    // ones, in order
+    for (int round = 0; round < 50 * g_stress; ++round) {
+        std::vector<char> bad(data.begin(), data.end());
+        bad.resize(rand.Uniform(bad.size() + 1));
+        for (int k = rand.Uniform(10); k > 0 && !bad.empty(); --k) {
+            bad[rand.Uniform(bad.size())] = (char)rand.Next();
+        }
+        log::Reader reader(Slice(bad.data(), bad.size()));
+        Slice rec;
+        size_t next = 0;
+        while (reader.ReadRecord(&rec)) {
+            while (next < records.size() && !(rec == Slice(records[next]))) {
+                ++next;
+            }
+            EXPECT(next < records.size());
+            ++next;
+        }
+    }
+}
+
+// ScanDir
+
+namespace {
+
+void WriteFile(const std::string& fn) {
+    int fd = open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    EXPECT(fd >= 0);
+    if (fd >= 0) close(fd);
+}
+
+std::vector<std::string> Scan(const std::string& dir,
+                              const ScanOptions& options) {
+    std::mutex mu;
+    std::vector<std::string> paths;
+    int ret = ScanDir(dir, options, [&](const DirEntry& entry) {
+        std::lock_guard<std::mutex> guard(mu);
+        paths.push_back(entry.path.ToString());
+        return true;
+    });
+    EXPECT_EQ(ret, 0);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+} // namespace
+
+TEST(ScanDir) {
+    char tmp[] = "/tmp/cutils_unittest_scan.XXXXXX";
+    EXPECT(mkdtemp(tmp) != nullptr);
+    std::string root = tmp;
+    mkdir((root + "/d1").c_str(), 0755);
+    mkdir((root + "/d1/d2").c_str(), 0755);
+    WriteFile(root + "/a.log");
+    WriteFile(root + "/b.txt");
+    WriteFile(root + "/.hidden");
+    WriteFile(root + "/d1/c.log");
+    WriteFile(root + "/d1/d2/e.log");
+    EXPECT_EQ(symlink("d1", (root + "/link").c_str()), 0);
+
+    typedef std::vector<std::string> Paths;
+    ScanOptions options;
+    EXPECT(Scan(root, options) ==
+           Paths({".hidden", "a.log", "b.txt", "link"}));
+    options.include_dirs = true;
+    options.include_hidden = false;
+    EXPECT(Scan(root, options) == Paths({"a.log", "b.txt", "d1", "link"}));
+
+    options = ScanOptions();
+    options.recursive = true;
+    options.matcher = NameMatcher::Suffix(".log");
+    EXPECT(Scan(root, options) ==
+           Paths({"a.log", "d1/c.log", "d1/d2/e.log"}));
+    options.max_depth = 1;
+    EXPECT(Scan(root, options) == Paths({"a.log", "d1/c.log"}));
+    options.max_depth = -1;
+    options.matcher = NameMatcher::Glob("[bc].*");
+    EXPECT(Scan(root, options) == Paths({"b.txt", "d1/c.log"}));
+    options.matcher = NameMatcher::Prefix("d");
+    options.include_dirs = true;
+    EXPECT(Scan(root, options) == Paths({"d1", "d1/d2"}));
+
+    // the link leads to d1 once, under whichever path comes first
+    options = ScanOptions();
+    options.recursive = true;
+    options.follow_symlinks = true;
+    options.matcher = NameMatcher::Substring("e.");
+    Paths paths = Scan(root, options);
+    EXPECT(paths == Paths({"d1/d2/e.log"}) ||
+           paths == Paths({"link/d2/e.log"}));
+
+    // a wide tree on a pool gives the same entries as on one thread
+    for (int i = 0; i < 20; ++i) {
+        std::string sub = root + "/d1/w" + std::to_string(i);
+        mkdir(sub.c_str(), 0755);
+        for (int j = 0; j < 50; ++j) {
+            WriteFile(sub + "/f" + std::to_string(j));
+        }
+    }
+    options = ScanOptions();
+    options.recursive = true;
+    options.include_dirs = true;
+    Paths serial = Scan(root, options);
+    EXPECT_EQ(serial.size(), 1028u);
+    {
+        AsyncWorkerPool pool(4, 16);
+        options.pool = &pool;
+        EXPECT(Scan(root, options) == serial);
+        options.buffer_size = 512;
+        EXPECT(Scan(root, options) == serial);
+
+        std::atomic<int> seen(0);
+        int ret = ScanDir(root, options, [&](const DirEntry&) {
+            return ++seen < 100;
+        });
+        EXPECT_EQ(ret, 1);
+        EXPECT(seen.load() >= 100 && seen.load() < 1028);
+    }
+
+    // helpers dequeued after ScanDir() returned find nothing to do and
+    // touch none of the caller's objects
+    {
+        AsyncWorkerPool pool(1, 16);
+        std::atomic<bool> release(false), drained(false);
+        pool.AddTask([&]() {
+            while (!release.load()) usleep(100);
+        });
+        {
+            ScanOptions late;
+            late.recursive = true;
+            late.include_dirs = true;
+            late.pool = &pool;
+            late.parallelism = 4;
+            EXPECT(Scan(root, late) == serial);
+        }
+        release = true;
+        pool.AddTask([&]() { drained = true; });
+        while (!drained.load()) usleep(100);
+    }
+
+    EXPECT_EQ(ScanDir(root + "/none", ScanOptions(),
+                      [](const DirEntry&) { return true; }), -ENOENT);
+
+    std::vector<std::string> files;
+    EXPECT_EQ(ScanFiles(root, ".", files), 0);
+    std::sort(files.begin(), files.end());
+    EXPECT(files == Paths({".hidden", "a.log", "b.txt"}));
+    files.clear();
+    EXPECT_EQ(ScanFiles(root + "/none", "", files), -1);
+
+    EXPECT_EQ(DeleteFileOrDir(root, 1), 0);
+}
+
+TEST(RemoveTree) {
+    char tmp[] = "/tmp/cutils_unittest_rm.XXXXXX";
+    EXPECT(mkdtemp(tmp) != nullptr);
+    std::string root = tmp;
+    std::string keep = root + "/keep";
+    mkdir(keep.c_str(), 0755);
+    WriteFile(keep + "/k");
+    auto make_tree = [&](const std::string& top) {
+        mkdir(top.c_str(), 0755);
+        WriteFile(top + "/.hidden");
+        EXPECT_EQ(symlink("../keep", (top + "/link").c_str()), 0);
+        for (int i = 0; i < 8; ++i) {
+            std::string dir = top + "/d" + std::to_string(i);
+            mkdir(dir.c_str(), 0755);
+            mkdir((dir + "/.deep").c_str(), 0755);
+            mkdir((dir + "/.deep/er").c_str(), 0755);
+            for (int j = 0; j < 30; ++j) {
+                WriteFile(dir + "/f" + std::to_string(j));
+                WriteFile(dir + "/.deep/er/f" + std::to_string(j));
+            }
+        }
+    };
+    // 2 + 8 * 60 files, 8 * 3 directories below "top"
+    const uint64_t kFiles = 482, kDirs = 24;
+
+    std::string top = root + "/top";
+    make_tree(top);
+    std::atomic<int> reports(0);
+    RemoveOptions options;
+    options.progress_every = 100;
+    options.progress = [&](const RemoveStats&) { ++reports; };
+    RemoveStats stats;
+    EXPECT_EQ(RemoveTree(top, options, &stats), 0);
+    EXPECT_EQ(stats.files, kFiles);
+    EXPECT_EQ(stats.dirs, kDirs + 1);
+    EXPECT_EQ(reports.load(), 6);
+    EXPECT(Access(top) != 0);
+    EXPECT_EQ(Access(keep + "/k"), 0);
+    EXPECT_EQ(RemoveTree(top, options), 0);
+
+    {
+        AsyncWorkerPool pool(4, 16);
+        TokenBucket limiter(1e5, 100);
+        make_tree(top);
+        options = RemoveOptions();
+        options.pool = &pool;
+        options.limiter = &limiter;
+        options.keep_root = true;
+        EXPECT_EQ(RemoveTree(top, options, &stats), 0);
+        EXPECT_EQ(stats.files, kFiles);
+        EXPECT_EQ(stats.dirs, kDirs);
+        std::vector<std::string> files;
+        EXPECT_EQ(ScanFiles(top, "", files), 0);
+        EXPECT(files.empty());
+        EXPECT_EQ(rmdir(top.c_str()), 0);
+    }
+
+    make_tree(top);
+    EXPECT_EQ(EmptyDirectory(top), 0);
+    EXPECT_EQ(rmdir(top.c_str()), 0);
+    make_tree(top);
+    EXPECT_EQ(DeleteFileOrDir(top, 0), -1);
+    EXPECT_EQ(DeleteFileOrDir(top, 1), 0);
+    EXPECT(Access(top) != 0);
+    EXPECT_EQ(EmptyDirectory(top), -ENOENT);
+    EXPECT_EQ(symlink("keep", (root + "/link").c_str()), 0);
+    EXPECT_EQ(DeleteFileOrDir(root + "/link", 1), 0);
+
+    // top/a is swapped for a symlink to "keep" while the removal runs:
+    // before a is opened (the 1st removal), or after, before a/b is (the
+    // 2nd).  The symlink is removed, nothing under keep is.
+    mkdir((keep + "/b").c_str(), 0755);
+    WriteFile(keep + "/b/precious");
+    for (uint64_t swap_at = 1; swap_at <= 2; ++swap_at) {
+        mkdir(top.c_str(), 0755);
+        WriteFile(top + "/f");
+        mkdir((top + "/a").c_str(), 0755);
+        WriteFile(top + "/a/g");
+        mkdir((top + "/a/b").c_str(), 0755);
+        WriteFile(top + "/a/b/h");
+        std::string moved = root + "/moved";
+        options = RemoveOptions();
+        options.progress_every = 1;
+        bool swapped = false;
+        options.progress = [&](const RemoveStats& progress) {
+            if (swapped || progress.files != swap_at) return;
+            swapped = true;
+            EXPECT_EQ(rename((top + "/a").c_str(), moved.c_str()), 0);
+            EXPECT_EQ(symlink("../keep", (top + "/a").c_str()), 0);
+        };
+        EXPECT_EQ(RemoveTree(top, options), 0);
+        EXPECT(swapped);
+        EXPECT(Access(top) != 0);
+        EXPECT_EQ(Access(keep + "/b/precious"), 0);
+        EXPECT_EQ(DeleteFileOrDir(moved, 1), 0);
+    }
+    EXPECT_EQ(RemoveTree(keep + "/k", RemoveOptions()), 0);
+    EXPECT_EQ(DeleteFileOrDir(root, 1), 0);
+    EXPECT(Access(root) != 0);
+}
+
+// MappedFile
+
+TEST(MappedFile) {
+    char path[] = "/tmp/cutils_unittest_map.XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT(fd >= 0);
+    if (fd < 0) return;
+    Xoshiro256pp rand(10);
+    std::string content = RandomBytes(&rand, 100000);
+    EXPECT_EQ(pwrite(fd, content.data(), content.size(), 0),
+              (ssize_t)content.size());
+    close(fd);
+
+    MappedFile file;
+    EXPECT_EQ(file.Open(path), 0);
+    EXPECT(file.data() == Slice(content));
+    EXPECT(file.mutable_data() == nullptr);
+    EXPECT_EQ(file.Advise(MappedFile::kSequential), 0);
+#ifdef MADV_HUGEPAGE
+    EXPECT_EQ(file.Advise(MappedFile::kHugePage, 5000, 100), 0);
+#else
+    EXPECT_EQ(file.Advise(MappedFile::kHugePage, 5000, 100), -EINVAL);
+#endif
+    EXPECT_EQ(file.Resize(10), -EPERM);
+
+    // windows at unaligned offsets, clipped to the end
+    MappedFile::Options options;
+    options.max_map = 30000;
+    options.populate = true;
+    EXPECT_EQ(file.Open(path, options), 0);
+    EXPECT_EQ(file.file_size(), content.size());
+    EXPECT(file.data() == Slice(content.data(), 30000));
+    for (int i = 0; i < 20; ++i) {
+        uint64_t off = rand.Uniform(content.size() + 10);
+        size_t len = rand.Uniform(50000);
+        EXPECT_EQ(file.MapWindow(off, len), 0);
+        off = std::min<uint64_t>(off, content.size());
+        len = std::min<size_t>(len, content.size() - off);
+        EXPECT_EQ(file.offset(), off);
+        EXPECT(file.data() == Slice(content.data() + off, len));
+    }
+
+    // growth within the reserve keeps the mapping in place
+    options = MappedFile::Options();
+    options.writable = true;
+    options.reserve = 1 << 20;
+    EXPECT_EQ(file.Open(path, options), 0);
+    const char* base = file.data().data();
+    EXPECT_EQ(file.Resize(300000), 0);
+    EXPECT(file.data().data() == base);
+    memset(file.mutable_data() + 100000, 'x', 200000);
+    content.append(200000, 'x');
+    EXPECT_EQ(file.Resize(1000), 0);
+    EXPECT(file.data() == Slice(content.data(), 1000));
+    EXPECT_EQ(file.Resize(300000), 0);
+    EXPECT_EQ(file.data()[299999], '\0');
+    EXPECT_EQ(file.Resize(2 << 20), 0);
+    EXPECT(file.data().starts_with(Slice(content.data(), 1000)));
+    file.mutable_data()[(2 << 20) - 1] = 'y';
+    EXPECT_EQ(file.Sync(), 0);
+
+    // growth by another writer
+    MappedFile reader;
+    EXPECT_EQ(reader.Open(path), 0);
+    EXPECT_EQ(file.Resize(3 << 20), 0);
+    EXPECT_EQ(reader.size(), (size_t)(2 << 20));
+    EXPECT_EQ(reader.Refresh(), 0);
+    EXPECT_EQ(reader.size(), (size_t)(3 << 20));
+    EXPECT_EQ(reader.data()[(2 << 20) - 1], 'y');
+    file.Close();
+    reader.Close();
+    EXPECT(!reader.is_open());
+
+    // growth past the address budget switches to windows
+    options = MappedFile::Options();
+    options.max_map = 4 << 20;
+    EXPECT_EQ(reader.Open(path, options), 0);
+    options.writable = true;
+    EXPECT_EQ(file.Open(path, options), 0);
+    EXPECT_EQ(file.size(), (size_t)(3 << 20));
+    EXPECT_EQ(file.Resize(5 << 20), 0);
+    EXPECT_EQ(file.file_size(), (uint64_t)(5 << 20));
+    EXPECT_EQ(file.size(), (size_t)(4 << 20));
+    EXPECT_EQ(file.data()[(2 << 20) - 1], 'y');
+    EXPECT_EQ(reader.Refresh(), 0);
+    EXPECT_EQ(reader.file_size(), (uint64_t)(5 << 20));
+    EXPECT_EQ(reader.size(), (size_t)(4 << 20));
+    EXPECT_EQ(reader.MapWindow(4 << 20, 4 << 20), 0);
+    EXPECT_EQ(reader.size(), (size_t)(1 << 20));
+    reader.Close();
+
+    // a shrink in windows clips the window before the file goes
+    EXPECT_EQ(file.MapWindow(3 << 20, 2 << 20), 0);
+    EXPECT_EQ(file.Resize((4 << 20) + 100), 0);
+    EXPECT_EQ(file.file_size(), (uint64_t)(4 << 20) + 100);
+    EXPECT_EQ(file.size(), (size_t)(1 << 20) + 100);
+    file.mutable_data()[(1 << 20) + 99] = 'z';
+    EXPECT_EQ(file.Resize(1 << 20), 0);
+    EXPECT_EQ(file.offset(), (uint64_t)(1 << 20));
+    EXPECT_EQ(file.size(), 0u);
+    struct stat st;
+    EXPECT(stat(path, &st) == 0 && st.st_size == (1 << 20));
+    EXPECT_EQ(file.MapWindow(0, 2 << 20), 0);
+    EXPECT_EQ(file.size(), (size_t)(1 << 20));
+    file.Close();
+
+    options = MappedFile::Options();
+    options.writable = true;
+    options.create = true;
+    unlink(path);
+    EXPECT_EQ(file.Open(path, options), 0);
+    EXPECT(file.data().empty());
+    EXPECT_EQ(file.Resize(10), 0);
+    EXPECT_EQ(file.size(), 10u);
+    file.Close();
+    unlink(path);
+    EXPECT_EQ(file.Open(path), -ENOENT);
+}
+
+// ConcurrencyLimiter
+
+// Drops back off the limit but do not pull the window RTT down
+TEST(ConcurrencyLimiterDropRtt) {
+    ConcurrencyLimiter::Options options;
+    options.window_ns = 0;
+    options.min_window_samples = 10;
+    ConcurrencyLimiter limiter(options);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT(limiter.TryAcquire());
+        bool dropped = i % 2 == 1;
+        limiter.Release(dropped ? 0 : 1000000, dropped);
+    }
+    EXPECT_EQ(limiter.WindowRttNanos(), 1000000u);
+    EXPECT(limiter.Limit() < options.initial_limit);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT(limiter.TryAcquire());
+        limiter.Release(0, true);
+    }
+    EXPECT_EQ(limiter.WindowRttNanos(), 1000000u);
+}
+
+// FreqCtrl
+
+TEST(FreqCtrlBeforeInit) {
+    FreqCtrl ctrl;
+    EXPECT(!ctrl.ShouldGo());
+    EXPECT(!ctrl.ShouldGo());
+    ctrl.Init("unittest", 10);
+    int admitted = 0;
+    for (int i = 0; i < 20; ++i) admitted += ctrl.ShouldGo();
+    EXPECT(admitted >= 10 && admitted < 20);
+}
+
+// Trace
+
+namespace {
+
+// Records a span from its destructor, which runs after the thread's ring
+// holder is gone when it was constructed before the first span
+struct LateSpan {
+    ~LateSpan() { CUTILS_TRACE_SPAN("late"); }
+};
+
+} // namespace
+
+TEST(TraceSpanAfterThreadExit) {
+    char path[] = "/tmp/cutils_unittest_trace.XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT(fd >= 0);
+    if (fd < 0) return;
+    close(fd);
+    std::string json = std::string(path) + ".json";
+    EXPECT_EQ(trace::StartTracing(path, 10), 0);
+    std::thread([]() {
+        static thread_local LateSpan late;
+        (void)late;
+        CUTILS_TRACE_SPAN("early");
+    }).join();
+    trace::StopTracing();
+    EXPECT_EQ(trace::ConvertToChromeJson(path, json), 0);
+
+    std::string out;
+    char buf[4096];
+    fd = open(json.c_str(), O_RDONLY);
+    ssize_t n;
+    while (fd >= 0 && (n = read(fd, buf, sizeof(buf))) > 0) out.append(buf, n);
+    if (fd >= 0) close(fd);
+    EXPECT(out.find("\"early\"") != std::string::npos);
+    EXPECT(out.find("\"late\"") == std::string::npos);
+    unlink(path);
+    unlink(json.c_str());
+}
+
+// CRC32C
+
+namespace {
+
+const crc32c::Kernel kKernels[] = {crc32c::kTable, crc32c::kSSE42,
+                                   crc32c::kSSE42Pclmul, crc32c::kPower8};
+
+} // namespace
+
+// Known answers from RFC 3720 B.4 and the LevelDB tests, on every kernel
+TEST(Crc32cKnownAnswers) {
+    char buf[48];
+    for (auto kernel : kKernels) {
+        if (!crc32c::IsKernelSupported(kernel)) continue;
+        auto crc = [&](const char* data, size_t n) {
+            return crc32c::ExtendWith(kernel, 0, data, n);
+        };
+        memset(buf, 0, 32);
+        EXPECT_EQ(crc(buf, 32), 0x8a9136aau);
+        memset(buf, 0xff, 32);
+        EXPECT_EQ(crc(buf, 32), 0x62a8ab43u);
+        for (int i = 0; i < 32; ++i) buf[i] = i;
+        EXPECT_EQ(crc(buf, 32), 0x46dd794eu);
+        for (int i = 0; i < 32; ++i) buf[i] = 31 - i;
+        EXPECT_EQ(crc(buf, 32), 0x113fdb5cu);
+        const unsigned char iscsi[48] = {
+            0x01, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+            0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x18,
+            0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        };
+        EXPECT_EQ(crc((const char*)iscsi, 48), 0xd9963a56u);
+        EXPECT_EQ(crc("123456789", 9), 0xe3069283u);
+        EXPECT_EQ(crc("", 0), 0u);
+        EXPECT_EQ(crc32c::ExtendWith(kernel, crc("hello ", 6), "world", 5),
+                  crc("hello world", 11));
+    }
+    uint32_t v = crc32c::Value("foo", 3);
+    EXPECT(crc32c::Mask(v) != v);
+    EXPECT(crc32c::Mask(crc32c::Mask(v)) != v);
+    EXPECT_EQ(crc32c::Unmask(crc32c::Mask(v)), v);
+    EXPECT_EQ(crc32c::Unmask(crc32c::Unmask(crc32c::Mask(crc32c::Mask(v)))),
+              v);
+}
+
+// CurrentKernel() names the kernel Extend() picked by itself, not kAuto
+TEST(Crc32cCurrentKernel) {
+    EXPECT_EQ(crc32c::Value("x", 1), crc32c::ExtendWith(crc32c::kTable, 0,
+                                                        "x", 1));
+    EXPECT(crc32c::CurrentKernel() != crc32c::kAuto);
+    EXPECT(crc32c::IsKernelSupported(crc32c::CurrentKernel()));
+
+    // an explicit choice sticks, for Extend() and CurrentKernel() alike
+    EXPECT(crc32c::SetKernel(crc32c::kTable));
+    EXPECT_EQ(crc32c::CurrentKernel(), crc32c::kTable);
+    EXPECT_EQ(crc32c::Value("x", 1), crc32c::ExtendWith(crc32c::kTable, 0,
+                                                        "x", 1));
+    EXPECT_EQ(crc32c::CurrentKernel(), crc32c::kTable);
+    EXPECT(crc32c::SetKernel(crc32c::kAuto));
+    EXPECT(crc32c::CurrentKernel() != crc32c::kAuto);
+}
+
+// Every kernel agrees with the table one at any length and alignment, and
+// so do the combine, copy, iovec, batch and parallel variants
+TEST(Crc32cKernelsAgree) {
+    Xoshiro256pp rand(9);
+    std::string data = RandomBytes(&rand, 1 << 16);
+    for (int round = 0; round < 500 * g_stress; ++round) {
+        size_t off = rand.Uniform(64);
+        size_t n = rand.Uniform(2) ? rand.Uniform(64)
+                                   : rand.Uniform(data.size() - off);
+        uint32_t init = rand.Uniform(2) ? (uint32_t)rand.Next() : 0;
+        const char* p = data.data() + off;
+        uint32_t expected = crc32c::ExtendWith(crc32c::kTable, init, p, n);
+        for (auto kernel : kKernels) {
+            if (!crc32c::IsKernelSupported(kernel)) continue;
+            EXPECT_EQ(crc32c::ExtendWith(kernel, init, p, n), expected);
+        }
+        EXPECT_EQ(crc32c::Extend(init, p, n), expected);
+
+        size_t split = n == 0 ? 0 : rand.Uniform(n + 1);
+        uint32_t a = crc32c::Value(p, split);
+        uint32_t b = crc32c::Value(p + split, n - split);
+        EXPECT_EQ(Crc32cCombine(a, b, n - split), crc32c::Value(p, n));
+
+        std::string dst(n, 0);
+        EXPECT_EQ(CopyAndCrc32c(&dst[0], p, n, init), expected);
+        EXPECT(memcmp(dst.data(), p, n) == 0);
+
+        struct iovec iov[3];
+        size_t cut1 = split, cut2 = split + (n - split) / 2;
+        iov[0].iov_base = (void*)p;
+        iov[0].iov_len = cut1;
+        iov[1].iov_base = (void*)(p + cut1);
+        iov[1].iov_len = cut2 - cut1;
+        iov[2].iov_base = (void*)(p + cut2);
+        iov[2].iov_len = n - cut2;
+        EXPECT_EQ(Crc32cIovec(iov, 3, init), expected);
+        std::string gathered(n, 0);
+        EXPECT_EQ(CopyAndCrc32cIovec(&gathered[0], iov, 3, init), expected);
+        EXPECT(gathered == std::string(p, n));
+    }
+
+    const size_t records = 37;
+    std::vector<const char*> ptrs(records);
+    std::vector<size_t> lens(records);
+    std::vector<uint32_t> crcs(records);
+    for (size_t i = 0; i < records; ++i) {
+        ptrs[i] = data.data() + rand.Uniform(1024);
+        lens[i] = rand.Uniform(2048);
+    }
+    for (bool mask : {false, true}) {
+        Crc32cBatch(ptrs.data(), lens.data(), records, crcs.data(), mask);
+        for (size_t i = 0; i < records; ++i) {
+            uint32_t crc = crc32c::Value(ptrs[i], lens[i]);
+            EXPECT_EQ(crcs[i], mask ? crc32c::Mask(crc) : crc);
+        }
+    }
+
+    std::string big = RandomBytes(&rand, (8 << 20) + 12345);
+    AsyncWorkerPool pool(4, 16);
+    EXPECT_EQ(ParallelCrc32c(big.data(), big.size(), &pool, 7),
+              crc32c::Extend(7, big.data(), big.size()));
+    EXPECT_EQ(ParallelCrc32c(big.data(), 100, &pool),
+              crc32c::Value(big.data(), 100));
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--stress=", 9) == 0) {
+            g_stress = std::max(1, atoi(argv[i] + 9));
+        } else {
+            filters.push_back(argv[i]);
+        }
+    }
+    int failed_tests = 0, run = 0;
+    for (auto& test : Tests()) {
+        bool wanted = filters.empty();
+        for (auto& f : filters) {
+            wanted = wanted || strstr(test.name, f.c_str()) != nullptr;
+        }
+        if (!wanted) continue;
+        int before = g_failures;
+        uint64_t beg = MonotonicNanos();
+        fprintf(stderr, "[ RUN      ] %s\n", test.name);
+        test.func();
+        bool ok = g_failures == before;
+        fprintf(stderr, "[ %s ] %s (%lu ms)\n", ok ? "      OK" : "  FAILED",
+                test.name, (unsigned long)(MonotonicNanos() - beg) / 1000000);
+        failed_tests += !ok;
+        ++run;
+    }
+    fprintf(stderr, "%d tests, %d failed\n", run, failed_tests);
+    return failed_tests == 0 ? 0 : 1;
+}
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
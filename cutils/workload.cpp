@@ -0,0 +1,147 @@
+#include "workload.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "key_coding.h"
+
+namespace cutils {
+
+namespace {
+
+const size_t kValuePoolSize = 1 << 20;
+const size_t kValuePiece = 100;
+
+// At least "len" bytes of text whose kValuePiece byte pieces each repeat
+// their first ratio * kValuePiece random bytes, as LevelDB's db_bench
+// values
+void FillCompressible(Xoshiro256pp* rand, double ratio, size_t len,
+                      std::string* out) {
+    size_t raw = std::min(kValuePiece,
+                          std::max<size_t>(1, kValuePiece * ratio));
+    std::string piece(kValuePiece, ' ');
+    while (out->size() < len) {
+        for (size_t i = 0; i < raw; ++i) {
+            piece[i] = ' ' + rand->Uniform(95);
+        }
+        for (size_t i = raw; i < kValuePiece; ++i) {
+            piece[i] = piece[i % raw];
+        }
+        out->append(piece);
+    }
+}
+
+// "v" as at least "width" zero padded decimals, snprintf is most of the
+// cost of a key otherwise
+void AppendPadded(std::string* out, uint64_t v, int width) {
+    char buf[32];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    while (end - p < width && p > buf) *--p = '0';
+    out->append(p, end - p);
+}
+
+} // namespace
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadOptions& options)
+    : options_(options), num_keys_(options.num_keys), rand_(options.seed) {
+    assert(options_.num_keys > 0);
+    assert(options_.min_value_size <= options_.max_value_size);
+    if (options_.key_distribution == WorkloadOptions::kZipfian ||
+        options_.key_distribution == WorkloadOptions::kScrambledZipfian ||
+        options_.key_distribution == WorkloadOptions::kLatest) {
+        zipf_.reset(new ZipfianDistribution(options_.num_keys,
+                                            options_.zipf_theta));
+    }
+
+    double p[4] = {options_.read_proportion, options_.update_proportion,
+                   options_.insert_proportion, options_.scan_proportion};
+    double total = p[0] + p[1] + p[2] + p[3];
+    double acc = 0;
+    for (int i = 0; i < 4; ++i) {
+        acc += total > 0 ? p[i] / total : (i == 0);
+        op_cdf_[i] = acc;
+    }
+
+    // a value starts anywhere in the first kValuePoolSize bytes
+    FillCompressible(&rand_, options_.compression_ratio,
+                     kValuePoolSize + options_.max_value_size, &values_);
+}
+
+WorkloadGenerator::Op WorkloadGenerator::NextOp() {
+    double u = rand_.NextDouble();
+    for (int i = 0; i < 3; ++i) {
+        if (u < op_cdf_[i]) return (Op)i;
+    }
+    return kScan;
+}
+
+uint64_t WorkloadGenerator::NextKeyId() {
+    switch (options_.key_distribution) {
+        case WorkloadOptions::kSequential:
+            return sequence_++ % num_keys_;
+        case WorkloadOptions::kZipfian:
+            // ids inserted since construction are outside the zipfian
+            // range and stay cold, as in YCSB
+            return zipf_->Next(rand_);
+        case WorkloadOptions::kScrambledZipfian:
+            return ScrambledZipfianDistribution::Fnv1a64(zipf_->Next(rand_))
+                   % num_keys_;
+        case WorkloadOptions::kLatest:
+            return num_keys_ - 1 - zipf_->Next(rand_) % num_keys_;
+        case WorkloadOptions::kUniform:
+        default:
+            return rand_.Uniform(num_keys_);
+    }
+}
+
+uint32_t WorkloadGenerator::NextScanLength() {
+    return 1 + rand_.Uniform(std::max<uint32_t>(1, options_.max_scan_length));
+}
+
+void WorkloadGenerator::FormatKey(uint64_t id, std::string* key) const {
+    key->assign(options_.key_prefix);
+    if (options_.num_groups > 0) {
+        // contiguous blocks of the initial key space, later inserts go to
+        // the last group
+        uint64_t group = std::min<uint64_t>(
+                (unsigned __int128)id * options_.num_groups /
+                options_.num_keys, options_.num_groups - 1);
+        AppendPadded(key, group, 4);
+        key->push_back('/');
+    }
+    uint64_t v = options_.hash_ids ? ScrambledZipfianDistribution::Fnv1a64(id)
+                                   : id;
+    if (options_.binary_ids) {
+        AppendOrderedUint64(key, v);
+    } else {
+        AppendPadded(key, v, options_.key_digits);
+    }
+}
+
+Slice WorkloadGenerator::Key(uint64_t id) {
+    FormatKey(id, &key_);
+    return key_;
+}
+
+Slice WorkloadGenerator::NextValue() {
+    size_t len = options_.min_value_size +
+                 rand_.Uniform(options_.max_value_size -
+                               options_.min_value_size + 1);
+    size_t pos = rand_.Uniform(kValuePoolSize);
+    return Slice(values_.data() + pos, len);
+}
+
+} // namespace cutils
+
+//gzrd_Lib_CPP_Version_ID--start
+#ifndef GZRD_SVN_ATTR
+#define GZRD_SVN_ATTR "0"
+#endif
+static char gzrd_Lib_CPP_Version_ID[] __attribute__((used))="$HeadURL$ $Id$ " GZRD_SVN_ATTR "__file__";
+// gzrd_Lib_CPP_Version_ID--end
+
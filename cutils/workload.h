@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "distribution.h"
+#include "random.h"
+#include "slice.h"
+
+namespace cutils {
+
+// Synthetic key/value workload in the spirit of YCSB, reproducible from
+// a seed: the same options give the same sequence of operations, keys
+// and values on every run.
+//
+// Key ids are chosen from [0, key count) by
+//   kSequential         0, 1, 2, ... wrapping around
+//   kUniform            uniform
+//   kZipfian            YCSB Zipfian, low ids hot
+//   kScrambledZipfian   Zipfian with the hot ids spread by a hash
+//   kLatest             Zipfian over recency: recently inserted ids hot
+// and formatted as key_prefix, then the group prefix if num_groups > 0,
+// then the id (or its hash with hash_ids, so inserts do not arrive in key
+// order) as key_digits zero padded decimals, or as 8 memcomparable bytes
+// with binary_ids:
+//
+//   user0000000000000042          key_prefix "user", key_digits 16
+//   user0003/0000000000000042     with num_groups, group 3
+//
+// Groups split the id range into num_groups contiguous blocks, so that a
+// prefix scan of one group sees a contiguous range of ids.
+//
+// Values are windows into a pool of pseudo random text in which each
+// 100 byte piece repeats its first compression_ratio part, so values
+// compress to about compression_ratio of their size.
+struct WorkloadOptions {
+    enum KeyDistribution {
+        kSequential = 0,
+        kUniform = 1,
+        kZipfian = 2,
+        kScrambledZipfian = 3,
+        kLatest = 4,
+    };
+
+    uint64_t seed = 0;
+
+    uint64_t num_keys = 1000000;
+    KeyDistribution key_distribution = kUniform;
+    double zipf_theta = ZipfianDistribution::kYcsbTheta;
+
+    std::string key_prefix = "key";
+    int key_digits = 16;
+    uint32_t num_groups = 0;
+    bool hash_ids = false;
+    bool binary_ids = false;
+
+    uint32_t min_value_size = 100;
+    uint32_t max_value_size = 100;
+    double compression_ratio = 0.5;
+
+    // operation mix, normalized by their sum
+    double read_proportion = 0.95;
+    double update_proportion = 0.05;
+    double insert_proportion = 0;
+    double scan_proportion = 0;
+    uint32_t max_scan_length = 100;
+};
+
+class WorkloadGenerator {
+public:
+    enum Op {
+        kRead = 0,
+        kUpdate = 1,
+        kInsert = 2,
+        kScan = 3,
+    };
+
+    explicit WorkloadGenerator(const WorkloadOptions& options);
+
+    WorkloadGenerator(const WorkloadGenerator&) = delete;
+    WorkloadGenerator& operator=(const WorkloadGenerator&) = delete;
+
+    // Next operation of the mix
+    Op NextOp();
+
+    // Id of an existing key for a read, update or scan
+    uint64_t NextKeyId();
+    // Id of a new key, growing the key space by one
+    uint64_t NextInsertId() { return num_keys_++; }
+    // Length of a scan in [1, max_scan_length]
+    uint32_t NextScanLength();
+
+    // The key of an id; the Slice version is valid until the next call
+    void FormatKey(uint64_t id, std::string* key) const;
+    Slice Key(uint64_t id);
+    Slice NextKey() { return Key(NextKeyId()); }
+
+    // A value of the configured size and compressibility, valid as long as
+    // the generator
+    Slice NextValue();
+
+    uint64_t num_keys() const { return num_keys_; }
+    const WorkloadOptions& options() const { return options_; }
+
+private:
+    WorkloadOptions options_;
+    uint64_t num_keys_;
+    uint64_t sequence_ = 0;
+    Xoshiro256pp rand_;
+    std::unique_ptr<ZipfianDistribution> zipf_;
+    double op_cdf_[4];
+    std::string key_;
+    std::string values_;
+};
+
+} // namespace cutils